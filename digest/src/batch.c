@@ -0,0 +1,181 @@
+/* Copyright (c) 2014, Nicholas Appleton (http://www.appletonaudio.com)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither Nicholas Appleton nor the names of its contributors may be
+ *       used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL NICHOLAS APPLETON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE. */
+
+#include <stdlib.h>
+#include <pthread.h>
+#include "batch.h"
+
+/* How many jobs each worker may run ahead of the output. */
+#define BATCH_WINDOW_PER_WORKER (64)
+
+struct batch_result {
+	char                *output;
+	size_t               output_size;
+	int                  error;
+	int                  done;
+};
+
+struct batch {
+	pthread_mutex_t      lock;
+	pthread_cond_t       job_done;
+	pthread_cond_t       window_moved;
+
+	batch_job_fn         job;
+	void                *ctx;
+
+	unsigned             nb_jobs;
+	unsigned             window;
+
+	/* Index of the next job to be started and of the next job to be written
+	 * out. */
+	unsigned             next;
+	unsigned             written;
+
+	struct batch_result *results;
+};
+
+static
+void
+run_job(struct batch *b, unsigned index)
+{
+	struct batch_result *res = b->results + index;
+	FILE *f;
+
+	res->output      = NULL;
+	res->output_size = 0;
+
+	f = open_memstream(&res->output, &res->output_size);
+	if (f) {
+		res->error = b->job(b->ctx, index, f);
+		fclose(f);
+	} else {
+		res->error = -1;
+	}
+}
+
+static
+void *
+worker_main(void *arg)
+{
+	struct batch *b = arg;
+
+	pthread_mutex_lock(&b->lock);
+	while (b->next < b->nb_jobs) {
+		unsigned index;
+
+		if (b->next >= b->written + b->window) {
+			pthread_cond_wait(&b->window_moved, &b->lock);
+			continue;
+		}
+
+		index = b->next++;
+		pthread_mutex_unlock(&b->lock);
+
+		run_job(b, index);
+
+		pthread_mutex_lock(&b->lock);
+		b->results[index].done = 1;
+		if (index == b->written)
+			pthread_cond_signal(&b->job_done);
+	}
+	pthread_mutex_unlock(&b->lock);
+
+	return NULL;
+}
+
+int batch_run(unsigned nb_jobs, unsigned nb_workers, batch_job_fn job, void *ctx, FILE *out)
+{
+	struct batch b;
+	pthread_t *threads;
+	unsigned started;
+	unsigned i;
+	int failed = 0;
+
+	if (!nb_jobs)
+		return 0;
+	if (nb_workers > nb_jobs)
+		nb_workers = nb_jobs;
+	if (!nb_workers)
+		nb_workers = 1;
+
+	b.results = calloc(nb_jobs, sizeof(b.results[0]));
+	threads   = malloc(nb_workers * sizeof(threads[0]));
+	if (!b.results || !threads) {
+		free(b.results);
+		free(threads);
+		return -1;
+	}
+
+	b.job     = job;
+	b.ctx     = ctx;
+	b.nb_jobs = nb_jobs;
+	b.window  = nb_workers * BATCH_WINDOW_PER_WORKER;
+	b.next    = 0;
+	b.written = 0;
+	pthread_mutex_init(&b.lock, NULL);
+	pthread_cond_init(&b.job_done, NULL);
+	pthread_cond_init(&b.window_moved, NULL);
+
+	for (started = 0; started < nb_workers; started++)
+		if (pthread_create(threads + started, NULL, worker_main, &b))
+			break;
+
+	/* Nothing has been run or written yet so the caller can report the
+	 * failure cleanly. */
+	if (!started)
+		failed = -1;
+
+	for (i = 0; started && (i < nb_jobs); i++) {
+		struct batch_result *res = b.results + i;
+
+		pthread_mutex_lock(&b.lock);
+		while (!res->done)
+			pthread_cond_wait(&b.job_done, &b.lock);
+		pthread_mutex_unlock(&b.lock);
+
+		if (res->output_size)
+			fwrite(res->output, 1, res->output_size, out);
+		free(res->output);
+		if (res->error)
+			failed++;
+
+		pthread_mutex_lock(&b.lock);
+		b.written = i + 1;
+		pthread_cond_broadcast(&b.window_moved);
+		pthread_mutex_unlock(&b.lock);
+	}
+
+	while (started--)
+		pthread_join(threads[started], NULL);
+
+	pthread_cond_destroy(&b.window_moved);
+	pthread_cond_destroy(&b.job_done);
+	pthread_mutex_destroy(&b.lock);
+	free(threads);
+	free(b.results);
+
+	return failed;
+}
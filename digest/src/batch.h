@@ -0,0 +1,51 @@
+/* Copyright (c) 2014, Nicholas Appleton (http://www.appletonaudio.com)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither Nicholas Appleton nor the names of its contributors may be
+ *       used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL NICHOLAS APPLETON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE. */
+
+#ifndef BATCH_H_
+#define BATCH_H_
+
+#include <stdio.h>
+
+/* Using this API:
+ *
+ * batch_run() executes nb_jobs independent jobs on a pool of nb_workers
+ * threads. Each job is given its index and a stream to write its output to.
+ * The output of every job is written to out in job index order regardless of
+ * the order in which the jobs complete. Workers are only allowed to run a
+ * bounded distance ahead of the oldest job which has not been written out so
+ * that the memory used to hold pending output stays bounded.
+ *
+ * The job function returns zero on success. The output of a failed job is
+ * still written. batch_run() returns the number of jobs which failed or a
+ * negative value, without having run any job, if memory could not be
+ * allocated or no thread of the pool could be started. If only some of the
+ * threads start, the jobs are run on those. */
+
+typedef int (*batch_job_fn)(void *ctx, unsigned index, FILE *out);
+
+int batch_run(unsigned nb_jobs, unsigned nb_workers, batch_job_fn job, void *ctx, FILE *out);
+
+#endif /* BATCH_H_ */
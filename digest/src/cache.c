@@ -0,0 +1,400 @@
+/* Copyright (c) 2014, Nicholas Appleton (http://www.appletonaudio.com)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither Nicholas Appleton nor the names of its contributors may be
+ *       used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL NICHOLAS APPLETON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE. */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "cache.h"
+
+#define CACHE_MAGIC "digest-cache 1"
+
+struct cache_entry {
+	struct cache_entry  *next;
+	struct cache_key     key;
+	unsigned             hash;
+	char                *spec;
+	char                *digest;
+
+	/* Set once the entry has been returned by cache_lookup() or stored
+	 * during this run. Entries which are not used are not written back. */
+	int                  used;
+};
+
+struct cache {
+	pthread_mutex_t      lock;
+	char                *filename;
+	struct cache_entry **buckets;
+	unsigned             nb_buckets;
+	unsigned             nb_entries;
+	unsigned             nb_used;
+	int                  dirty;
+
+	/* Time at which the cache was opened (see cache_now_ns()). */
+	long long            start_ns;
+};
+
+/* The current time as the kernel would use it to stamp a file. Timestamps
+ * are taken from the coarse clock, which can lag the precise one by a tick,
+ * so a precise reading could be later than the mtime of a file which is
+ * modified after it. */
+static
+long long
+cache_now_ns(void)
+{
+	struct timespec ts;
+#ifdef CLOCK_REALTIME_COARSE
+	if (clock_gettime(CLOCK_REALTIME_COARSE, &ts) == 0)
+		return (long long)ts.tv_sec * 1000000000ll + ts.tv_nsec;
+#endif
+	if (clock_gettime(CLOCK_REALTIME, &ts) == 0)
+		return (long long)ts.tv_sec * 1000000000ll + ts.tv_nsec;
+	return (long long)time(NULL) * 1000000000ll;
+}
+
+static
+unsigned
+cache_hash(const struct cache_key *key, const char *spec)
+{
+	unsigned h = 2166136261u;
+	unsigned i;
+	for (i = 0; i < 8; i++)
+		h = (h ^ (unsigned)((key->dev >> (8 * i)) & 0xFF)) * 16777619u;
+	for (i = 0; i < 8; i++)
+		h = (h ^ (unsigned)((key->ino >> (8 * i)) & 0xFF)) * 16777619u;
+	while (*spec)
+		h = (h ^ (unsigned char)*spec++) * 16777619u;
+	return h;
+}
+
+static
+struct cache_entry **
+cache_find(struct cache *c, const struct cache_key *key, const char *spec, unsigned hash)
+{
+	struct cache_entry **e = c->buckets + (hash & (c->nb_buckets - 1));
+	while (*e != NULL) {
+		if (((*e)->hash == hash) && ((*e)->key.dev == key->dev) && ((*e)->key.ino == key->ino) && (strcmp((*e)->spec, spec) == 0))
+			break;
+		e = &((*e)->next);
+	}
+	return e;
+}
+
+static
+int
+cache_grow(struct cache *c)
+{
+	unsigned nb_buckets = (c->nb_buckets) ? (2 * c->nb_buckets) : 1024;
+	struct cache_entry **buckets = calloc(nb_buckets, sizeof(buckets[0]));
+	unsigned i;
+
+	if (!buckets)
+		return -1;
+
+	for (i = 0; i < c->nb_buckets; i++) {
+		while (c->buckets[i] != NULL) {
+			struct cache_entry *e = c->buckets[i];
+			c->buckets[i] = e->next;
+			e->next = buckets[e->hash & (nb_buckets - 1)];
+			buckets[e->hash & (nb_buckets - 1)] = e;
+		}
+	}
+
+	free(c->buckets);
+	c->buckets    = buckets;
+	c->nb_buckets = nb_buckets;
+	return 0;
+}
+
+/* Must be called with the lock held (or before any other thread can see the
+ * cache). */
+static
+void
+cache_mark_used(struct cache *c, struct cache_entry *e)
+{
+	if (!e->used) {
+		e->used = 1;
+		c->nb_used++;
+	}
+}
+
+/* Must be called with the lock held (or before any other thread can see the
+ * cache). The entry is marked as used if used is set. */
+static
+int
+cache_insert(struct cache *c, const struct cache_key *key, const char *spec, const char *digest, int used)
+{
+	unsigned hash = cache_hash(key, spec);
+	struct cache_entry **pos;
+	struct cache_entry *e;
+	char *d;
+
+	if ((c->nb_entries >= c->nb_buckets) && cache_grow(c))
+		return -1;
+
+	d = malloc(strlen(digest) + 1);
+	if (!d)
+		return -1;
+	strcpy(d, digest);
+
+	pos = cache_find(c, key, spec, hash);
+	if (*pos != NULL) {
+		e = *pos;
+		free(e->digest);
+		e->key    = *key;
+		e->digest = d;
+		if (used)
+			cache_mark_used(c, e);
+		return 0;
+	}
+
+	e = malloc(sizeof(*e) + strlen(spec) + 1);
+	if (!e) {
+		free(d);
+		return -1;
+	}
+	e->next   = NULL;
+	e->key    = *key;
+	e->hash   = hash;
+	e->spec   = (char *)(e + 1);
+	e->digest = d;
+	e->used   = 0;
+	strcpy(e->spec, spec);
+	*pos = e;
+	c->nb_entries++;
+	if (used)
+		cache_mark_used(c, e);
+	return 0;
+}
+
+static
+void
+cache_free(struct cache *c)
+{
+	unsigned i;
+	for (i = 0; i < c->nb_buckets; i++) {
+		while (c->buckets[i] != NULL) {
+			struct cache_entry *e = c->buckets[i];
+			c->buckets[i] = e->next;
+			free(e->digest);
+			free(e);
+		}
+	}
+	free(c->buckets);
+	free(c->filename);
+	pthread_mutex_destroy(&c->lock);
+	free(c);
+}
+
+/* Parses "dev ino size mtime ctime spec digest". Returns non-zero if the
+ * line is malformed. */
+static
+int
+cache_parse_line(char *line, struct cache_key *key, char **spec, char **digest)
+{
+	char *s = line;
+	char *end;
+
+	key->dev      = strtoull(s, &end, 10); if (end == s || *end != ' ') return -1; s = end + 1;
+	key->ino      = strtoull(s, &end, 10); if (end == s || *end != ' ') return -1; s = end + 1;
+	key->size     = strtoull(s, &end, 10); if (end == s || *end != ' ') return -1; s = end + 1;
+	key->mtime_ns = strtoll(s, &end, 10);  if (end == s || *end != ' ') return -1; s = end + 1;
+	key->ctime_ns = strtoll(s, &end, 10);  if (end == s || *end != ' ') return -1; s = end + 1;
+
+	*spec = s;
+	s = strchr(s, ' ');
+	if (!s || s == *spec)
+		return -1;
+	*s++ = '\0';
+	*digest = s;
+	return (*s == '\0' || strchr(s, ' ') != NULL) ? -1 : 0;
+}
+
+struct cache *cache_open(const char *filename)
+{
+	struct cache *c = calloc(1, sizeof(*c));
+	char *line = NULL;
+	size_t line_cap = 0;
+	ssize_t len;
+	FILE *f;
+
+	if (!c) {
+		fprintf(stderr, "oom\n");
+		return NULL;
+	}
+	pthread_mutex_init(&c->lock, NULL);
+	c->filename = malloc(strlen(filename) + 1);
+	if (!c->filename || cache_grow(c)) {
+		fprintf(stderr, "oom\n");
+		cache_free(c);
+		return NULL;
+	}
+	strcpy(c->filename, filename);
+	c->start_ns = cache_now_ns();
+
+	f = fopen(filename, "r");
+	if (!f) {
+		if (errno == ENOENT)
+			return c;
+		fprintf(stderr, "could not open cache '%s'\n", filename);
+		cache_free(c);
+		return NULL;
+	}
+
+	/* Refuse to touch anything which does not look like a cache so that a
+	 * mistyped filename cannot be overwritten. */
+	len = getline(&line, &line_cap, f);
+	if ((len >= 0) && (strcmp(line, CACHE_MAGIC "\n") != 0)) {
+		fprintf(stderr, "'%s' is not a digest cache\n", filename);
+		free(line);
+		fclose(f);
+		cache_free(c);
+		return NULL;
+	}
+
+	/* Malformed entries are dropped; they will be recomputed. */
+	while ((len = getline(&line, &line_cap, f)) >= 0) {
+		struct cache_key key;
+		char *spec, *digest;
+		if (len && (line[len-1] == '\n'))
+			line[--len] = '\0';
+		if (cache_parse_line(line, &key, &spec, &digest))
+			continue;
+		if (cache_insert(c, &key, spec, digest, 0)) {
+			fprintf(stderr, "oom\n");
+			break;
+		}
+	}
+
+	free(line);
+	fclose(f);
+	return c;
+}
+
+int cache_close(struct cache *c)
+{
+	size_t tmp_len = strlen(c->filename) + 32;
+	char *tmp;
+	FILE *f;
+	unsigned i;
+	int error = 0;
+
+	/* Entries for files which were not visited (deleted, renamed or just
+	 * not part of this run) are dropped so that the cache does not grow
+	 * without bound. */
+	if (!c->dirty && (c->nb_used == c->nb_entries)) {
+		cache_free(c);
+		return 0;
+	}
+
+	/* Write a new file and move it over the old one so that an interrupted
+	 * run never leaves a truncated cache behind. */
+	tmp = malloc(tmp_len);
+	if (tmp) {
+		snprintf(tmp, tmp_len, "%s.%ld.tmp", c->filename, (long)getpid());
+		f = fopen(tmp, "w");
+	} else {
+		f = NULL;
+	}
+	if (f) {
+		fputs(CACHE_MAGIC "\n", f);
+		for (i = 0; i < c->nb_buckets; i++) {
+			const struct cache_entry *e;
+			for (e = c->buckets[i]; e != NULL; e = e->next)
+				if (e->used)
+					fprintf(f, "%llu %llu %llu %lld %lld %s %s\n", e->key.dev, e->key.ino, e->key.size, e->key.mtime_ns, e->key.ctime_ns, e->spec, e->digest);
+		}
+		error = ferror(f);
+		error = (fclose(f) != 0) || error;
+		if (!error)
+			error = (rename(tmp, c->filename) != 0);
+		if (error)
+			remove(tmp);
+	} else {
+		error = 1;
+	}
+	if (error)
+		fprintf(stderr, "could not write cache '%s'\n", c->filename);
+
+	free(tmp);
+	cache_free(c);
+	return error;
+}
+
+int cache_key_init(struct cache_key *key, const char *filename)
+{
+	struct stat st;
+	if ((stat(filename, &st) != 0) || !S_ISREG(st.st_mode))
+		return -1;
+	key->dev      = (unsigned long long)st.st_dev;
+	key->ino      = (unsigned long long)st.st_ino;
+	key->size     = (unsigned long long)st.st_size;
+	key->mtime_ns = (long long)st.st_mtim.tv_sec * 1000000000ll + st.st_mtim.tv_nsec;
+	key->ctime_ns = (long long)st.st_ctim.tv_sec * 1000000000ll + st.st_ctim.tv_nsec;
+	return 0;
+}
+
+char *cache_lookup(struct cache *c, const struct cache_key *key, const char *spec)
+{
+	unsigned hash = cache_hash(key, spec);
+	struct cache_entry *e;
+	char *digest = NULL;
+
+	pthread_mutex_lock(&c->lock);
+	e = *cache_find(c, key, spec, hash);
+	if ((e != NULL) && (e->key.size == key->size) && (e->key.mtime_ns == key->mtime_ns) && (e->key.ctime_ns == key->ctime_ns)) {
+		cache_mark_used(c, e);
+		digest = malloc(strlen(e->digest) + 1);
+		if (digest)
+			strcpy(digest, e->digest);
+	}
+	pthread_mutex_unlock(&c->lock);
+
+	return digest;
+}
+
+int cache_store(struct cache *c, const struct cache_key *key, const char *spec, const char *digest)
+{
+	int ret;
+
+	/* A file which was modified no earlier than the cache was opened may
+	 * be modified again within the resolution of its timestamps without
+	 * changing the key, so the digest could silently go stale. Such
+	 * "racily clean" files are simply hashed again next time. */
+	if ((key->mtime_ns >= c->start_ns) || (key->ctime_ns >= c->start_ns))
+		return 0;
+
+	pthread_mutex_lock(&c->lock);
+	ret = cache_insert(c, key, spec, digest, 1);
+	if (!ret)
+		c->dirty = 1;
+	pthread_mutex_unlock(&c->lock);
+	return ret;
+}
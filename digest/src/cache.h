@@ -0,0 +1,77 @@
+/* Copyright (c) 2014, Nicholas Appleton (http://www.appletonaudio.com)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither Nicholas Appleton nor the names of its contributors may be
+ *       used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL NICHOLAS APPLETON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE. */
+
+#ifndef CACHE_H_
+#define CACHE_H_
+
+/* Using this API:
+ *
+ * A cache remembers the digests which were produced for files so that they
+ * can be reused when the file has not changed. Entries are keyed by the
+ * device and inode of the file and the specification string which produced
+ * the digest and are only returned if the size, modification time and
+ * change time of the file are exactly as they were when the digest was
+ * stored. Digests are stored in their formatted form.
+ *
+ * cache_open() loads the cache from the given file. A file which does not
+ * exist gives an empty cache. It should be called when the run starts.
+ * cache_close() writes the cache back (only if it has changed) by replacing
+ * the file and frees it. Only the entries which were returned by
+ * cache_lookup() or stored during the run are kept. It returns non-zero if
+ * the cache could not be written.
+ *
+ * cache_key_init() obtains the key for the given file. It returns non-zero
+ * if the file could not be examined, in which case it should simply not be
+ * cached. The key should be obtained before the file is read so that a
+ * modification made while the file is being hashed causes the next lookup
+ * to miss.
+ *
+ * cache_lookup() returns a copy of the stored digest (to be released with
+ * free()) or NULL if there is no valid entry. cache_store() adds or replaces
+ * an entry. It silently declines to store a digest for a file whose
+ * modification or change time is not strictly earlier than the time the
+ * cache was opened, as a further modification in the same timestamp tick
+ * would not be noticed. Both may be called from several threads at once. */
+
+struct cache_key {
+	unsigned long long dev;
+	unsigned long long ino;
+	unsigned long long size;
+	long long          mtime_ns;
+	long long          ctime_ns;
+};
+
+struct cache;
+
+struct cache *cache_open(const char *filename);
+int           cache_close(struct cache *c);
+
+int           cache_key_init(struct cache_key *key, const char *filename);
+
+char         *cache_lookup(struct cache *c, const struct cache_key *key, const char *spec);
+int           cache_store(struct cache *c, const struct cache_key *key, const char *spec, const char *digest);
+
+#endif /* CACHE_H_ */
@@ -28,7 +28,9 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <assert.h>
+#include <sys/stat.h>
 
 #include "hash/hash.h"
 #include "hash/tiger.h"
@@ -36,16 +38,47 @@
 #include "hash/sha2.h"
 #include "hash/sha3.h"
 #include "hash/md4.h"
+#include "hash/ed2k.h"
 #include "hash/md5.h"
 #include "hash/whirlpool.h"
 #include "hash/hashtree.h"
+#include "hash/stitch.h"
+#include "hash/dispatch.h"
+#include "reader.h"
+#include "pipeline.h"
+#include "batch.h"
+#include "uring.h"
+#include "walk.h"
+#include "cache.h"
 
-/* File reading buffer size */
-#define BUFFER_SIZE (8192)
+/* Default number of input buffers shared by the worker threads. */
+#define PIPELINE_DEPTH (4)
+
+/* Maximum number of consecutive files of a batch which are given to a
+ * single io_uring instance. */
+#define URING_FILES_PER_JOB (256)
+
+/* Files read through io_uring which are no larger than SMALL_FILE_SIZE are
+ * held in memory and hashed up to SMALL_FILES_BATCH at a time with the
+ * digest_jobs() method of the hash, which can interleave several messages,
+ * rather than one after the other. */
+#define SMALL_FILE_SIZE     (16384)
+#define SMALL_FILES_BATCH   (32)
+
+/* Options which control how the input is read and hashed. */
+struct process_config {
+	struct reader_config reader;
+
+	/* Number of threads to distribute the steps over and the number of
+	 * buffers which can be read ahead of them. When nb_threads is zero,
+	 * reading and hashing both happen on the calling thread. */
+	unsigned             nb_threads;
+	unsigned             depth;
+};
 
 static
 unsigned
-print_lookup_digest(const unsigned char *data, unsigned data_bits, const char *lookup_table, unsigned lookup_bits)
+print_lookup_digest(FILE *out, const unsigned char *data, unsigned data_bits, const char *lookup_table, unsigned lookup_bits)
 {
 	unsigned i = 0;
 	while (i < data_bits) {
@@ -54,25 +87,25 @@ print_lookup_digest(const unsigned char *data, unsigned data_bits, const char *l
 		for (j = 0; (j < lookup_bits) && (i < data_bits); j++, i++)
 			c = c | (((data[i/8] >> (7 - (i & 7))) & 1) << (lookup_bits - 1 - j));
 		assert(c < (1 << lookup_bits));
-		printf("%c", lookup_table[c]);
+		fputc(lookup_table[c], out);
 	}
 	return data_bits % lookup_bits;
 }
 
 static
 void
-print_hex_digest(const unsigned char *digest, unsigned bits)
+print_hex_digest(FILE *out, const unsigned char *digest, unsigned bits)
 {
 	static const char lookup[16] =
 		{'0', '1', '2', '3' ,'4', '5', '6', '7'
 		,'8', '9', 'A', 'B', 'C', 'D', 'E', 'F'
 		};
-	(void)print_lookup_digest(digest, bits, lookup, 4);
+	(void)print_lookup_digest(out, digest, bits, lookup, 4);
 }
 
 static
 void
-print_base32_digest(const unsigned char *digest, unsigned bits)
+print_base32_digest(FILE *out, const unsigned char *digest, unsigned bits)
 {
 	static const char lookup[32] =
 		{'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H'
@@ -80,18 +113,18 @@ print_base32_digest(const unsigned char *digest, unsigned bits)
 		,'Q', 'R', 'S', 'T', 'U', 'V', 'W', 'X'
 		,'Y', 'Z', '2', '3', '4', '5', '6', '7'
 		};
-	unsigned i = print_lookup_digest(digest, bits, lookup, 5);
+	unsigned i = print_lookup_digest(out, digest, bits, lookup, 5);
 	/* TODO: add tests (there are vectors in RFC4648). This is probably
 	 * wrong. */
 	while (i > 0) {
-		printf("=");
+		fputc('=', out);
 		i--;
 	}
 }
 
 static
 void
-print_base64_digest(const unsigned char *digest, unsigned bits)
+print_base64_digest(FILE *out, const unsigned char *digest, unsigned bits)
 {
 	static const char lookup[64] =
 		{'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H'
@@ -103,16 +136,16 @@ print_base64_digest(const unsigned char *digest, unsigned bits)
 		,'w', 'x', 'y', 'z', '0', '1', '2', '3'
 		,'4', '5', '6', '7', '8', '9', '+', '/'
 		};
-	unsigned i = print_lookup_digest(digest, bits, lookup, 6) / 2;
+	unsigned i = print_lookup_digest(out, digest, bits, lookup, 6) / 2;
 	/* TODO: add tests (there are vectors in RFC4648). This is probably
 	 * wrong. */
 	while (i > 0) {
-		printf("=");
+		fputc('=', out);
 		i--;
 	}
 }
 
-typedef void (*digest_output_func)(const unsigned char *digest, unsigned bits);
+typedef void (*digest_output_func)(FILE *out, const unsigned char *digest, unsigned bits);
 
 struct output_fmt {
 	const char         *name;
@@ -152,12 +185,41 @@ parse_unsigned(const char *s, unsigned *x)
 	return s;
 }
 
+/* Read a size in bytes from the given string. The number may be followed by
+ * one of the binary multiplier suffixes 'k', 'M' or 'G'. The return value is
+ * the position of the first character after the size or NULL if the parse
+ * failed. */
+static
+const char *
+parse_size(const char *s, size_t *x)
+{
+	unsigned v;
+	s = parse_unsigned(s, &v);
+	if (s == NULL)
+		return NULL;
+	*x = v;
+	switch (*s) {
+	case 'k': case 'K': *x <<= 10; s++; break;
+	case 'm': case 'M': *x <<= 20; s++; break;
+	case 'g': case 'G': *x <<= 30; s++; break;
+	default: break;
+	}
+	return s;
+}
+
 struct hash_step {
 	struct hash_s      tree;
 	struct hash_s      hash;
 	int                tree_initialized;
 	digest_output_func output;
 	struct hash_step  *next;
+
+	/* An MD5 step may feed the hash objects of a SHA-1 and a SHA-256 step
+	 * through stitch_process(), in which case those steps have stitched
+	 * set and do nothing with the data themselves (see steps_stitch()). */
+	struct hash_s     *stitch_sha1;
+	struct hash_s     *stitch_sha256;
+	int                stitched;
 };
 
 static
@@ -280,6 +342,21 @@ md4_setup(struct hash_step *step, const char *cfg_str)
 	return 0;
 }
 
+static
+int
+ed2k_setup(struct hash_step *step, const char *cfg_str)
+{
+	if (cfg_str) {
+		fprintf(stderr, "cannot configure ed2k with '%s'\n", cfg_str);
+		return -1;
+	}
+	if (ed2k_create(&step->hash)) {
+		fprintf(stderr, "could not create ed2k hash object\n");
+		return -2;
+	}
+	return 0;
+}
+
 static
 int
 whirlpool_setup(struct hash_step *step, const char *cfg_str)
@@ -330,6 +407,7 @@ static const struct hash_alg supported[] =
 ,	{"sha2", sha2_setup, sha2_help}
 ,	{"sha3", sha3_setup, generic_hash_help}
 ,	{"md4", md4_setup, generic_hash_help}
+,	{"ed2k", ed2k_setup, generic_hash_help}
 ,	{"md5", md5_setup, generic_hash_help}
 ,	{"whirlpool", whirlpool_setup, generic_hash_help}
 };
@@ -474,7 +552,10 @@ struct hash_step *str_to_spec(const char *s)
 		fprintf(stderr, "oom\n");
 		return NULL;
 	}
-	step->next = 0;
+	step->next          = 0;
+	step->stitch_sha1   = NULL;
+	step->stitch_sha256 = NULL;
+	step->stitched      = 0;
 	if (parse_merkle_spec(s, step)) {
 		free(step);
 		step = NULL;
@@ -482,31 +563,138 @@ struct hash_step *str_to_spec(const char *s)
 	return step;
 }
 
-static void process_file(FILE *f, struct hash_step *steps)
+static void process_step(struct hash_step *step, const unsigned char *data, size_t size)
 {
-	unsigned char buffer[BUFFER_SIZE];
-	size_t read;
-	while ((read = fread(buffer, 1, sizeof(buffer), f))) {
-		struct hash_step *t;
-		for (t = steps; t != NULL; t = t->next) {
-			if (t->tree_initialized)
-				t->tree.process(&t->tree, buffer, read);
-			else
-				t->hash.process(&t->hash, buffer, read);
-		}
+	if (step->stitched)
+		return;
+	if (step->tree_initialized)
+		step->tree.process(&step->tree, data, size);
+	else if (step->stitch_sha1 || step->stitch_sha256)
+		stitch_process(&step->hash, step->stitch_sha1, step->stitch_sha256, data, size);
+	else
+		step->hash.process(&step->hash, data, size);
+}
+
+/* Lets the first MD5 step feed the first SHA-1 and SHA-256 steps using the
+ * stitched kernels so that the data is only walked once for all of them.
+ * Only done when every step is run by the same thread as otherwise the
+ * steps would no longer be spread evenly. */
+static void steps_stitch(struct hash_step *steps)
+{
+	struct hash_step *md5 = NULL, *sha1 = NULL, *sha256 = NULL;
+	struct hash_step *t;
+
+	for (t = steps; t != NULL; t = t->next) {
+		unsigned role = (t->tree_initialized) ? 0 : stitch_role(&t->hash);
+		if ((role == STITCH_MD5) && (md5 == NULL))
+			md5 = t;
+		else if ((role == STITCH_SHA1) && (sha1 == NULL))
+			sha1 = t;
+		else if ((role == STITCH_SHA256) && (sha256 == NULL))
+			sha256 = t;
+	}
+	if ((md5 == NULL) || ((sha1 == NULL) && (sha256 == NULL)))
+		return;
+
+	if (sha1 != NULL) {
+		md5->stitch_sha1 = &sha1->hash;
+		sha1->stitched   = 1;
+	}
+	if (sha256 != NULL) {
+		md5->stitch_sha256 = &sha256->hash;
+		sha256->stitched   = 1;
 	}
 }
 
-static int open_and_process(const char *filename, struct hash_step *steps)
+static void process_buffer(struct hash_step *steps, const unsigned char *data, size_t size)
 {
-	FILE *f = fopen(filename, "rb");
-	if (!f) {
+	struct hash_step *t;
+	for (t = steps; t != NULL; t = t->next)
+		process_step(t, data, size);
+}
+
+/* The set of steps owned by a single worker thread: the first step and every
+ * stride'th step after it. */
+struct step_group {
+	struct hash_step *first;
+	unsigned          stride;
+};
+
+static void process_group(void *ctx, const unsigned char *data, size_t size)
+{
+	const struct step_group *group = ctx;
+	struct hash_step *t = group->first;
+	while (t != NULL) {
+		unsigned i;
+		process_step(t, data, size);
+		for (i = 0; (t != NULL) && (i < group->stride); i++)
+			t = t->next;
+	}
+}
+
+/* Runs the reader through the steps spread across nb_threads threads while
+ * the calling thread keeps up to depth buffers read ahead of them. */
+static int process_threaded(struct reader *r, struct hash_step *steps, unsigned nb_threads, unsigned depth, const struct reader_config *cfg)
+{
+	struct step_group *groups = malloc(nb_threads * (sizeof(*groups) + sizeof(void *)));
+	void **ctx = (void **)(groups + nb_threads);
+	struct pipeline *p;
+	struct hash_step *t;
+	unsigned i;
+	int ret;
+
+	if (!groups)
+		return -1;
+
+	for (i = 0, t = steps; i < nb_threads; i++, t = t->next) {
+		assert(t != NULL);
+		groups[i].first  = t;
+		groups[i].stride = nb_threads;
+		ctx[i]           = groups + i;
+	}
+
+	p = pipeline_create(depth, cfg, nb_threads, process_group, ctx);
+	if (!p) {
+		free(groups);
+		return -1;
+	}
+	ret = pipeline_run(p, r);
+	pipeline_destroy(p);
+	free(groups);
+	return ret;
+}
+
+/* Feeds the entire file (or stdin if filename is NULL) through all of the
+ * given steps. Regular files are hashed directly out of mapped windows. If
+ * cfg->nb_threads is non-zero, the steps are distributed over that many
+ * threads which all consume the same input buffers. */
+static int open_and_process(const char *filename, struct hash_step *steps, const struct process_config *cfg)
+{
+	struct reader       r;
+	struct reader_chunk chunk;
+	int                 ret;
+
+	if (reader_open(&r, filename, &cfg->reader)) {
 		fprintf(stderr, "could not open '%s'\n", filename);
 		return -1;
 	}
-	process_file(f, steps);
-	fclose(f);
-	return 0;
+	if (cfg->nb_threads <= 1)
+		steps_stitch(steps);
+	if (cfg->nb_threads) {
+		ret = process_threaded(&r, steps, cfg->nb_threads, cfg->depth, &cfg->reader);
+	} else if (reader_chunk_init(&chunk, &cfg->reader)) {
+		ret = -1;
+	} else {
+		while ((ret = reader_next(&r, &chunk)) > 0) {
+			process_buffer(steps, chunk.data, chunk.size);
+			reader_release(&r, &chunk);
+		}
+		reader_chunk_free(&chunk);
+	}
+	if (ret < 0)
+		fprintf(stderr, "error reading '%s'\n", (filename) ? filename : "stdin");
+	reader_close(&r);
+	return (ret < 0) ? -1 : 0;
 }
 
 void step_unlink(struct hash_step **n)
@@ -522,31 +710,834 @@ void step_unlink(struct hash_step **n)
 	free(step);
 }
 
+/* Call the end method of the step and print the digest in the requested
+ * format. */
+static
+int
+step_finish_and_print(struct hash_step *t, FILE *out)
+{
+	struct hash_s *h = (t->tree_initialized) ? &t->tree : &t->hash;
+	unsigned       dsize = h->query_digest_size(h);
+	unsigned char *digest = malloc((dsize + 7) / 8);
+	if (!digest) {
+		fprintf(stderr, "oom\n");
+		return -1;
+	}
+	h->end(h, digest);
+	t->output(out, digest, dsize);
+	free(digest);
+	return 0;
+}
+
+/* Returns the digest the step produced in the requested format as a string
+ * which must be released with free(). */
+static
+char *
+step_digest_to_string(struct hash_step *t, const unsigned char *digest)
+{
+	struct hash_s *h = (t->tree_initialized) ? &t->tree : &t->hash;
+	char *str = NULL;
+	size_t str_size = 0;
+	FILE *s = open_memstream(&str, &str_size);
+
+	if (!s) {
+		fprintf(stderr, "oom\n");
+		return NULL;
+	}
+	t->output(s, digest, h->query_digest_size(h));
+	if (fclose(s)) {
+		free(str);
+		str = NULL;
+	}
+	return str;
+}
+
+/* Returns non-zero if every step is a hash (rather than a tree) which can
+ * digest several messages at once. */
+static
+int
+steps_have_jobs(const struct hash_step *steps)
+{
+	for (; steps != NULL; steps = steps->next)
+		if (steps->tree_initialized || (steps->hash.digest_jobs == NULL))
+			return 0;
+	return 1;
+}
+
+/* Call the end method of the step and return the digest in the requested
+ * format as a string which must be released with free(). */
+static
+char *
+step_finish_to_string(struct hash_step *t)
+{
+	char *str = NULL;
+	size_t str_size = 0;
+	FILE *s = open_memstream(&str, &str_size);
+	int error;
+
+	if (!s) {
+		fprintf(stderr, "oom\n");
+		return NULL;
+	}
+	error = step_finish_and_print(t, s);
+	if (fclose(s) || error) {
+		free(str);
+		str = NULL;
+	}
+	return str;
+}
+
 /* For all of the given steps, call the end method and print the digest in the
- * requested format. */
+ * requested format. If name is not NULL, it is printed after the digests. */
 static
 int
-steps_finish_and_print(struct hash_step *steps)
+steps_finish_and_print(struct hash_step *steps, FILE *out, const char *name)
 {
 	struct hash_step *t;
 	for (t = steps; t != NULL; t = t->next) {
-		struct hash_s *h = (t->tree_initialized) ? &t->tree : &t->hash;
-		unsigned       dsize = h->query_digest_size(h);
-		unsigned char *digest = malloc((dsize + 7) / 8);
-		if (digest) {
-			h->end(h, digest);
-			t->output(digest, dsize);
-			printf(" ");
-			free(digest);
-		} else {
+		if (step_finish_and_print(t, out))
+			return -1;
+		fputc(' ', out);
+	}
+	if (name)
+		fputs(name, out);
+	fputc('\n', out);
+	return 0;
+}
+
+/* As steps_finish_and_print() but prints a manifest line for each step
+ * containing the specification the step was built from, the name and the
+ * digest. This is the format which is read back by -c. */
+static
+int
+steps_finish_and_print_manifest(struct hash_step *steps, char *const *specs, FILE *out, const char *name)
+{
+	struct hash_step *t;
+	unsigned i;
+	for (t = steps, i = 0; t != NULL; t = t->next, i++) {
+		fprintf(out, "%s %s ", specs[i], name);
+		if (step_finish_and_print(t, out))
+			return -1;
+		fputc('\n', out);
+	}
+	return 0;
+}
+
+/* Builds a new list of steps from the given specification strings. Returns
+ * NULL on failure. */
+static
+struct hash_step *
+specs_to_steps(char *const *specs, unsigned nb_specs)
+{
+	struct hash_step *steps = NULL;
+	struct hash_step **insert_pos = &steps;
+	unsigned i;
+	for (i = 0; i < nb_specs; i++) {
+		*insert_pos = str_to_spec(specs[i]);
+		if (*insert_pos == NULL) {
+			while (steps != NULL)
+				step_unlink(&steps);
+			break;
+		}
+		insert_pos = &((*insert_pos)->next);
+	}
+	return steps;
+}
+
+/* A growable list of names. */
+struct name_list {
+	char     **names;
+	unsigned   nb;
+	unsigned   capacity;
+};
+
+static
+int
+name_list_add(struct name_list *list, const char *name, size_t len)
+{
+	char *n;
+	if (list->nb == list->capacity) {
+		unsigned capacity = (list->capacity) ? (2 * list->capacity) : 16;
+		char **names = realloc(list->names, capacity * sizeof(char *));
+		if (!names)
+			return -1;
+		list->names    = names;
+		list->capacity = capacity;
+	}
+	n = malloc(len + 1);
+	if (!n)
+		return -1;
+	memcpy(n, name, len);
+	n[len] = '\0';
+	list->names[list->nb++] = n;
+	return 0;
+}
+
+static
+void
+name_list_free(struct name_list *list)
+{
+	while (list->nb)
+		free(list->names[--list->nb]);
+	free(list->names);
+}
+
+/* Adds every line of the given file (or stdin if filename is "-") to the
+ * list. Empty lines are ignored. */
+static
+int
+name_list_add_from(struct name_list *list, const char *filename)
+{
+	FILE *f = (strcmp(filename, "-") == 0) ? stdin : fopen(filename, "r");
+	char *line = NULL;
+	size_t line_cap = 0;
+	ssize_t len;
+	int error = 0;
+
+	if (!f) {
+		fprintf(stderr, "could not open '%s'\n", filename);
+		return -1;
+	}
+	while (!error && (len = getline(&line, &line_cap, f)) >= 0) {
+		if (len && (line[len-1] == '\n'))
+			len--;
+		if (len && (line[len-1] == '\r'))
+			len--;
+		if (len && name_list_add(list, line, len)) {
 			fprintf(stderr, "oom\n");
+			error = -1;
+		}
+	}
+	free(line);
+	if (f != stdin)
+		fclose(f);
+	return error;
+}
+
+static
+int
+name_list_add_walked(void *ctx, const char *path, size_t len)
+{
+	return name_list_add(ctx, path, len);
+}
+
+struct file_batch {
+	char *const                 *specs;
+	unsigned                     nb_specs;
+	const struct name_list      *files;
+	const struct process_config *cfg;
+
+	/* Number of files in each job when the files are read through
+	 * io_uring. */
+	unsigned                     files_per_job;
+
+	/* Print manifest lines rather than one line per file. */
+	int                          manifest;
+
+	/* Small files may be hashed together (see steps_have_jobs()). */
+	int                          jobs;
+
+	/* Digests of unchanged files are taken from here if not NULL. */
+	struct cache                *cache;
+};
+
+/* The state of one file of a batch. If the digests for every specification
+ * were found in the cache, digests holds them and the file is not read.
+ * Otherwise steps holds a fresh set of steps to hash the file with. */
+struct batch_file {
+	struct hash_step            *steps;
+	char                       **digests;
+	struct cache_key             key;
+	int                          keyed;
+
+	/* While hold is set, the contents of the file are collected in data
+	 * rather than given to the steps so that the file can be hashed along
+	 * with other small files. */
+	int                          hold;
+	unsigned char               *data;
+	size_t                       size;
+
+	const char                  *name;
+
+	/* Number of bytes read through io_uring so far. A regular file which
+	 * turns out to be larger than a ring buffer is marked as large and is
+	 * then hashed again from the start with the mapping reader. */
+	size_t                       received;
+	int                          large;
+};
+
+static
+void
+digests_free(char **digests, unsigned nb)
+{
+	if (digests) {
+		while (nb--)
+			free(digests[nb]);
+		free(digests);
+	}
+}
+
+/* Returns zero if the file needs to be hashed with f->steps, a positive value
+ * if the digests came from the cache and a negative value on failure. */
+static
+int
+batch_file_begin(const struct file_batch *batch, const char *name, struct batch_file *f)
+{
+	unsigned i;
+
+	f->name     = name;
+	f->steps    = NULL;
+	f->digests  = NULL;
+	f->hold     = 0;
+	f->data     = NULL;
+	f->size     = 0;
+	f->received = 0;
+	f->large    = 0;
+	f->keyed    = (batch->cache != NULL) && (cache_key_init(&f->key, name) == 0);
+
+	if (f->keyed) {
+		f->digests = calloc(batch->nb_specs, sizeof(char *));
+		for (i = 0; (f->digests != NULL) && (i < batch->nb_specs); i++)
+			if ((f->digests[i] = cache_lookup(batch->cache, &f->key, batch->specs[i])) == NULL)
+				break;
+		if ((f->digests != NULL) && (i == batch->nb_specs))
+			return 1;
+		digests_free(f->digests, batch->nb_specs);
+		f->digests = NULL;
+	}
+
+	f->steps = specs_to_steps(batch->specs, batch->nb_specs);
+	return (f->steps != NULL) ? 0 : -1;
+}
+
+/* Prints the result for the file unless failed is set and releases the
+ * state. Digests which were computed are added to the cache. If raw is not
+ * NULL, it holds the digest of every step one after the other and the steps
+ * themselves are not finished. */
+static
+int
+batch_file_end(const struct file_batch *batch, struct batch_file *f, const char *name, int failed, const unsigned char *raw, FILE *out)
+{
+	unsigned i;
+	struct hash_step *t;
+
+	if (!failed && (f->digests == NULL)) {
+		f->digests = calloc(batch->nb_specs, sizeof(char *));
+		failed = (f->digests == NULL);
+		for (i = 0, t = f->steps; !failed && (t != NULL); i++, t = t->next) {
+			if (raw) {
+				f->digests[i] = step_digest_to_string(t, raw);
+				raw += (t->hash.query_digest_size(&t->hash) + 7) / 8;
+			} else {
+				f->digests[i] = step_finish_to_string(t);
+			}
+			failed = (f->digests[i] == NULL);
+			if (!failed && f->keyed)
+				(void)cache_store(batch->cache, &f->key, batch->specs[i], f->digests[i]);
+		}
+	}
+
+	if (!failed) {
+		for (i = 0; i < batch->nb_specs; i++) {
+			if (batch->manifest)
+				fprintf(out, "%s %s %s\n", batch->specs[i], name, f->digests[i]);
+			else
+				fprintf(out, "%s ", f->digests[i]);
+		}
+		if (!batch->manifest)
+			fprintf(out, "%s\n", name);
+	}
+
+	digests_free(f->digests, batch->nb_specs);
+	while (f->steps != NULL)
+		step_unlink(&f->steps);
+	free(f->data);
+
+	return failed;
+}
+
+/* Hashes one file of a batch with a fresh set of steps. */
+static
+int
+hash_file_job(void *ctx, unsigned index, FILE *out)
+{
+	const struct file_batch *batch = ctx;
+	const char *filename = batch->files->names[index];
+	struct batch_file f;
+	int ret = batch_file_begin(batch, filename, &f);
+
+	if (ret == 0)
+		ret = open_and_process(filename, f.steps, batch->cfg);
+
+	return batch_file_end(batch, &f, filename, (ret < 0), NULL, out);
+}
+
+/* A run of consecutive files from a batch which share an io_uring. */
+struct file_range {
+	const struct file_batch     *batch;
+	unsigned                     first;
+
+	/* Small files which have been read but not yet hashed or printed, in
+	 * order, and the number of them which could not be. */
+	struct batch_file           *pending[SMALL_FILES_BATCH];
+	unsigned                     pending_index[SMALL_FILES_BATCH];
+	unsigned                     nb_pending;
+	unsigned                     failed;
+};
+
+/* Hashes all of the pending small files of the range together and prints
+ * their results. */
+static
+void
+file_range_flush(struct file_range *range, FILE *out)
+{
+	const struct file_batch *batch = range->batch;
+	struct hash_job_s jobs[SMALL_FILES_BATCH];
+	unsigned char *results;
+	size_t digests_size = 0;
+	size_t offset;
+	struct hash_step *t;
+	unsigned i;
+
+	if (!range->nb_pending)
+		return;
+
+	for (t = range->pending[0]->steps; t != NULL; t = t->next)
+		digests_size += (t->hash.query_digest_size(&t->hash) + 7) / 8;
+
+	/* Digests which are not a whole number of bytes leave the low bits of
+	 * their last byte alone. Zero them so that they print as they do when
+	 * the file is hashed on its own. */
+	results = calloc(range->nb_pending, digests_size);
+	if (!results)
+		fprintf(stderr, "oom\n");
+
+	/* Every file has the same steps so the hash objects of the first file
+	 * can be used to digest the contents of all of them. */
+	for (t = range->pending[0]->steps, offset = 0; (results != NULL) && (t != NULL); t = t->next) {
+		static const unsigned char empty[1] = {0};
+		for (i = 0; i < range->nb_pending; i++) {
+			jobs[i].data   = (range->pending[i]->data) ? range->pending[i]->data : empty;
+			jobs[i].size   = range->pending[i]->size;
+			jobs[i].result = results + i * digests_size + offset;
+		}
+		t->hash.digest_jobs(&t->hash, jobs, range->nb_pending);
+		offset += (t->hash.query_digest_size(&t->hash) + 7) / 8;
+	}
+
+	for (i = 0; i < range->nb_pending; i++) {
+		struct batch_file *f = range->pending[i];
+		const char *name = batch->files->names[range->first + range->pending_index[i]];
+		if (batch_file_end(batch, f, name, (results == NULL), (results) ? (results + i * digests_size) : NULL, out))
+			range->failed++;
+		free(f);
+	}
+
+	free(results);
+	range->nb_pending = 0;
+}
+
+static
+void *
+uring_file_begin(void *ctx, unsigned index, int *skip)
+{
+	const struct file_range *range = ctx;
+	struct batch_file *f = malloc(sizeof(*f));
+	int ret;
+
+	if (!f)
+		return NULL;
+
+	ret = batch_file_begin(range->batch, range->batch->files->names[range->first + index], f);
+	if (ret < 0) {
+		free(f);
+		return NULL;
+	}
+	*skip = (ret > 0);
+	f->hold = (ret == 0) && range->batch->jobs;
+	if (ret == 0)
+		steps_stitch(f->steps);
+	return f;
+}
+
+static
+int
+uring_file_process(void *file, const unsigned char *data, size_t size)
+{
+	struct batch_file *f = file;
+	struct stat st;
+
+	/* The ring buffers are only SMALL_FILE_SIZE bytes, which would make
+	 * reading a large file slow. Such files are read again with the
+	 * reader, which maps them. Anything else (a named pipe, say) can only
+	 * be read once so stays on the ring. */
+	f->received += size;
+	if ((f->received > SMALL_FILE_SIZE) && (stat(f->name, &st) == 0) && S_ISREG(st.st_mode)) {
+		f->large = 1;
+		f->hold  = 0;
+		return 1;
+	}
+
+	if (f->hold) {
+		unsigned char *held = NULL;
+		if (f->size + size <= SMALL_FILE_SIZE)
+			held = realloc(f->data, f->size + size);
+		if (held) {
+			memcpy(held + f->size, data, size);
+			f->data  = held;
+			f->size += size;
+			return 0;
+		}
+
+		/* Too large to hold back (or out of memory): give the steps what
+		 * was collected so far and hash the rest as it arrives. */
+		f->hold = 0;
+		process_buffer(f->steps, f->data, f->size);
+		free(f->data);
+		f->data = NULL;
+		f->size = 0;
+	}
+
+	process_buffer(f->steps, data, size);
+	return 0;
+}
+
+static
+int
+uring_file_end(void *ctx, void *file, unsigned index, int failed, FILE *out)
+{
+	struct file_range *range = ctx;
+	struct batch_file *f = file;
+	int error;
+
+	if (f && f->hold && !failed) {
+		range->pending[range->nb_pending]       = f;
+		range->pending_index[range->nb_pending] = index;
+		if (++range->nb_pending == SMALL_FILES_BATCH)
+			file_range_flush(range, out);
+		return 0;
+	}
+
+	/* Results are printed in order so anything held back goes first. */
+	file_range_flush(range, out);
+
+	if (!f)
+		return -1;
+
+	if (f->large && !failed) {
+		int ret;
+		while (f->steps != NULL)
+			step_unlink(&f->steps);
+		free(f->data);
+		f->data  = NULL;
+		f->steps = specs_to_steps(range->batch->specs, range->batch->nb_specs);
+		ret = (f->steps != NULL) ? open_and_process(f->name, f->steps, range->batch->cfg) : -1;
+		failed = (ret < 0);
+	}
+
+	error = batch_file_end(range->batch, f, f->name, failed, NULL, out);
+	free(f);
+	return error;
+}
+
+static const struct uring_file_ops uring_file_ops =
+{uring_file_begin
+,uring_file_process
+,uring_file_end
+};
+
+/* Hashes a run of files of a batch through a single io_uring. Falls back to
+ * hashing them one at a time with hash_file_job() if io_uring is not
+ * available. */
+static
+int
+hash_files_uring_job(void *ctx, unsigned index, FILE *out)
+{
+	const struct file_batch *batch = ctx;
+	struct file_range range;
+	unsigned nb;
+	int failed;
+
+	range.batch      = batch;
+	range.first      = index * batch->files_per_job;
+	range.nb_pending = 0;
+	range.failed     = 0;
+	nb = batch->files->nb - range.first;
+	if (nb > batch->files_per_job)
+		nb = batch->files_per_job;
+
+	/* Each slot of the ring owns a buffer, so they are sized for the small
+	 * files this path is meant for rather than from -b: larger files just
+	 * take a few more reads. */
+	failed = uring_run(batch->files->names + range.first, nb, URING_DEPTH, SMALL_FILE_SIZE, &uring_file_ops, &range, out);
+	if (failed == URING_UNAVAILABLE) {
+		unsigned i;
+		for (i = 0, failed = 0; i < nb; i++)
+			if (hash_file_job(ctx, range.first + i, out))
+				failed++;
+	} else {
+		file_range_flush(&range, out);
+	}
+
+	return (failed != 0) || (range.failed != 0);
+}
+
+/* Number of preceding manifest entries whose specifications are assumed to
+ * have been validated already. */
+#define MANIFEST_SPEC_MEMORY (8)
+
+/* A line of a manifest: a specification, a filename and the digest the file
+ * is expected to produce. All three point into line. */
+struct check_entry {
+	char                        *line;
+	const char                  *spec;
+	const char                  *name;
+	const char                  *expected;
+};
+
+/* A run of consecutive manifest entries naming the same file. The file is
+ * read once for all of them. */
+struct check_file {
+	unsigned                     first;
+	unsigned                     nb;
+
+	/* Results, written by the job which checks the file. */
+	unsigned                     mismatched;
+	int                          unreadable;
+};
+
+struct manifest {
+	struct check_entry          *entries;
+	unsigned                     nb_entries;
+	unsigned                     entries_capacity;
+
+	struct check_file           *files;
+	unsigned                     nb_files;
+	unsigned                     files_capacity;
+
+	const struct process_config *cfg;
+};
+
+/* Splits a manifest line in place. The specification is the first word and
+ * the digest is the last so that filenames may contain spaces. */
+static
+int
+manifest_add_line(struct manifest *m, char *line)
+{
+	struct check_entry *e;
+	struct hash_step *step;
+	char *first = strchr(line, ' ');
+	char *last = strrchr(line, ' ');
+	unsigned i;
+
+	if ((first == NULL) || (first == last) || (first + 1 == last) || (last[1] == '\0'))
+		return -1;
+	*first = '\0';
+	*last  = '\0';
+
+	/* Reject bad specifications now rather than once per file. Manifests
+	 * tend to repeat the same few specifications so only look at the ones
+	 * which have not been seen in the last few lines. */
+	for (i = 0; (i < MANIFEST_SPEC_MEMORY) && (i < m->nb_entries); i++)
+		if (strcmp(m->entries[m->nb_entries - 1 - i].spec, line) == 0)
+			break;
+	if ((i == MANIFEST_SPEC_MEMORY) || (i == m->nb_entries)) {
+		step = str_to_spec(line);
+		if (!step)
 			return -1;
+		step_unlink(&step);
+	}
+
+	if (m->nb_entries == m->entries_capacity) {
+		unsigned capacity = (m->entries_capacity) ? (2 * m->entries_capacity) : 64;
+		e = realloc(m->entries, capacity * sizeof(m->entries[0]));
+		if (!e)
+			return -1;
+		m->entries          = e;
+		m->entries_capacity = capacity;
+	}
+	e = m->entries + m->nb_entries;
+	e->line     = line;
+	e->spec     = line;
+	e->name     = first + 1;
+	e->expected = last + 1;
+
+	if (!m->nb_files || strcmp(m->entries[m->files[m->nb_files-1].first].name, e->name)) {
+		if (m->nb_files == m->files_capacity) {
+			unsigned capacity = (m->files_capacity) ? (2 * m->files_capacity) : 64;
+			struct check_file *f = realloc(m->files, capacity * sizeof(m->files[0]));
+			if (!f)
+				return -1;
+			m->files          = f;
+			m->files_capacity = capacity;
 		}
+		m->files[m->nb_files].first      = m->nb_entries;
+		m->files[m->nb_files].nb         = 0;
+		m->files[m->nb_files].mismatched = 0;
+		m->files[m->nb_files].unreadable = 0;
+		m->nb_files++;
 	}
-	printf("\n");
+	m->files[m->nb_files-1].nb++;
+	m->nb_entries++;
 	return 0;
 }
 
+/* Reads a manifest from the given file (or stdin if filename is "-"). Empty
+ * lines and lines starting with '#' are ignored. */
+static
+int
+manifest_read(struct manifest *m, const char *filename)
+{
+	FILE *f = (strcmp(filename, "-") == 0) ? stdin : fopen(filename, "r");
+	char *line = NULL;
+	size_t line_cap = 0;
+	unsigned line_nb = 0;
+	ssize_t len;
+	int error = 0;
+
+	if (!f) {
+		fprintf(stderr, "could not open '%s'\n", filename);
+		return -1;
+	}
+	while (!error && (len = getline(&line, &line_cap, f)) >= 0) {
+		line_nb++;
+		if (len && (line[len-1] == '\n'))
+			line[--len] = '\0';
+		if (len && (line[len-1] == '\r'))
+			line[--len] = '\0';
+		if (!len || (line[0] == '#'))
+			continue;
+		if (manifest_add_line(m, line)) {
+			fprintf(stderr, "%s:%u: malformed manifest entry\n", filename, line_nb);
+			error = -1;
+		} else {
+			line     = NULL;
+			line_cap = 0;
+		}
+	}
+	free(line);
+	if (f != stdin)
+		fclose(f);
+	return error;
+}
+
+static
+void
+manifest_free(struct manifest *m)
+{
+	while (m->nb_entries)
+		free(m->entries[--m->nb_entries].line);
+	free(m->entries);
+	free(m->files);
+}
+
+/* Checks every entry of the manifest for one file. */
+static
+int
+check_file_job(void *ctx, unsigned index, FILE *out)
+{
+	struct manifest *m = ctx;
+	struct check_file *f = m->files + index;
+	const struct check_entry *e = m->entries + f->first;
+	struct hash_step *steps = NULL;
+	struct hash_step **insert_pos = &steps;
+	struct hash_step *t;
+	unsigned i;
+
+	for (i = 0; i < f->nb; i++) {
+		*insert_pos = str_to_spec(e[i].spec);
+		if (*insert_pos == NULL)
+			break;
+		insert_pos = &((*insert_pos)->next);
+	}
+
+	if ((i < f->nb) || open_and_process(e->name, steps, m->cfg)) {
+		f->unreadable = 1;
+		for (i = 0; i < f->nb; i++)
+			fprintf(out, "%s %s: FAILED open or read\n", e[i].spec, e[i].name);
+	} else {
+		for (t = steps, i = 0; t != NULL; t = t->next, i++) {
+			char *actual = step_finish_to_string(t);
+			int ok = (actual != NULL);
+			/* Only base64 is case sensitive. */
+			if (ok)
+				ok = (t->output == print_base64_digest) ? (strcmp(actual, e[i].expected) == 0) : (strcasecmp(actual, e[i].expected) == 0);
+			free(actual);
+			if (!ok)
+				f->mismatched++;
+			fprintf(out, "%s %s: %s\n", e[i].spec, e[i].name, (ok) ? "OK" : "FAILED");
+		}
+	}
+
+	while (steps != NULL)
+		step_unlink(&steps);
+
+	return (f->unreadable || f->mismatched);
+}
+
+/* Checks every entry of a manifest using nb_workers threads. Prints a
+ * summary to stderr and returns non-zero if anything failed. */
+static
+int
+check_manifest(const char *filename, unsigned nb_workers, const struct process_config *cfg)
+{
+	struct manifest m = {NULL, 0, 0, NULL, 0, 0, NULL};
+	unsigned mismatched = 0;
+	unsigned unreadable = 0;
+	unsigned i;
+	int failed;
+
+	m.cfg = cfg;
+	if (manifest_read(&m, filename)) {
+		manifest_free(&m);
+		return -1;
+	}
+
+	failed = batch_run(m.nb_files, nb_workers, check_file_job, &m, stdout);
+	if (failed < 0) {
+		fprintf(stderr, "could not start worker threads\n");
+	} else {
+		for (i = 0; i < m.nb_files; i++) {
+			mismatched += m.files[i].mismatched;
+			unreadable += m.files[i].unreadable;
+		}
+		fprintf(stderr, "%u entries for %u files checked: %u did not match, %u files could not be read\n", m.nb_entries, m.nb_files, mismatched, unreadable);
+	}
+
+	manifest_free(&m);
+	return (failed != 0);
+}
+
+/* Lists the detected processor features and the kernel which each dispatch
+ * slot picked. Kernels which cannot run here are shown in brackets. */
+static
+void
+print_kernels(FILE *out)
+{
+	unsigned features = mccl_cpu_features();
+	unsigned i, j;
+
+	fprintf(out, "cpu features:");
+	for (i = 0; i < 32; i++) {
+		const char *name = mccl_cpu_feature_name(1u << i);
+		if ((features & (1u << i)) && (name != NULL))
+			fprintf(out, " %s", name);
+	}
+	fprintf(out, "\n");
+
+	for (i = 0; dispatch_slots[i] != NULL; i++) {
+		const struct dispatch_slot_s *slot = dispatch_slots[i];
+		fprintf(out, "%-12s %-10s %s (", slot->name, slot->kernels[dispatch_select(slot)].name, slot->description);
+		for (j = 0; j < slot->nb_kernels; j++) {
+			const char *fmt = dispatch_usable(&slot->kernels[j]) ? "%s" : "[%s]";
+			if (j)
+				fprintf(out, ", ");
+			fprintf(out, fmt, slot->kernels[j].name);
+		}
+		fprintf(out, ")\n");
+	}
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -556,7 +1547,17 @@ main(int argc, char *argv[])
 	const char *help_arg = ((argc > 2) && help) ? argv[2] : NULL;
 	struct hash_step *steps = NULL;
 	struct hash_step **insert_pos = &steps;
-	const char *filename = NULL;
+	struct name_list files = {NULL, 0, 0};
+	char **specs = malloc(argc * sizeof(char *));
+	unsigned nb_steps = 0;
+	unsigned nb_workers = 0;
+	int batch = 0;
+	int uring = 1;
+	int manifest = 0;
+	int incomplete = 0;
+	const char *check = NULL;
+	const char *cache_file = NULL;
+	struct process_config cfg;
 
 	if ((argc < 2) || (help && (help_arg == NULL))) {
 		unsigned j;
@@ -568,8 +1569,20 @@ main(int argc, char *argv[])
 		       "           ( algorithm name, [\".\", algorithm specific parameters ] ),\n"
 		       "           [ \":\", format name, [\".\", parameter ] ]\n"
 		       "         }\n"
-		       "       , [ \"-f\", filename ]\n"
+		       "       , { \"-f\", filename }\n"
+		       "       , [ \"--files-from\", filename ]\n"
+		       "       , { \"-r\", directory }\n"
+		       "       , [ \"-p\", files in parallel ]\n"
+		       "       , [ \"--no-uring\" ]\n"
+		       "       , [ \"--cache\", filename ]\n"
+		       "       , [ \"-j\", threads ]\n"
+		       "       , [ \"-d\", read-ahead depth ]\n"
+		       "       , [ \"-b\", buffer size ]\n"
+		       "       , [ \"-D\" ]\n"
+		       "       , [ \"-m\" ]\n"
 		       "       )\n"
+		       "     | ( \"-c\", manifest, [ \"-p\", files in parallel ] )\n"
+		       "     | ( \"--kernels\" )\n"
 		       "     | ( \"help\", [ algorithm name | format name ] )\n"
 		       "     )\n\n", argv[0]);
 		printf("Produces a set of hashes for data given through stdin or a file.\n\n");
@@ -593,9 +1606,55 @@ main(int argc, char *argv[])
 				printf(", ");
 		}
 		printf("\n\n");
+		printf("Multiple files can be hashed by giving -f several times or by giving a file\n");
+		printf("containing one filename per line to --files-from (\"-\" reads the list from\n");
+		printf("stdin). The files are hashed concurrently on a pool of threads (the size of\n");
+		printf("which can be set with -p and defaults to the number of processors) and one\n");
+		printf("line is printed per file, in the order the files were given, containing the\n");
+		printf("digests followed by the filename. Where the kernel supports it, each thread\n");
+		printf("keeps many files open and reading at once through io_uring; --no-uring\n");
+		printf("disables this.\n\n");
+		printf("The -m option prints a manifest line for every algorithm and file instead,\n");
+		printf("containing the algorithm specification, the filename and the digest. Giving\n");
+		printf("a manifest to -c (\"-\" reads it from stdin) checks every entry on the pool of\n");
+		printf("threads, prints OK or FAILED for each and a summary to stderr. Entries\n");
+		printf("always name files, so -m cannot be used when hashing stdin.\n\n");
+		printf("The --cache option keeps the digests of every file which is hashed in the\n");
+		printf("given file. A file is not read again while its device, inode, size,\n");
+		printf("modification time and change time are unchanged. Files changed since the\n");
+		printf("run started are not cached and entries for files which were not hashed\n");
+		printf("are dropped. The filename is always printed after the digests when\n");
+		printf("--cache is given. Like -m, it cannot be used when hashing stdin.\n\n");
+		printf("The -r option adds every regular file below the given directory. These are\n");
+		printf("hashed and printed in the order of their location on disk (or of their inode\n");
+		printf("numbers if the filesystem cannot report locations) to minimise seeking.\n\n");
+		printf("The -j option distributes the hash computations over the given number of\n");
+		printf("threads which all consume the same input buffers. By default, everything\n");
+		printf("runs on the calling thread.\n\n");
+		printf("The -d option sets the number of buffers which are read ahead of the hash\n");
+		printf("computations by a dedicated reader (default: %u when -j is given). Giving -d\n", PIPELINE_DEPTH);
+		printf("without -j hashes on a single thread while the input is read on another.\n\n");
+		printf("The -b option sets the size of each buffer which is read into (pipes,\n");
+		printf("devices, regular files no larger than a buffer and everything with -D).\n");
+		printf("Larger regular files are mapped %luM at a time whatever the buffer size.\n", (unsigned long)(READER_MAP_WINDOW / (1024 * 1024)));
+		printf("The size may be suffixed with k, M or G. The default is %luk.\n\n", (unsigned long)(READER_BUFFER_SIZE / 1024));
+		printf("The -D option reads regular files with O_DIRECT into aligned buffers rather\n");
+		printf("than mapping them, so that hashing does not evict the page cache. Where the\n");
+		printf("filesystem does not support O_DIRECT, pages are dropped after being read.\n\n");
+		printf("The --kernels option lists the processor features which were detected and\n");
+		printf("the implementation picked for each accelerated kernel. The choice can be\n");
+		printf("overridden by setting %s to a comma separated list of\n", DISPATCH_FORCE_ENV);
+		printf("implementation names (applied to every kernel which has one of that name)\n");
+		printf("or of kernel=name pairs, e.g. %s=portable or\n", DISPATCH_FORCE_ENV);
+		printf("%s=sha2.256=portable,md5.mb=sse2.\n\n", DISPATCH_FORCE_ENV);
 		exit(-1);
 	}
 
+	if ((argc == 2) && (strcmp(argv[1], "--kernels") == 0)) {
+		print_kernels(stdout);
+		exit(0);
+	}
+
 	if (help) {
 		if (help_arg == NULL)
 			exit(0);
@@ -611,20 +1670,116 @@ main(int argc, char *argv[])
 		exit(-0);
 	}
 
+	if (!specs) {
+		fprintf(stderr, "oom\n");
+		exit(-1);
+	}
+
+	reader_config_init(&cfg.reader);
+	cfg.nb_threads = 0;
+	cfg.depth      = 0;
+
 	i = 1;
 	while ((i < argc) && !error) {
 		if (argv[i][0] == '-') {
 			switch (argv[i][1]) {
 			case 'f':
 				i++;
-				if (filename) {
-					fprintf(stderr, "filename already specified\n"); error = 1;
-				} else if (i >= argc) {
+				if (i >= argc) {
 					fprintf(stderr, "expected filename\n"); error = 1;
+				} else if (name_list_add(&files, argv[i], strlen(argv[i]))) {
+					fprintf(stderr, "oom\n"); error = 1;
+				}
+				break;
+			case 'c':
+				i++;
+				if (i >= argc) {
+					fprintf(stderr, "expected manifest filename\n"); error = 1;
+				} else {
+					check = argv[i];
+				}
+				break;
+			case 'm':
+				manifest = 1;
+				break;
+			case 'r':
+				i++;
+				if (i >= argc) {
+					fprintf(stderr, "expected directory\n"); error = 1;
 				} else {
-					filename = argv[i];
+					/* Directories which could not be read have been
+					 * reported; hash what was found and fail at the
+					 * end. */
+					int ret = walk_tree(argv[i], name_list_add_walked, &files);
+					error = (ret < 0);
+					incomplete = incomplete || (ret > 0);
+					batch = 1;
 				}
 				break;
+			case 'p':
+				i++;
+				if (i >= argc) {
+					fprintf(stderr, "expected number of parallel files\n"); error = 1;
+				} else {
+					const char *c = parse_unsigned(argv[i], &nb_workers);
+					error = (c == NULL) || (*c != '\0');
+				}
+				break;
+			case '-':
+				if (strcmp(argv[i], "--files-from") == 0) {
+					i++;
+					if (i >= argc) {
+						fprintf(stderr, "expected filename\n"); error = 1;
+					} else {
+						error = (name_list_add_from(&files, argv[i]) != 0);
+						batch = 1;
+					}
+				} else if (strcmp(argv[i], "--cache") == 0) {
+					i++;
+					if (i >= argc) {
+						fprintf(stderr, "expected cache filename\n"); error = 1;
+					} else {
+						cache_file = argv[i];
+					}
+				} else if (strcmp(argv[i], "--no-uring") == 0) {
+					uring = 0;
+				} else {
+					fprintf(stderr, "unknown switch '%s'\n", &argv[i][1]); error = 1;
+				}
+				break;
+			case 'j':
+				i++;
+				if (i >= argc) {
+					fprintf(stderr, "expected number of threads\n"); error = 1;
+				} else {
+					const char *c = parse_unsigned(argv[i], &cfg.nb_threads);
+					error = (c == NULL) || (*c != '\0');
+				}
+				break;
+			case 'd':
+				i++;
+				if (i >= argc) {
+					fprintf(stderr, "expected read-ahead depth\n"); error = 1;
+				} else {
+					const char *c = parse_unsigned(argv[i], &cfg.depth);
+					error = (c == NULL) || (*c != '\0');
+				}
+				break;
+			case 'b':
+				i++;
+				if (i >= argc) {
+					fprintf(stderr, "expected buffer size\n"); error = 1;
+				} else {
+					const char *c = parse_size(argv[i], &cfg.reader.buffer_size);
+					error = (c == NULL) || (*c != '\0');
+					if (!error && !cfg.reader.buffer_size) {
+						fprintf(stderr, "buffer size must be non-zero\n"); error = 1;
+					}
+				}
+				break;
+			case 'D':
+				cfg.reader.direct = 1;
+				break;
 			default:
 				fprintf(stderr, "unknown switch '%s'\n", &argv[i][1]); error = 1;
 				break;
@@ -632,26 +1787,99 @@ main(int argc, char *argv[])
 		} else {
 			*insert_pos = str_to_spec(argv[i]);
 			error = (*insert_pos == NULL);
-			insert_pos = &((*insert_pos)->next);
+			if (!error) {
+				insert_pos = &((*insert_pos)->next);
+				specs[nb_steps++] = argv[i];
+			}
 		}
 		i++;
 	}
 
-	if ((steps != NULL) && !error) {
-		if (filename) {
-			error = open_and_process(filename, steps);
+	if (!nb_workers) {
+		long nproc = sysconf(_SC_NPROCESSORS_ONLN);
+		nb_workers = (nproc > 0) ? (unsigned)nproc : 1;
+	}
+
+	if (check && !error) {
+		if ((steps != NULL) || files.nb) {
+			fprintf(stderr, "-c cannot be combined with algorithms or files\n");
+			error = 1;
 		} else {
-			process_file(stdin, steps);
+			/* The number of steps differs from file to file so they are
+			 * not spread over threads. */
+			cfg.nb_threads = 0;
+			error = (check_manifest(check, nb_workers, &cfg) != 0);
 		}
-	}
+	} else if ((steps != NULL) && !error) {
+		/* Asking for read-ahead without asking for threads gets a single
+		 * thread doing all of the hashing. */
+		if (cfg.depth && !cfg.nb_threads)
+			cfg.nb_threads = 1;
+		if (cfg.nb_threads > nb_steps)
+			cfg.nb_threads = nb_steps;
+		if (!cfg.depth)
+			cfg.depth = PIPELINE_DEPTH;
+		cfg.reader.populate = (cfg.nb_threads != 0);
 
-	if (!error)
-		error = steps_finish_and_print(steps);
+		if (!files.nb && !batch && (manifest || cache_file)) {
+			/* Stdin has no name: -c would look for a file named "-" (a
+			 * manifest of "-" is read from stdin) and there is no key to
+			 * cache the digest under. */
+			fprintf(stderr, "%s requires files to be named\n", (manifest) ? "-m" : "--cache");
+			error = 1;
+		} else if (batch || cache_file || (files.nb > 1)) {
+			struct file_batch fb;
+			int failed;
+			fb.specs    = specs;
+			fb.nb_specs = nb_steps;
+			fb.files    = &files;
+			fb.cfg      = &cfg;
+			fb.manifest = manifest;
+			fb.jobs     = steps_have_jobs(steps);
+			fb.cache    = NULL;
+			if (cache_file) {
+				fb.cache = cache_open(cache_file);
+				error = (fb.cache == NULL);
+			}
+			/* Read through io_uring unless the files are going to be
+			 * read ahead for threaded steps or read with O_DIRECT. The
+			 * files are split into at least one run per worker. */
+			if (error || !files.nb) {
+				failed = 0;
+			} else if (uring && !cfg.nb_threads && !cfg.reader.direct) {
+				unsigned nb_jobs;
+				fb.files_per_job = (files.nb + nb_workers - 1) / nb_workers;
+				if (fb.files_per_job > URING_FILES_PER_JOB)
+					fb.files_per_job = URING_FILES_PER_JOB;
+				nb_jobs = (files.nb + fb.files_per_job - 1) / fb.files_per_job;
+				failed = batch_run(nb_jobs, nb_workers, hash_files_uring_job, &fb, stdout);
+			} else {
+				failed = batch_run(files.nb, nb_workers, hash_file_job, &fb, stdout);
+			}
+			if (failed < 0)
+				fprintf(stderr, "could not start worker threads\n");
+			error = error || (failed != 0);
+			if (fb.cache && cache_close(fb.cache))
+				error = 1;
+		} else {
+			const char *filename = (files.nb) ? files.names[0] : NULL;
+			error = open_and_process(filename, steps, &cfg);
+			if (!error && manifest)
+				error = steps_finish_and_print_manifest(steps, specs, stdout, filename);
+			else if (!error)
+				error = steps_finish_and_print(steps, stdout, NULL);
+		}
+	} else if (!error) {
+		error = steps_finish_and_print(steps, stdout, NULL);
+	}
 
 	while (steps != NULL)
 		step_unlink(&steps);
 
-	exit(error);
+	name_list_free(&files);
+	free(specs);
+
+	exit(error || incomplete);
 
 }
 
@@ -0,0 +1,199 @@
+/* Copyright (c) 2014, Nicholas Appleton (http://www.appletonaudio.com)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither Nicholas Appleton nor the names of its contributors may be
+ *       used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL NICHOLAS APPLETON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE. */
+
+#include <stdlib.h>
+#include <assert.h>
+#include <pthread.h>
+#include "pipeline.h"
+
+struct pipeline_slot {
+	struct reader_chunk  chunk;
+
+	/* Number of workers which have yet to finish with the chunk. */
+	unsigned             pending;
+};
+
+struct pipeline_worker {
+	struct pipeline     *owner;
+	pthread_t            thread;
+	void                *ctx;
+};
+
+struct pipeline {
+	pthread_mutex_t         lock;
+	pthread_cond_t          data_ready;
+	pthread_cond_t          slot_free;
+
+	/* Number of chunks which have been published to the workers and whether
+	 * the producer has finished. */
+	unsigned long           produced;
+	int                     eof;
+
+	pipeline_consume_fn     consume;
+
+	unsigned                depth;
+	struct pipeline_slot   *slots;
+
+	unsigned                nb_workers;
+	struct pipeline_worker *workers;
+};
+
+static
+void *
+worker_main(void *arg)
+{
+	struct pipeline_worker *w = arg;
+	struct pipeline        *p = w->owner;
+	unsigned long           seq;
+
+	for (seq = 0; ; seq++) {
+		struct pipeline_slot *slot;
+
+		pthread_mutex_lock(&p->lock);
+		while ((seq >= p->produced) && !p->eof)
+			pthread_cond_wait(&p->data_ready, &p->lock);
+		if (seq >= p->produced) {
+			pthread_mutex_unlock(&p->lock);
+			break;
+		}
+		pthread_mutex_unlock(&p->lock);
+
+		slot = p->slots + (seq % p->depth);
+		p->consume(w->ctx, slot->chunk.data, slot->chunk.size);
+
+		pthread_mutex_lock(&p->lock);
+		assert(slot->pending > 0);
+		if (--slot->pending == 0)
+			pthread_cond_signal(&p->slot_free);
+		pthread_mutex_unlock(&p->lock);
+	}
+
+	return NULL;
+}
+
+struct pipeline *pipeline_create(unsigned depth, const struct reader_config *cfg, unsigned nb_workers, pipeline_consume_fn consume, void **worker_ctx)
+{
+	struct pipeline *p;
+	unsigned i;
+
+	assert(depth > 0);
+	assert(nb_workers > 0);
+
+	p = malloc(sizeof(*p) + sizeof(p->slots[0]) * depth + sizeof(p->workers[0]) * nb_workers);
+	if (!p)
+		return NULL;
+
+	p->slots      = (struct pipeline_slot *)(p + 1);
+	p->workers    = (struct pipeline_worker *)(p->slots + depth);
+	p->depth      = depth;
+	p->nb_workers = nb_workers;
+	p->consume    = consume;
+
+	for (i = 0; i < depth; i++) {
+		p->slots[i].pending = 0;
+		if (reader_chunk_init(&p->slots[i].chunk, cfg)) {
+			while (i--)
+				reader_chunk_free(&p->slots[i].chunk);
+			free(p);
+			return NULL;
+		}
+	}
+
+	for (i = 0; i < nb_workers; i++) {
+		p->workers[i].owner = p;
+		p->workers[i].ctx   = worker_ctx[i];
+	}
+
+	pthread_mutex_init(&p->lock, NULL);
+	pthread_cond_init(&p->data_ready, NULL);
+	pthread_cond_init(&p->slot_free, NULL);
+
+	return p;
+}
+
+int pipeline_run(struct pipeline *p, struct reader *r)
+{
+	unsigned long seq;
+	unsigned started;
+	int ret = 0;
+
+	p->produced = 0;
+	p->eof      = 0;
+
+	for (started = 0; started < p->nb_workers; started++)
+		if (pthread_create(&p->workers[started].thread, NULL, worker_main, p->workers + started))
+			break;
+
+	if (started < p->nb_workers)
+		ret = -1;
+
+	for (seq = 0; (ret == 0); seq++) {
+		struct pipeline_slot *slot = p->slots + (seq % p->depth);
+
+		pthread_mutex_lock(&p->lock);
+		while (slot->pending)
+			pthread_cond_wait(&p->slot_free, &p->lock);
+		pthread_mutex_unlock(&p->lock);
+
+		/* Every worker is done with the chunk - it can be recycled. */
+		reader_release(r, &slot->chunk);
+
+		ret = reader_next(r, &slot->chunk);
+		if (ret <= 0)
+			break;
+		ret = 0;
+
+		pthread_mutex_lock(&p->lock);
+		slot->pending = p->nb_workers;
+		p->produced++;
+		pthread_cond_broadcast(&p->data_ready);
+		pthread_mutex_unlock(&p->lock);
+	}
+
+	pthread_mutex_lock(&p->lock);
+	p->eof = 1;
+	pthread_cond_broadcast(&p->data_ready);
+	pthread_mutex_unlock(&p->lock);
+
+	while (started--)
+		pthread_join(p->workers[started].thread, NULL);
+
+	for (seq = 0; seq < p->depth; seq++)
+		reader_release(r, &p->slots[seq].chunk);
+
+	return ret;
+}
+
+void pipeline_destroy(struct pipeline *p)
+{
+	unsigned i;
+	for (i = 0; i < p->depth; i++)
+		reader_chunk_free(&p->slots[i].chunk);
+	pthread_cond_destroy(&p->slot_free);
+	pthread_cond_destroy(&p->data_ready);
+	pthread_mutex_destroy(&p->lock);
+	free(p);
+}
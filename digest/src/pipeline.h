@@ -0,0 +1,58 @@
+/* Copyright (c) 2014, Nicholas Appleton (http://www.appletonaudio.com)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither Nicholas Appleton nor the names of its contributors may be
+ *       used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL NICHOLAS APPLETON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE. */
+
+#ifndef PIPELINE_H_
+#define PIPELINE_H_
+
+#include <stddef.h>
+#include "reader.h"
+
+/* Using this API:
+ *
+ * A pipeline reads a stream into a ring of chunks and hands every chunk, in
+ * order, to each of a number of worker threads. A chunk is only recycled once
+ * every worker has finished with it, so the workers never see a copy of the
+ * data and never see it out of order.
+ *
+ * pipeline_create() builds a pipeline with nb_workers workers and a ring of
+ * depth chunks configured with cfg. Each worker repeatedly calls
+ * consume(worker_ctx[i], ...) for every chunk of the stream. Returns NULL on
+ * failure.
+ *
+ * pipeline_run() starts the workers, reads the entire stream from the given
+ * reader in the calling thread and waits for the workers to complete. It
+ * returns zero on success and a negative value if the reader or a thread
+ * could not be started. The pipeline may be run again afterwards. */
+
+typedef void (*pipeline_consume_fn)(void *worker_ctx, const unsigned char *data, size_t size);
+
+struct pipeline;
+
+struct pipeline *pipeline_create(unsigned depth, const struct reader_config *cfg, unsigned nb_workers, pipeline_consume_fn consume, void **worker_ctx);
+int              pipeline_run(struct pipeline *p, struct reader *r);
+void             pipeline_destroy(struct pipeline *p);
+
+#endif /* PIPELINE_H_ */
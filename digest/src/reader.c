@@ -0,0 +1,279 @@
+/* Copyright (c) 2014, Nicholas Appleton (http://www.appletonaudio.com)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither Nicholas Appleton nor the names of its contributors may be
+ *       used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL NICHOLAS APPLETON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE. */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "reader.h"
+
+void reader_config_init(struct reader_config *cfg)
+{
+	cfg->buffer_size = READER_BUFFER_SIZE;
+	cfg->window_size = READER_MAP_WINDOW;
+	cfg->populate    = 0;
+	cfg->direct      = 0;
+}
+
+int reader_chunk_init(struct reader_chunk *c, const struct reader_config *cfg)
+{
+	c->data     = NULL;
+	c->size     = 0;
+	c->map      = NULL;
+	c->map_size = 0;
+	c->buffer   = NULL;
+	c->capacity = cfg->buffer_size;
+	if (cfg->direct)
+		c->capacity = ((c->capacity + READER_DIRECT_ALIGN - 1) / READER_DIRECT_ALIGN) * READER_DIRECT_ALIGN;
+	return 0;
+}
+
+void reader_chunk_free(struct reader_chunk *c)
+{
+	assert(c->map == NULL);
+	free(c->buffer);
+}
+
+/* Most chunks never need storage of their own (everything that gets mapped)
+ * so it is allocated on first use. It is always aligned so that it can be
+ * used for O_DIRECT transfers. */
+static
+int
+reader_chunk_storage(struct reader_chunk *c)
+{
+	void *p;
+	if (c->buffer)
+		return 0;
+	if (posix_memalign(&p, READER_DIRECT_ALIGN, c->capacity))
+		return -1;
+	c->buffer = p;
+	return 0;
+}
+
+static
+int
+reader_open_direct(struct reader *r)
+{
+#ifdef O_DIRECT
+	int flags = fcntl(r->fd, F_GETFL);
+	if ((flags != -1) && (fcntl(r->fd, F_SETFL, flags | O_DIRECT) == 0))
+		return READER_DIRECT;
+#endif
+	return READER_UNCACHED;
+}
+
+/* Make the pipe big enough to hold an entire buffer so that the writer can
+ * run ahead of us and each read returns as much as possible. Failure is
+ * harmless: the pipe may be at the limit for unprivileged users. */
+static
+void
+reader_grow_pipe(int fd, size_t size)
+{
+#ifdef F_SETPIPE_SZ
+	int current = fcntl(fd, F_GETPIPE_SZ);
+	if ((current >= 0) && ((size_t)current < size) && (size <= INT_MAX))
+		(void)fcntl(fd, F_SETPIPE_SZ, (int)size);
+#else
+	(void)fd;
+	(void)size;
+#endif
+}
+
+int reader_open(struct reader *r, const char *filename, const struct reader_config *cfg)
+{
+	const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+	struct stat st;
+
+	r->cfg         = cfg;
+	r->window_size = ((cfg->window_size + page - 1) / page) * page;
+
+	r->mode      = READER_READ;
+	r->offset    = 0;
+	r->file_size = 0;
+
+	if (filename == NULL) {
+		r->fd      = STDIN_FILENO;
+		r->owns_fd = 0;
+	} else {
+		r->fd      = open(filename, O_RDONLY);
+		r->owns_fd = 1;
+		if (r->fd < 0)
+			return -1;
+	}
+
+	if (fstat(r->fd, &st) != 0)
+		return 0;
+
+	if (S_ISFIFO(st.st_mode))
+		reader_grow_pipe(r->fd, cfg->buffer_size);
+
+	/* Only regular files which were opened by name can be mapped or read
+	 * directly. stdin may not be positioned at the start of the file. */
+	if (S_ISREG(st.st_mode) && r->owns_fd) {
+		r->file_size = st.st_size;
+		if (cfg->direct) {
+			r->mode = reader_open_direct(r);
+			(void)posix_fadvise(r->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+		} else if ((size_t)st.st_size > cfg->buffer_size) {
+			r->mode = READER_MAPPED;
+		}
+	}
+
+	return 0;
+}
+
+/* Switches a mapped reader over to plain reads from the current offset and
+ * obtains the next chunk that way. */
+static
+int
+reader_fallback_fd(struct reader *r, struct reader_chunk *c)
+{
+	if (lseek(r->fd, r->offset, SEEK_SET) != r->offset)
+		return -1;
+	r->mode = READER_READ;
+	return reader_next(r, c);
+}
+
+static
+int
+reader_next_mapped(struct reader *r, struct reader_chunk *c)
+{
+	int flags = MAP_PRIVATE;
+	struct stat st;
+	size_t sz;
+	void *p;
+
+	/* Touching a page of a mapping which lies beyond the end of the file
+	 * raises SIGBUS. If the file has changed size since it was opened,
+	 * carry on from the current offset using plain reads, which simply
+	 * stop at the new end of the file. This does not help if the file is
+	 * truncated while a window is being hashed, but it does stop a file
+	 * which is being rewritten from taking the whole run down. */
+	if ((fstat(r->fd, &st) != 0) || (st.st_size != r->file_size))
+		return reader_fallback_fd(r, c);
+
+	if (r->offset >= r->file_size)
+		return 0;
+
+	sz = r->window_size;
+	if ((off_t)sz > r->file_size - r->offset)
+		sz = (size_t)(r->file_size - r->offset);
+
+#ifdef MAP_POPULATE
+	if (r->cfg->populate)
+		flags |= MAP_POPULATE;
+#endif
+
+	p = mmap(NULL, sz, PROT_READ, flags, r->fd, r->offset);
+	if (p == MAP_FAILED) {
+		/* Some filesystems do not support mapping. Carry on from the
+		 * current offset using plain reads. */
+		return reader_fallback_fd(r, c);
+	}
+
+#ifdef MADV_SEQUENTIAL
+	(void)madvise(p, sz, MADV_SEQUENTIAL);
+#endif
+
+	r->offset  += sz;
+	c->map      = p;
+	c->map_size = sz;
+	c->data     = p;
+	c->size     = sz;
+	return 1;
+}
+
+static
+int
+reader_next_fd(struct reader *r, struct reader_chunk *c)
+{
+	ssize_t n;
+
+	do {
+		n = read(r->fd, c->buffer, c->capacity);
+	} while ((n < 0) && (errno == EINTR));
+
+#ifdef O_DIRECT
+	if ((n < 0) && (errno == EINVAL) && (r->mode == READER_DIRECT)) {
+		/* The device has stricter alignment requirements than we can
+		 * satisfy. Nothing was transferred so continue uncached. */
+		int flags = fcntl(r->fd, F_GETFL);
+		if ((flags == -1) || (fcntl(r->fd, F_SETFL, flags & ~O_DIRECT) == -1))
+			return -1;
+		r->mode = READER_UNCACHED;
+		return reader_next_fd(r, c);
+	}
+#endif
+
+	if (n < 0)
+		return -1;
+
+	/* The data has been copied out so the pages are of no further use to
+	 * us. Dropping them stops a large job from pushing everything else out
+	 * of the cache. */
+	if ((r->mode == READER_UNCACHED) && (n > 0))
+		(void)posix_fadvise(r->fd, r->offset, n, POSIX_FADV_DONTNEED);
+
+	r->offset += n;
+	c->data    = c->buffer;
+	c->size    = (size_t)n;
+	return (n > 0);
+}
+
+int reader_next(struct reader *r, struct reader_chunk *c)
+{
+	assert(c->map == NULL);
+
+	if (r->mode == READER_MAPPED)
+		return reader_next_mapped(r, c);
+
+	if (reader_chunk_storage(c))
+		return -1;
+
+	return reader_next_fd(r, c);
+}
+
+void reader_release(struct reader *r, struct reader_chunk *c)
+{
+	(void)r;
+	if (c->map) {
+		munmap(c->map, c->map_size);
+		c->map = NULL;
+	}
+	c->data = NULL;
+	c->size = 0;
+}
+
+void reader_close(struct reader *r)
+{
+	if (r->owns_fd)
+		close(r->fd);
+}
@@ -0,0 +1,138 @@
+/* Copyright (c) 2014, Nicholas Appleton (http://www.appletonaudio.com)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither Nicholas Appleton nor the names of its contributors may be
+ *       used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL NICHOLAS APPLETON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE. */
+
+#ifndef READER_H_
+#define READER_H_
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/* Using this API:
+ *
+ * A reader supplies the contents of a file (or stdin) as a sequence of
+ * chunks. Regular files are memory mapped a window at a time and the chunks
+ * point directly at the mapping so that the hash functions can consume the
+ * page cache without an intermediate copy. Everything else (pipes, terminals,
+ * character devices...) is read with read() straight into storage owned by
+ * the chunk; stdio is never involved so the data is only copied once. Pipes
+ * are enlarged to the buffer size where the kernel allows it so that each
+ * read can return a full buffer. Regular files which fit in a single buffer
+ * are read rather than mapped as setting up and tearing down a mapping costs
+ * more than copying a small file.
+ *
+ * When the direct member of the configuration is set, regular files are not
+ * mapped. They are instead opened with O_DIRECT and read into aligned chunk
+ * storage so that hashing very large data sets does not evict everything
+ * else from the page cache. If the filesystem refuses O_DIRECT, the reads
+ * go through the page cache and the pages are dropped once they have been
+ * read.
+ *
+ * reader_open() opens the given filename or stdin if filename is NULL using
+ * the given configuration. It returns zero on success. The configuration
+ * must outlive the reader.
+ *
+ * reader_next() fills the given chunk with the next piece of the stream. It
+ * returns a positive value if data was obtained, zero at the end of the
+ * stream and a negative value on error. The data member of the chunk remains
+ * valid until reader_release() is called on the chunk. Chunks must be
+ * released before they are passed to reader_next() again.
+ *
+ * reader_chunk_init() must be called on a chunk before it is first used and
+ * reader_chunk_free() must be called when it is no longer required. Chunks
+ * must be initialised with the same configuration as the reader.
+ *
+ * reader_config_init() fills a configuration with the defaults below. */
+
+/* Default size of the storage used for plain and direct reads. */
+#define READER_BUFFER_SIZE (1024ul * 1024ul)
+
+/* Alignment of chunk storage. O_DIRECT transfers must start at and be a
+ * multiple of the logical block size of the device, which is never larger
+ * than a page on the systems we care about. */
+#define READER_DIRECT_ALIGN (4096ul)
+
+/* Default size of each mapped window of a regular file. */
+#define READER_MAP_WINDOW (64ul * 1024ul * 1024ul)
+
+struct reader_config {
+	/* Size of each plain or direct read. Rounded up to a multiple of
+	 * READER_DIRECT_ALIGN if direct is set. */
+	size_t               buffer_size;
+
+	/* Size of each mapped window. Rounded up to a multiple of the page size
+	 * when the reader is opened. */
+	size_t               window_size;
+
+	/* If set, mapped windows are faulted in when they are obtained from
+	 * reader_next() rather than when they are first touched. This moves the
+	 * cost of the disk reads onto the thread which calls reader_next(). */
+	int                  populate;
+
+	/* If set, regular files are read with O_DIRECT instead of being
+	 * mapped. */
+	int                  direct;
+};
+
+struct reader_chunk {
+	const unsigned char *data;
+	size_t               size;
+
+	/* Storage for plain and direct reads. Allocated the first time it is
+	 * needed. */
+	unsigned char       *buffer;
+	size_t               capacity;
+
+	/* Mapping which data points into (NULL if data points into buffer). */
+	void                *map;
+	size_t               map_size;
+};
+
+struct reader {
+	const struct reader_config *cfg;
+	size_t               window_size;
+	int                  fd;
+	int                  owns_fd;
+	enum {
+		READER_MAPPED,
+		READER_READ,
+		READER_DIRECT,
+		READER_UNCACHED
+	}                    mode;
+	off_t                offset;
+	off_t                file_size;
+};
+
+void reader_config_init(struct reader_config *cfg);
+
+int  reader_open(struct reader *r, const char *filename, const struct reader_config *cfg);
+int  reader_next(struct reader *r, struct reader_chunk *c);
+void reader_release(struct reader *r, struct reader_chunk *c);
+void reader_close(struct reader *r);
+
+int  reader_chunk_init(struct reader_chunk *c, const struct reader_config *cfg);
+void reader_chunk_free(struct reader_chunk *c);
+
+#endif /* READER_H_ */
@@ -0,0 +1,428 @@
+/* Copyright (c) 2014, Nicholas Appleton (http://www.appletonaudio.com)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither Nicholas Appleton nor the names of its contributors may be
+ *       used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL NICHOLAS APPLETON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "uring.h"
+
+#ifdef __NR_io_uring_setup
+
+#include <linux/io_uring.h>
+
+/* A minimal io_uring wrapper. Only what is needed to drive a ring from a
+ * single thread is here. */
+struct ring {
+	int                  fd;
+
+	unsigned            *sq_head;
+	unsigned            *sq_tail;
+	unsigned            *sq_mask;
+	unsigned            *sq_array;
+	struct io_uring_sqe *sqes;
+	unsigned             sq_pending;
+
+	unsigned            *cq_head;
+	unsigned            *cq_tail;
+	unsigned            *cq_mask;
+	struct io_uring_cqe *cqes;
+
+	void                *sq_map;
+	size_t               sq_map_size;
+	void                *cq_map;
+	size_t               cq_map_size;
+	size_t               sqes_size;
+};
+
+static
+int
+ring_supports(int fd, const unsigned char *ops, unsigned nb_ops)
+{
+	struct io_uring_probe *probe;
+	size_t sz = sizeof(*probe) + IORING_OP_LAST * sizeof(probe->ops[0]);
+	unsigned i;
+	int ok;
+
+	probe = calloc(1, sz);
+	if (!probe)
+		return 0;
+
+	ok = (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, IORING_OP_LAST) == 0);
+	for (i = 0; ok && (i < nb_ops); i++)
+		ok = (ops[i] <= probe->last_op) && (probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED);
+
+	free(probe);
+	return ok;
+}
+
+static
+void
+ring_destroy(struct ring *r)
+{
+	if (r->sqes)
+		munmap(r->sqes, r->sqes_size);
+	if (r->cq_map && r->cq_map != r->sq_map)
+		munmap(r->cq_map, r->cq_map_size);
+	if (r->sq_map)
+		munmap(r->sq_map, r->sq_map_size);
+	close(r->fd);
+}
+
+static
+int
+ring_create(struct ring *r, unsigned entries)
+{
+	static const unsigned char required[] = {IORING_OP_OPENAT, IORING_OP_READ, IORING_OP_CLOSE};
+	struct io_uring_params p;
+	unsigned char *sq, *cq;
+
+	memset(&p, 0, sizeof(p));
+	memset(r, 0, sizeof(*r));
+
+	r->fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+	if (r->fd < 0)
+		return URING_UNAVAILABLE;
+
+	if (!ring_supports(r->fd, required, sizeof(required))) {
+		close(r->fd);
+		return URING_UNAVAILABLE;
+	}
+
+	r->sq_map_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	r->cq_map_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	r->sqes_size   = p.sq_entries * sizeof(struct io_uring_sqe);
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (r->cq_map_size > r->sq_map_size)
+			r->sq_map_size = r->cq_map_size;
+		r->cq_map_size = r->sq_map_size;
+	}
+
+	r->sq_map = mmap(NULL, r->sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+	if (r->sq_map == MAP_FAILED) {
+		r->sq_map = NULL;
+		ring_destroy(r);
+		return -1;
+	}
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		r->cq_map = r->sq_map;
+	} else {
+		r->cq_map = mmap(NULL, r->cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+		if (r->cq_map == MAP_FAILED) {
+			r->cq_map = NULL;
+			ring_destroy(r);
+			return -1;
+		}
+	}
+
+	r->sqes = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+	if (r->sqes == MAP_FAILED) {
+		r->sqes = NULL;
+		ring_destroy(r);
+		return -1;
+	}
+
+	sq = r->sq_map;
+	cq = r->cq_map;
+	r->sq_head  = (unsigned *)(sq + p.sq_off.head);
+	r->sq_tail  = (unsigned *)(sq + p.sq_off.tail);
+	r->sq_mask  = (unsigned *)(sq + p.sq_off.ring_mask);
+	r->sq_array = (unsigned *)(sq + p.sq_off.array);
+	r->cq_head  = (unsigned *)(cq + p.cq_off.head);
+	r->cq_tail  = (unsigned *)(cq + p.cq_off.tail);
+	r->cq_mask  = (unsigned *)(cq + p.cq_off.ring_mask);
+	r->cqes     = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+	return 0;
+}
+
+/* Returns a cleared submission entry. The caller never has more entries
+ * outstanding than the ring was created with so this cannot fail. */
+static
+struct io_uring_sqe *
+ring_get_sqe(struct ring *r, unsigned char opcode, unsigned long long user_data)
+{
+	unsigned tail = *r->sq_tail;
+	unsigned idx  = tail & *r->sq_mask;
+	struct io_uring_sqe *sqe = r->sqes + idx;
+
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode    = opcode;
+	sqe->user_data = user_data;
+
+	r->sq_array[idx] = idx;
+	__atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	r->sq_pending++;
+	return sqe;
+}
+
+/* Submits everything which has been queued and waits for at least one
+ * completion. */
+static
+int
+ring_submit_and_wait(struct ring *r)
+{
+	long ret;
+	do {
+		ret = syscall(__NR_io_uring_enter, r->fd, r->sq_pending, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+	} while ((ret < 0) && (errno == EINTR));
+	if (ret < 0)
+		return -1;
+	r->sq_pending -= (unsigned)ret;
+	return 0;
+}
+
+enum slot_state {
+	SLOT_FREE,
+	SLOT_OPENING,
+	SLOT_READING,
+	SLOT_CLOSING,
+	SLOT_DONE
+};
+
+struct slot {
+	enum slot_state      state;
+	unsigned             index;
+	int                  fd;
+	int                  failed;
+	unsigned long long   offset;
+	void                *file;
+	unsigned char       *buffer;
+};
+
+struct uring {
+	struct ring                  ring;
+	char *const                 *names;
+	size_t                       buffer_size;
+	const struct uring_file_ops *ops;
+	void                        *ctx;
+};
+
+static
+void
+queue_open(struct uring *u, struct slot *s, unsigned slot)
+{
+	struct io_uring_sqe *sqe = ring_get_sqe(&u->ring, IORING_OP_OPENAT, slot);
+	sqe->fd         = AT_FDCWD;
+	sqe->addr       = (unsigned long long)(size_t)u->names[s->index];
+	sqe->open_flags = O_RDONLY;
+	s->state = SLOT_OPENING;
+}
+
+static
+void
+queue_read(struct uring *u, struct slot *s, unsigned slot)
+{
+	struct io_uring_sqe *sqe = ring_get_sqe(&u->ring, IORING_OP_READ, slot);
+	sqe->fd   = s->fd;
+	sqe->addr = (unsigned long long)(size_t)s->buffer;
+	sqe->len  = (unsigned)u->buffer_size;
+	sqe->off  = s->offset;
+	s->state  = SLOT_READING;
+}
+
+static
+void
+queue_close(struct uring *u, struct slot *s, unsigned slot)
+{
+	struct io_uring_sqe *sqe = ring_get_sqe(&u->ring, IORING_OP_CLOSE, slot);
+	sqe->fd  = s->fd;
+	s->state = SLOT_CLOSING;
+}
+
+static
+void
+complete(struct uring *u, struct slot *s, unsigned slot, int res)
+{
+	switch (s->state) {
+	case SLOT_OPENING:
+		if (res < 0) {
+			fprintf(stderr, "could not open '%s'\n", u->names[s->index]);
+			s->failed = 1;
+			s->state  = SLOT_DONE;
+		} else {
+			s->fd = res;
+			queue_read(u, s, slot);
+		}
+		break;
+	case SLOT_READING:
+		if ((res == -EINTR) || (res == -EAGAIN)) {
+			queue_read(u, s, slot);
+		} else if (res < 0) {
+			fprintf(stderr, "error reading '%s'\n", u->names[s->index]);
+			s->failed = 1;
+			queue_close(u, s, slot);
+		} else if (res == 0) {
+			queue_close(u, s, slot);
+		} else if (u->ops->process(s->file, s->buffer, (size_t)res)) {
+			/* The caller will read the rest of the file itself. */
+			queue_close(u, s, slot);
+		} else {
+			s->offset += (unsigned)res;
+			queue_read(u, s, slot);
+		}
+		break;
+	case SLOT_CLOSING:
+		s->state = SLOT_DONE;
+		break;
+	default:
+		break;
+	}
+}
+
+int uring_run(char *const *names, unsigned nb_files, unsigned depth, size_t buffer_size, const struct uring_file_ops *ops, void *ctx, FILE *out)
+{
+	struct uring u;
+	struct slot *slots;
+	unsigned next = 0;
+	unsigned written = 0;
+	unsigned i;
+	int failed = 0;
+	int ret;
+
+	if (!nb_files)
+		return 0;
+	if (depth > nb_files)
+		depth = nb_files;
+	if (!depth)
+		depth = 1;
+	if (buffer_size > 0x7FFFF000ul)
+		buffer_size = 0x7FFFF000ul;
+
+	ret = ring_create(&u.ring, depth);
+	if (ret)
+		return ret;
+
+	slots = calloc(depth, sizeof(slots[0]));
+	if (!slots) {
+		ring_destroy(&u.ring);
+		return -1;
+	}
+	for (i = 0; i < depth; i++) {
+		slots[i].buffer = malloc(buffer_size);
+		if (!slots[i].buffer)
+			break;
+	}
+	if (i < depth) {
+		while (i--)
+			free(slots[i].buffer);
+		free(slots);
+		ring_destroy(&u.ring);
+		return -1;
+	}
+
+	u.names       = names;
+	u.buffer_size = buffer_size;
+	u.ops         = ops;
+	u.ctx         = ctx;
+
+	/* File n always occupies slot n % depth. A slot only becomes free once
+	 * its file has been passed to end() so the output stays in order and
+	 * no more than depth files are ever in flight. */
+	while (written < nb_files) {
+		struct slot *s;
+		unsigned head, tail;
+		int skip;
+
+		while ((next < nb_files) && (next < written + depth)) {
+			s = slots + (next % depth);
+			s->index  = next;
+			s->fd     = -1;
+			s->failed = 0;
+			s->offset = 0;
+			skip      = 0;
+			s->file   = ops->begin(ctx, next, &skip);
+			if (s->file && !skip) {
+				queue_open(&u, s, next % depth);
+			} else {
+				s->failed = (s->file == NULL);
+				s->state  = SLOT_DONE;
+			}
+			next++;
+		}
+
+		s = slots + (written % depth);
+		if (s->state == SLOT_DONE) {
+			if (ops->end(ctx, s->file, s->index, s->failed, out) || s->failed)
+				failed++;
+			s->state = SLOT_FREE;
+			written++;
+			continue;
+		}
+
+		if (ring_submit_and_wait(&u.ring)) {
+			failed = -1;
+			break;
+		}
+
+		head = *u.ring.cq_head;
+		tail = __atomic_load_n(u.ring.cq_tail, __ATOMIC_ACQUIRE);
+		while (head != tail) {
+			const struct io_uring_cqe *cqe = u.ring.cqes + (head & *u.ring.cq_mask);
+			unsigned slot = (unsigned)cqe->user_data;
+			int res = cqe->res;
+			/* Retire the entry before anything is queued in response to
+			 * it so the completion queue can never overflow. */
+			__atomic_store_n(u.ring.cq_head, ++head, __ATOMIC_RELEASE);
+			complete(&u, slots + slot, slot, res);
+		}
+	}
+
+	/* Only reached with files outstanding if the ring failed. Closing the
+	 * ring cancels whatever is still queued. */
+	ring_destroy(&u.ring);
+	for (; written < next; written++) {
+		struct slot *s = slots + (written % depth);
+		if ((s->state == SLOT_READING) || (s->state == SLOT_CLOSING))
+			close(s->fd);
+		ops->end(ctx, s->file, s->index, 1, out);
+	}
+	for (i = 0; i < depth; i++)
+		free(slots[i].buffer);
+	free(slots);
+
+	return failed;
+}
+
+#else
+
+int uring_run(char *const *names, unsigned nb_files, unsigned depth, size_t buffer_size, const struct uring_file_ops *ops, void *ctx, FILE *out)
+{
+	(void)names;
+	(void)nb_files;
+	(void)depth;
+	(void)buffer_size;
+	(void)ops;
+	(void)ctx;
+	(void)out;
+	return URING_UNAVAILABLE;
+}
+
+#endif
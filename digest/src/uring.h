@@ -0,0 +1,70 @@
+/* Copyright (c) 2014, Nicholas Appleton (http://www.appletonaudio.com)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither Nicholas Appleton nor the names of its contributors may be
+ *       used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL NICHOLAS APPLETON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE. */
+
+#ifndef URING_H_
+#define URING_H_
+
+#include <stdio.h>
+#include <stddef.h>
+
+/* Using this API:
+ *
+ * uring_run() hashes a list of files through a single io_uring instance on
+ * the calling thread. Up to depth files are kept in flight at once; their
+ * opens, reads and closes are all queued on the ring so that many files cost
+ * a handful of system calls rather than several each. This is intended for
+ * large numbers of small files where the system calls rather than the
+ * hashing dominate.
+ *
+ * For every file, begin() is called to create the per-file state before the
+ * file is opened. If begin() sets *skip, the file is not read at all and is
+ * passed straight to end(). process() is called with each piece of the file
+ * in order. If it returns non-zero, nothing more is read and the file is
+ * passed to end() as if it had been read completely. end() is called exactly once per file, in the order the files
+ * were given, with a non-zero failed argument if the file could not be
+ * opened or read (a message will already have been written to stderr) and
+ * the stream which output for the file should be written to. end() is
+ * responsible for releasing the per-file state. If begin() returns NULL, the
+ * file is treated as having failed and end() is given a NULL state.
+ *
+ * uring_run() returns the number of files which failed, URING_UNAVAILABLE if
+ * the kernel does not provide io_uring or the operations which are required
+ * (in which case nothing was done) or another negative value on failure. */
+
+#define URING_UNAVAILABLE (-2)
+
+/* Default number of files kept in flight. */
+#define URING_DEPTH (32)
+
+struct uring_file_ops {
+	void *(*begin)(void *ctx, unsigned index, int *skip);
+	int   (*process)(void *file, const unsigned char *data, size_t size);
+	int   (*end)(void *ctx, void *file, unsigned index, int failed, FILE *out);
+};
+
+int uring_run(char *const *names, unsigned nb_files, unsigned depth, size_t buffer_size, const struct uring_file_ops *ops, void *ctx, FILE *out);
+
+#endif /* URING_H_ */
@@ -0,0 +1,238 @@
+/* Copyright (c) 2014, Nicholas Appleton (http://www.appletonaudio.com)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither Nicholas Appleton nor the names of its contributors may be
+ *       used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL NICHOLAS APPLETON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE. */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#include <linux/fiemap.h>
+#endif
+#include "walk.h"
+
+struct walk_entry {
+	char                *path;
+	size_t               len;
+	unsigned long long   physical;
+	unsigned long long   ino;
+};
+
+struct walk {
+	struct walk_entry   *entries;
+	unsigned             nb;
+	unsigned             capacity;
+
+	/* Cleared as soon as the filesystem refuses FIEMAP so that the
+	 * remaining files are not opened for nothing. */
+	int                  use_fiemap;
+
+	int                  unreadable;
+
+	char                *path;
+	size_t               path_capacity;
+};
+
+/* Finds the physical offset of the start of the file. Files without any
+ * extents (empty or inline) are given zero. */
+static
+int
+first_extent(const char *path, unsigned long long *physical)
+{
+#ifdef FS_IOC_FIEMAP
+	struct fiemap *map;
+	int fd = open(path, O_RDONLY);
+	int ret;
+
+	if (fd < 0)
+		return -1;
+
+	map = calloc(1, sizeof(*map) + sizeof(map->fm_extents[0]));
+	if (!map) {
+		close(fd);
+		return -1;
+	}
+	map->fm_start        = 0;
+	map->fm_length       = ~0ull;
+	map->fm_extent_count = 1;
+	ret = ioctl(fd, FS_IOC_FIEMAP, map);
+	close(fd);
+	if (ret == 0)
+		*physical = (map->fm_mapped_extents) ? map->fm_extents[0].fe_physical : 0;
+	free(map);
+	return (ret == 0) ? 0 : -1;
+#else
+	(void)path;
+	(void)physical;
+	return -1;
+#endif
+}
+
+static
+int
+walk_add_file(struct walk *w, size_t len, unsigned long long ino)
+{
+	struct walk_entry *e;
+
+	if (w->nb == w->capacity) {
+		unsigned capacity = (w->capacity) ? (2 * w->capacity) : 256;
+		e = realloc(w->entries, capacity * sizeof(w->entries[0]));
+		if (!e)
+			return -1;
+		w->entries  = e;
+		w->capacity = capacity;
+	}
+
+	e = w->entries + w->nb;
+	e->path = malloc(len + 1);
+	if (!e->path)
+		return -1;
+	memcpy(e->path, w->path, len + 1);
+	e->len      = len;
+	e->ino      = ino;
+	e->physical = 0;
+	if (w->use_fiemap && first_extent(e->path, &e->physical))
+		w->use_fiemap = 0;
+	w->nb++;
+	return 0;
+}
+
+/* Walks the directory whose name occupies the first len characters of
+ * w->path. */
+static
+int
+walk_dir(struct walk *w, size_t len)
+{
+	DIR *d = opendir(w->path);
+	struct dirent *de;
+	size_t base = len;
+	int ret = 0;
+
+	if (!d) {
+		fprintf(stderr, "could not open directory '%s'\n", w->path);
+		w->unreadable++;
+		return 0;
+	}
+
+	if (w->path[len-1] != '/')
+		w->path[base++] = '/';
+
+	while ((ret == 0) && ((de = readdir(d)) != NULL)) {
+		size_t sub_len = base + strlen(de->d_name);
+		unsigned char type = DT_UNKNOWN;
+		struct stat st;
+
+		if ((strcmp(de->d_name, ".") == 0) || (strcmp(de->d_name, "..") == 0))
+			continue;
+
+		if (sub_len + 1 > w->path_capacity) {
+			size_t capacity = 2 * (sub_len + 1);
+			char *p = realloc(w->path, capacity);
+			if (!p) {
+				ret = -1;
+				break;
+			}
+			w->path          = p;
+			w->path_capacity = capacity;
+		}
+		memcpy(w->path + base, de->d_name, sub_len - base + 1);
+
+#ifdef _DIRENT_HAVE_D_TYPE
+		type = de->d_type;
+#endif
+		if ((type == DT_UNKNOWN) && (lstat(w->path, &st) == 0)) {
+			if (S_ISDIR(st.st_mode))
+				type = DT_DIR;
+			else if (S_ISREG(st.st_mode))
+				type = DT_REG;
+		}
+
+		if (type == DT_DIR)
+			ret = walk_dir(w, sub_len);
+		else if (type == DT_REG)
+			ret = walk_add_file(w, sub_len, (unsigned long long)de->d_ino);
+	}
+
+	closedir(d);
+	return ret;
+}
+
+static
+int
+entry_cmp(const void *a, const void *b)
+{
+	const struct walk_entry *ea = a;
+	const struct walk_entry *eb = b;
+	if (ea->physical != eb->physical)
+		return (ea->physical < eb->physical) ? -1 : 1;
+	if (ea->ino != eb->ino)
+		return (ea->ino < eb->ino) ? -1 : 1;
+	return strcmp(ea->path, eb->path);
+}
+
+int walk_tree(const char *root, walk_add_fn add, void *ctx)
+{
+	struct walk w;
+	size_t len = strlen(root);
+	unsigned i;
+	int ret;
+
+	w.entries       = NULL;
+	w.nb            = 0;
+	w.capacity      = 0;
+	w.use_fiemap    = 1;
+	w.unreadable    = 0;
+	w.path_capacity = len + 256;
+	w.path          = malloc(w.path_capacity);
+	if (!w.path)
+		return -1;
+	memcpy(w.path, root, len + 1);
+
+	ret = walk_dir(&w, len);
+
+	/* If FIEMAP stopped working part way through, the offsets which were
+	 * obtained cannot be compared with the rest. */
+	if (!w.use_fiemap)
+		for (i = 0; i < w.nb; i++)
+			w.entries[i].physical = 0;
+
+	qsort(w.entries, w.nb, sizeof(w.entries[0]), entry_cmp);
+
+	for (i = 0; i < w.nb; i++) {
+		if ((ret == 0) && add(ctx, w.entries[i].path, w.entries[i].len))
+			ret = -1;
+		free(w.entries[i].path);
+	}
+
+	free(w.entries);
+	free(w.path);
+	return (ret) ? ret : w.unreadable;
+}
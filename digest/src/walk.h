@@ -0,0 +1,50 @@
+/* Copyright (c) 2014, Nicholas Appleton (http://www.appletonaudio.com)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither Nicholas Appleton nor the names of its contributors may be
+ *       used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL NICHOLAS APPLETON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE. */
+
+#ifndef WALK_H_
+#define WALK_H_
+
+#include <stddef.h>
+
+/* Using this API:
+ *
+ * walk_tree() finds every regular file below the given directory (symbolic
+ * links are not followed) and calls add() with the path of each one. The
+ * paths are given in the order in which the files should be read to keep
+ * the disk heads moving in one direction: by the physical location of the
+ * first extent of each file where the filesystem reports it through FIEMAP
+ * and by inode number otherwise.
+ *
+ * add() returns zero on success. walk_tree() returns zero if the entire
+ * tree was walked, a positive value if some directories could not be read
+ * (a message is written to stderr for each) and a negative value if add()
+ * failed or memory could not be allocated. */
+
+typedef int (*walk_add_fn)(void *ctx, const char *path, size_t len);
+
+int walk_tree(const char *root, walk_add_fn add, void *ctx);
+
+#endif /* WALK_H_ */
@@ -0,0 +1,92 @@
+#!/bin/sh
+# Copyright (c) 2014, Nicholas Appleton (http://www.appletonaudio.com)
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#     * Redistributions of source code must retain the above copyright
+#       notice, this list of conditions and the following disclaimer.
+#     * Redistributions in binary form must reproduce the above copyright
+#       notice, this list of conditions and the following disclaimer in the
+#       documentation and/or other materials provided with the distribution.
+#     * Neither Nicholas Appleton nor the names of its contributors may be
+#       used to endorse or promote products derived from this software
+#       without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED. IN NO EVENT SHALL NICHOLAS APPLETON BE LIABLE FOR ANY
+# DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+# (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+# SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+# CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+# LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+# OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+# DAMAGE.
+
+# Runs the digest binary given as the only argument against command lines
+# whose behaviour depends on the application rather than on the hash
+# functions (which are covered by the unittest binary). Exits non-zero if
+# any test fails.
+
+DIGEST=$1
+TMP=$(mktemp -d) || exit 1
+trap 'rm -rf "$TMP"' EXIT
+passed=0
+failed=0
+
+result() {
+	if [ "$2" -eq 0 ]; then
+		echo "  $1... passed"
+		passed=$((passed + 1))
+	else
+		echo "  $1... failed"
+		failed=$((failed + 1))
+	fi
+}
+
+# stdin has no name to cache a digest under: --cache must be refused rather
+# than silently hashing nothing.
+cache_stdin() {
+	echo abc | "$DIGEST" sha2.256 --cache "$TMP/cache" > "$TMP/out" 2> /dev/null && return 1
+	[ ! -s "$TMP/out" ] && [ ! -e "$TMP/cache" ]
+}
+
+# Small files in a batch are digested together with digest_jobs(). A digest
+# which is not a whole number of bytes must still print exactly as it does
+# when the file is hashed on its own.
+batch_partial_byte() {
+	mkdir "$TMP/partial" || return 1
+	for i in 1 2 3 4 5 6 7 8; do
+		echo "file $i" > "$TMP/partial/f$i"
+	done
+	for i in 1 2 3 4 5 6 7 8; do
+		single=$("$DIGEST" sha2.100 sha2.300 -f "$TMP/partial/f$i") || return 1
+		echo "$single$TMP/partial/f$i"
+	done | sort > "$TMP/single"
+	"$DIGEST" sha2.100 sha2.300 -r "$TMP/partial" | sort > "$TMP/batch" || return 1
+	cmp -s "$TMP/single" "$TMP/batch"
+}
+
+# Files larger than an io_uring buffer are handed over to the reader part
+# way through. Every file of a batch must still print the digests it gets
+# on its own.
+batch_sizes() {
+	mkdir "$TMP/sizes" || return 1
+	for n in 0 1 16383 16384 16385 40000 300000; do
+		head -c $n /dev/urandom > "$TMP/sizes/f$n" || return 1
+		single=$("$DIGEST" md5 sha2.256 -f "$TMP/sizes/f$n") || return 1
+		echo "$single$TMP/sizes/f$n"
+	done | sort > "$TMP/single"
+	"$DIGEST" md5 sha2.256 -r "$TMP/sizes" | sort > "$TMP/batch" || return 1
+	cmp -s "$TMP/single" "$TMP/batch"
+}
+
+echo "cli"
+cache_stdin; result "cache_stdin" $?
+batch_partial_byte; result "batch_partial_byte" $?
+batch_sizes; result "batch_sizes" $?
+
+echo "$passed cli tests passed"
+[ "$failed" -eq 0 ]
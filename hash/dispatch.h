@@ -0,0 +1,90 @@
+/* Copyright (c) 2014, Nicholas Appleton (http://www.appletonaudio.com)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither Nicholas Appleton nor the names of its contributors may be
+ *       used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL NICHOLAS APPLETON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE. */
+
+#ifndef DISPATCH_H_
+#define DISPATCH_H_
+
+/* Runtime kernel dispatch.
+ *
+ * Parts of several algorithms have more than one implementation (a kernel),
+ * most of which depend on instruction set extensions. Each of these parts is
+ * a slot which lists its kernels in order of preference. A hash object uses
+ * the first kernel of each slot which was compiled in and which can run on
+ * the processor. Every slot has a kernel which can always run and kernels
+ * listed after it are only ever used when forced.
+ *
+ * The choice can be overridden through the DIGEST_FORCE_KERNEL environment
+ * variable. It holds a comma separated list of "slot=kernel" pairs and bare
+ * kernel names. A bare name applies to every slot which has a kernel of that
+ * name and a pair applies to one slot, taking precedence over bare names:
+ * "portable,sha1=shani" runs everything portable except for SHA-1. Forcing a
+ * kernel which cannot run on the processor has no effect. The choice for
+ * each slot is made the first time it is needed and kept from then on. */
+
+#include "mccl/mccl_cpuid.h"
+
+#define DISPATCH_FORCE_ENV "DIGEST_FORCE_KERNEL"
+
+/* The "built" value of kernels which are compiled in wherever the x86
+ * extensions can be detected. */
+#ifdef MCCL_CPUID_X86
+#define DISPATCH_X86 (1)
+#else
+#define DISPATCH_X86 (0)
+#endif
+
+struct dispatch_kernel_s {
+	const char *name;
+
+	/* The MCCL_CPU_* flags which must all be present. */
+	unsigned    requires;
+
+	/* Zero if the kernel was not compiled in. */
+	int         built;
+};
+
+struct dispatch_slot_s {
+	const char                     *name;
+	const char                     *description;
+	const struct dispatch_kernel_s *kernels;
+	unsigned                        nb_kernels;
+};
+
+/* Every slot, terminated by NULL. */
+extern const struct dispatch_slot_s *const dispatch_slots[];
+
+/* Returns non-zero if the kernel was compiled in and the processor has all
+ * of the features it requires. */
+int dispatch_usable(const struct dispatch_kernel_s *kernel);
+
+/* Returns the index of the kernel to use for the slot. */
+unsigned dispatch_select(const struct dispatch_slot_s *slot);
+
+/* Returns the index of the kernel which would be used for the slot if the
+ * environment variable held force (which may be NULL). Nothing is kept. */
+unsigned dispatch_choose(const struct dispatch_slot_s *slot, const char *force);
+
+#endif /* DISPATCH_H_ */
@@ -79,10 +79,23 @@
  * member). destroy() can be called at any time and has no obligation to
  * change or nullify any members of the hash object passed to it.
  * Once destroy() has been called, using any of the hash object API is
- * undefined behaviour. */
+ * undefined behaviour.
+ *
+ * digest_jobs() is optional and may be NULL. When present, it computes the
+ * digest of each of nb_jobs independent messages exactly as a begin(),
+ * process(), end() sequence over the job's data would, storing each one in
+ * the job's result buffer. Implementations use it to work on several
+ * messages at once. It may only be called in the uninitialised state and
+ * leaves the hash object in the uninitialised state. */
 
 struct hash_pvt_s;
 
+struct hash_job_s {
+	const unsigned char *data;
+	size_t               size;
+	unsigned char       *result;
+};
+
 struct hash_s {
 	struct hash_pvt_s *state;
 
@@ -91,6 +104,7 @@ struct hash_s {
 	void        (*end)(struct hash_s *hash, unsigned char *result);
 	void        (*destroy)(struct hash_s *hash);
 	unsigned    (*query_digest_size)(const struct hash_s *hash);
+	void        (*digest_jobs)(struct hash_s *hash, struct hash_job_s *jobs, unsigned nb_jobs);
 };
 
 
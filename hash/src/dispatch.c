@@ -0,0 +1,141 @@
+/* Copyright (c) 2014, Nicholas Appleton (http://www.appletonaudio.com)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither Nicholas Appleton nor the names of its contributors may be
+ *       used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL NICHOLAS APPLETON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE. */
+
+#include "hash/dispatch.h"
+#include <stdlib.h>
+#include <string.h>
+
+extern const struct dispatch_slot_s sha1_dispatch;
+extern const struct dispatch_slot_s sha2_256_dispatch;
+extern const struct dispatch_slot_s sha2_256_mb_dispatch;
+extern const struct dispatch_slot_s sha2_512_dispatch;
+extern const struct dispatch_slot_s sha2_512_mb_dispatch;
+extern const struct dispatch_slot_s sha3_mb_dispatch;
+extern const struct dispatch_slot_s md4_mb_dispatch;
+extern const struct dispatch_slot_s md5_mb_dispatch;
+extern const struct dispatch_slot_s tiger_mb_dispatch;
+extern const struct dispatch_slot_s stitch_dispatch;
+
+const struct dispatch_slot_s *const dispatch_slots[] =
+{	&sha1_dispatch
+,	&sha2_256_dispatch
+,	&sha2_256_mb_dispatch
+,	&sha2_512_dispatch
+,	&sha2_512_mb_dispatch
+,	&sha3_mb_dispatch
+,	&md4_mb_dispatch
+,	&md5_mb_dispatch
+,	&tiger_mb_dispatch
+,	&stitch_dispatch
+,	NULL
+};
+
+int dispatch_usable(const struct dispatch_kernel_s *kernel)
+{
+	return kernel->built && ((mccl_cpu_features() & kernel->requires) == kernel->requires);
+}
+
+/* Returns the index of the first usable kernel of the slot with the given
+ * name or nb_kernels if there is none. */
+static
+unsigned
+dispatch_find(const struct dispatch_slot_s *slot, const char *name, size_t name_len)
+{
+	unsigned i;
+	for (i = 0; i < slot->nb_kernels; i++) {
+		const struct dispatch_kernel_s *k = slot->kernels + i;
+		if ((strlen(k->name) == name_len) && (strncmp(k->name, name, name_len) == 0) && dispatch_usable(k))
+			break;
+	}
+	return i;
+}
+
+/* Returns the index of the kernel which the force string selects for the
+ * slot or nb_kernels if it does not select one. */
+static
+unsigned
+dispatch_forced(const struct dispatch_slot_s *slot, const char *force)
+{
+	unsigned bare = slot->nb_kernels;
+	while (*force != '\0') {
+		size_t len = strcspn(force, ",");
+		const char *eq = memchr(force, '=', len);
+		size_t name_len = (eq != NULL) ? (size_t)(eq - force) : 0;
+		if (eq == NULL) {
+			if (bare == slot->nb_kernels)
+				bare = dispatch_find(slot, force, len);
+		} else if ((name_len == strlen(slot->name)) && (strncmp(force, slot->name, name_len) == 0)) {
+			unsigned i = dispatch_find(slot, eq + 1, len - name_len - 1);
+			if (i < slot->nb_kernels)
+				return i;
+		}
+		force += len;
+		if (*force == ',')
+			force++;
+	}
+	return bare;
+}
+
+unsigned dispatch_choose(const struct dispatch_slot_s *slot, const char *force)
+{
+	unsigned i;
+
+	if (force != NULL) {
+		i = dispatch_forced(slot, force);
+		if (i < slot->nb_kernels)
+			return i;
+	}
+	for (i = 0; i + 1 < slot->nb_kernels; i++)
+		if (dispatch_usable(&slot->kernels[i]))
+			break;
+	return i;
+}
+
+#if defined(__GNUC__)
+#define DISPATCH_LOAD(p)     __atomic_load_n(p, __ATOMIC_RELAXED)
+#define DISPATCH_STORE(p, v) __atomic_store_n(p, v, __ATOMIC_RELAXED)
+#else
+#define DISPATCH_LOAD(p)     (*(p))
+#define DISPATCH_STORE(p, v) (*(p) = (v))
+#endif
+
+unsigned dispatch_select(const struct dispatch_slot_s *slot)
+{
+	/* One more than the chosen kernel of each registered slot or zero if it
+	 * has not been chosen yet. */
+	static unsigned chosen[sizeof(dispatch_slots) / sizeof(dispatch_slots[0])];
+	unsigned s, i;
+
+	for (s = 0; (dispatch_slots[s] != NULL) && (dispatch_slots[s] != slot); s++)
+		;
+	if ((dispatch_slots[s] != NULL) && ((i = DISPATCH_LOAD(&chosen[s])) != 0))
+		return i - 1;
+
+	i = dispatch_choose(slot, getenv(DISPATCH_FORCE_ENV));
+	if (dispatch_slots[s] != NULL)
+		DISPATCH_STORE(&chosen[s], i + 1);
+	return i;
+}
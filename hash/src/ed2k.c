@@ -0,0 +1,202 @@
+/* Copyright (c) 2014, Nicholas Appleton (http://www.appletonaudio.com)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither Nicholas Appleton nor the names of its contributors may be
+ *       used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL NICHOLAS APPLETON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE. */
+
+#include <stdlib.h>
+#include <string.h>
+#include "hash/ed2k.h"
+#include "hash/md4.h"
+
+/* The number of whole chunks given to MD4's digest_jobs() at once. */
+#define ED2K_BATCH (8)
+
+struct hash_pvt_s {
+	/* Digests the chunk currently being filled, or whole chunks through
+	 * digest_jobs(). */
+	struct hash_s  chunk;
+
+	/* Digests the chunk digests. */
+	struct hash_s  root;
+
+	/* Bytes of the current chunk which have been given to chunk and the
+	 * number of chunks which have been given to root. */
+	size_t         chunk_fill;
+	size_t         nb_chunks;
+};
+
+static
+void
+ed2k_begin(struct hash_s *hash)
+{
+	struct hash_pvt_s *ctx = hash->state;
+	ctx->chunk.begin(&ctx->chunk);
+	ctx->root.begin(&ctx->root);
+	ctx->chunk_fill = 0;
+	ctx->nb_chunks  = 0;
+}
+
+static
+void
+ed2k_chunk_done(struct hash_pvt_s *ctx)
+{
+	unsigned char digest[16];
+	ctx->chunk.end(&ctx->chunk, digest);
+	ctx->root.process(&ctx->root, digest, sizeof(digest));
+	ctx->nb_chunks++;
+}
+
+static
+void
+ed2k_process(struct hash_s *hash, const unsigned char *data, size_t size)
+{
+	struct hash_pvt_s *ctx = hash->state;
+
+	/* Finish off a chunk which was started by an earlier call. */
+	if (ctx->chunk_fill) {
+		size_t cpy = ED2K_CHUNK_SIZE - ctx->chunk_fill;
+		if (cpy > size)
+			cpy = size;
+		ctx->chunk.process(&ctx->chunk, data, cpy);
+		ctx->chunk_fill += cpy;
+		data += cpy;
+		size -= cpy;
+		if (ctx->chunk_fill < ED2K_CHUNK_SIZE)
+			return;
+		ed2k_chunk_done(ctx);
+		ctx->chunk_fill = 0;
+	}
+
+	/* Chunks which are entirely within the buffer are independent MD4
+	 * messages and are hashed together across the lanes of the MD4
+	 * multi-buffer engine. */
+	while (size >= ED2K_CHUNK_SIZE) {
+		struct hash_job_s jobs[ED2K_BATCH];
+		unsigned char digests[ED2K_BATCH][16];
+		unsigned nb = (size / ED2K_CHUNK_SIZE > ED2K_BATCH) ? ED2K_BATCH : (unsigned)(size / ED2K_CHUNK_SIZE);
+		unsigned i;
+		for (i = 0; i < nb; i++) {
+			jobs[i].data   = data + i * (size_t)ED2K_CHUNK_SIZE;
+			jobs[i].size   = ED2K_CHUNK_SIZE;
+			jobs[i].result = digests[i];
+		}
+		ctx->chunk.digest_jobs(&ctx->chunk, jobs, nb);
+		ctx->root.process(&ctx->root, digests[0], nb * sizeof(digests[0]));
+		ctx->nb_chunks += nb;
+		data += nb * (size_t)ED2K_CHUNK_SIZE;
+		size -= nb * (size_t)ED2K_CHUNK_SIZE;
+	}
+
+	if (size) {
+		ctx->chunk.begin(&ctx->chunk);
+		ctx->chunk.process(&ctx->chunk, data, size);
+		ctx->chunk_fill = size;
+	}
+}
+
+static
+void
+ed2k_end(struct hash_s *hash, unsigned char *result)
+{
+	struct hash_pvt_s *ctx = hash->state;
+
+	/* The chunk object may have been used by digest_jobs() since it was
+	 * last started. */
+	if (!ctx->chunk_fill)
+		ctx->chunk.begin(&ctx->chunk);
+
+	if (!ctx->nb_chunks) {
+		ctx->chunk.end(&ctx->chunk, result);
+		return;
+	}
+
+	ed2k_chunk_done(ctx);
+	ctx->root.end(&ctx->root, result);
+}
+
+static
+void
+ed2k_digest_jobs(struct hash_s *hash, struct hash_job_s *jobs, unsigned nb_jobs)
+{
+	struct hash_pvt_s *ctx = hash->state;
+	unsigned i;
+
+	/* Messages shorter than a chunk are plain MD4. */
+	for (i = 0; i < nb_jobs; i++)
+		if (jobs[i].size >= ED2K_CHUNK_SIZE)
+			break;
+	if (i == nb_jobs) {
+		ctx->chunk.digest_jobs(&ctx->chunk, jobs, nb_jobs);
+		return;
+	}
+
+	for (i = 0; i < nb_jobs; i++) {
+		ed2k_begin(hash);
+		ed2k_process(hash, jobs[i].data, jobs[i].size);
+		ed2k_end(hash, jobs[i].result);
+	}
+}
+
+static
+unsigned
+ed2k_query_digest_size(const struct hash_s *hash)
+{
+	return 128;
+}
+
+static
+void
+ed2k_destroy(struct hash_s *hash)
+{
+	hash->state->chunk.destroy(&hash->state->chunk);
+	hash->state->root.destroy(&hash->state->root);
+	free(hash->state);
+}
+
+int
+ed2k_create(struct hash_s *hash)
+{
+	struct hash_pvt_s *ctx = malloc(sizeof(struct hash_pvt_s));
+	if (!ctx)
+		return -1;
+	if (md4_create(&ctx->chunk)) {
+		free(ctx);
+		return -1;
+	}
+	if (md4_create(&ctx->root)) {
+		ctx->chunk.destroy(&ctx->chunk);
+		free(ctx);
+		return -1;
+	}
+	ctx->chunk_fill = 0;
+	ctx->nb_chunks  = 0;
+	hash->state = ctx;
+	hash->begin = ed2k_begin;
+	hash->process = ed2k_process;
+	hash->end = ed2k_end;
+	hash->digest_jobs = ed2k_digest_jobs;
+	hash->destroy = ed2k_destroy;
+	hash->query_digest_size = ed2k_query_digest_size;
+	return 0;
+}
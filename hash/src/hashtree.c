@@ -31,6 +31,10 @@
 #include <limits.h>
 #include "hash/hashtree.h"
 
+/* The number of leaves handed to the hash function's digest_jobs() at
+ * once. */
+#define HASHTREE_BATCH (32)
+
 /* Hash tree key structure. */
 struct htk_s {
 	/* Specifies how many times the data has been hashed from other hashes.
@@ -59,6 +63,9 @@ struct hash_pvt_s {
 	size_t         key_size;
 	struct hash_s *hash;
 
+	/* Digests of a batch of leaves (HASHTREE_BATCH keys). */
+	unsigned char *batch_data;
+
 	/* Base memory for all htk_s structures. Simplifies freeing of memory
 	 * later on as we move pointers all over the place. */
 	void          *basemem;
@@ -211,6 +218,39 @@ run_block(struct hash_pvt_s *tree, const unsigned char *data, size_t size)
 	tree_append(tree, k);
 }
 
+/* Hashes nb_blocks consecutive whole blocks as a batch of independent
+ * messages and adds their hashes into the tree in order. Only used when the
+ * hash function supports digest_jobs(). */
+static
+void
+run_blocks(struct hash_pvt_s *tree, const unsigned char *data, size_t nb_blocks)
+{
+	struct hash_job_s jobs[HASHTREE_BATCH];
+
+	while (nb_blocks) {
+		unsigned nb = (nb_blocks > HASHTREE_BATCH) ? HASHTREE_BATCH : (unsigned)nb_blocks;
+		unsigned i;
+
+		for (i = 0; i < nb; i++) {
+			jobs[i].data   = data + i * tree->block_size;
+			jobs[i].size   = tree->block_size;
+			jobs[i].result = tree->batch_data + i * tree->key_size;
+		}
+		tree->hash->digest_jobs(tree->hash, jobs, nb);
+
+		for (i = 0; i < nb; i++) {
+			struct htk_s *k = tree->pool;
+			assert(k);
+			tree->pool = tree->pool->next;
+			memcpy(k->data, jobs[i].result, tree->key_size);
+			tree_append(tree, k);
+		}
+
+		data      += nb * tree->block_size;
+		nb_blocks -= nb;
+	}
+}
+
 static
 void
 hashtree_destroy(struct hash_s *tree)
@@ -277,6 +317,12 @@ hashtree_process(struct hash_s *tree, const unsigned char *data, size_t size)
 			tree->state->block_index = 0;
 		}
 	}
+	if ((tree->state->hash->digest_jobs != NULL) && (size >= tree->state->block_size)) {
+		size_t nb_blocks = size / tree->state->block_size;
+		run_blocks(tree->state, data, nb_blocks);
+		data += nb_blocks * tree->state->block_size;
+		size -= nb_blocks * tree->state->block_size;
+	}
 	while (size >= tree->state->block_size) {
 		run_block(tree->state, data, tree->state->block_size);
 		data += tree->state->block_size;
@@ -359,7 +405,7 @@ hashtree_create(struct hash_s *tree, struct hash_s *alg, size_t block_size, unsi
 {
 	const unsigned key_bits = alg->query_digest_size(alg);
 	const size_t key_size = key_bits / 8;
-	struct hash_pvt_s *pvt = malloc(sizeof(*pvt) + block_size);
+	struct hash_pvt_s *pvt = malloc(sizeof(*pvt) + block_size + HASHTREE_BATCH * key_size);
 	const unsigned keys = req_nodes(UINT_MAX-1u, max_storage_levels) + 1;
 	unsigned i;
 
@@ -376,6 +422,7 @@ hashtree_create(struct hash_s *tree, struct hash_s *alg, size_t block_size, unsi
 	}
 
 	pvt->block_data = (unsigned char*)(pvt+1);
+	pvt->batch_data = pvt->block_data + block_size;
 
 	pvt->pool = pvt->basemem;
 	for (i = 1; i < keys; i++) {
@@ -398,6 +445,7 @@ hashtree_create(struct hash_s *tree, struct hash_s *alg, size_t block_size, unsi
 	tree->begin = hashtree_begin;
 	tree->process = hashtree_process;
 	tree->end = hashtree_end;
+	tree->digest_jobs = NULL;
 	tree->query_digest_size = hashtree_query_digest_size;
 
 	return 0;
@@ -29,9 +29,16 @@
 #include <assert.h>
 #include "mccl/mccl_op_uint64.h"
 #include "mccl/mccl_bufcvt.h"
+#include "mccl/mccl_cpuid.h"
+#include "hash/dispatch.h"
 #include "hash/md5.h"
+#include "md5_internal.h"
 
-static const mccl_uif32 md5_k[64] =
+#ifdef MCCL_CPUID_X86
+#include <immintrin.h>
+#endif
+
+const mccl_uif32 md5_k[64] =
 	{0xD76AA478u, 0xE8C7B756u, 0x242070DBu, 0xC1BDCEEEu
 	,0xF57C0FAFu, 0x4787C62Au, 0xA8304613u, 0xFD469501u
 	,0x698098D8u, 0x8B44F7AFu, 0xFFFF5BB1u, 0x895CD7BEu
@@ -118,7 +125,327 @@ static void md5_process_buffer(const unsigned char *data, mccl_uif32 *state)
 	state[3] += d;
 }
 
+/* Multi-buffer kernels. MD5 is little endian so the words of each lane are
+ * loaded as they are and the lanes transposed into word order. */
+
+static
+void
+md5_mb_single(union mb_state_u *state, const unsigned char *data, size_t nb_blocks)
+{
+	for (; nb_blocks; nb_blocks--, data += 64)
+		md5_process_buffer(data, state->w32);
+}
+
+static
+void
+md5_mb_portable_blocks(union mb_state_u *const *state, const unsigned char *const *data, size_t nb_blocks)
+{
+	md5_mb_single(state[0], data[0], nb_blocks);
+}
+
+static
+void
+md5_mb_store(const union mb_state_u *state, unsigned char *result, unsigned digest_bits)
+{
+	unsigned i;
+	for (i = 0; i < digest_bits / 8; i++)
+		result[i] = (unsigned char)((state->w32[i/4] >> 8u * (i & 0x03u)) & 0xFFu);
+}
+
+#ifdef MCCL_CPUID_X86
+
+/* One step of the compression function. The caller rotates the names of the
+ * working variables instead of moving them. */
+#define MB_STEP(fn, a, b, c, d, k, w, s) \
+	(a = ADD(b, VROL(ADD(ADD(a, fn(b, c, d)), ADD(SET1((int)(k)), w)), s)))
+
+#define MB_F(b, c, d) XOR(d, AND(b, XOR(c, d)))
+#define MB_G(b, c, d) XOR(c, AND(d, XOR(b, c)))
+#define MB_H(b, c, d) XOR(XOR(b, c), d)
+#define MB_I(b, c, d) XOR(c, OR(b, XOR(d, ones)))
+
+#define MB_IDX_F(i) (i)
+#define MB_IDX_G(i) ((5 * (i) + 1) & 15)
+#define MB_IDX_H(i) ((3 * (i) + 5) & 15)
+#define MB_IDX_I(i) ((7 * (i)) & 15)
+
+/* Four steps starting at step i. */
+#define MB_STEPS4(fn, idx, i, s0, s1, s2, s3) \
+	do { \
+		MB_STEP(fn, a, b, c, d, md5_k[(i) + 0], w[idx((i) + 0)], s0); \
+		MB_STEP(fn, d, a, b, c, md5_k[(i) + 1], w[idx((i) + 1)], s1); \
+		MB_STEP(fn, c, d, a, b, md5_k[(i) + 2], w[idx((i) + 2)], s2); \
+		MB_STEP(fn, b, c, d, a, md5_k[(i) + 3], w[idx((i) + 3)], s3); \
+	} while (0)
+
+#define MB_ROUNDS() \
+	do { \
+		MB_STEPS4(MB_F, MB_IDX_F, 0,  7, 12, 17, 22); \
+		MB_STEPS4(MB_F, MB_IDX_F, 4,  7, 12, 17, 22); \
+		MB_STEPS4(MB_F, MB_IDX_F, 8,  7, 12, 17, 22); \
+		MB_STEPS4(MB_F, MB_IDX_F, 12, 7, 12, 17, 22); \
+		MB_STEPS4(MB_G, MB_IDX_G, 16, 5,  9, 14, 20); \
+		MB_STEPS4(MB_G, MB_IDX_G, 20, 5,  9, 14, 20); \
+		MB_STEPS4(MB_G, MB_IDX_G, 24, 5,  9, 14, 20); \
+		MB_STEPS4(MB_G, MB_IDX_G, 28, 5,  9, 14, 20); \
+		MB_STEPS4(MB_H, MB_IDX_H, 32, 4, 11, 16, 23); \
+		MB_STEPS4(MB_H, MB_IDX_H, 36, 4, 11, 16, 23); \
+		MB_STEPS4(MB_H, MB_IDX_H, 40, 4, 11, 16, 23); \
+		MB_STEPS4(MB_H, MB_IDX_H, 44, 4, 11, 16, 23); \
+		MB_STEPS4(MB_I, MB_IDX_I, 48, 6, 10, 15, 21); \
+		MB_STEPS4(MB_I, MB_IDX_I, 52, 6, 10, 15, 21); \
+		MB_STEPS4(MB_I, MB_IDX_I, 56, 6, 10, 15, 21); \
+		MB_STEPS4(MB_I, MB_IDX_I, 60, 6, 10, 15, 21); \
+	} while (0)
+
+#define ADD(x, y)    _mm256_add_epi32(x, y)
+#define XOR(x, y)    _mm256_xor_si256(x, y)
+#define AND(x, y)    _mm256_and_si256(x, y)
+#define OR(x, y)     _mm256_or_si256(x, y)
+#define VROL(x, c)   _mm256_or_si256(_mm256_slli_epi32(x, c), _mm256_srli_epi32(x, 32 - (c)))
+#define SET1(x)      _mm256_set1_epi32(x)
+
+/* Loads eight words from each of the eight lanes and transposes them so that
+ * w[i] holds word i of every lane. */
+__attribute__((target("avx2")))
+static
+void
+md5_x8_load(__m256i *w, const unsigned char *const *p, unsigned offset)
+{
+	__m256i r[8], t[8], u[8];
+	unsigned i;
+
+	for (i = 0; i < 8; i++)
+		r[i] = _mm256_loadu_si256((const __m256i *)(p[i] + offset));
+
+	for (i = 0; i < 8; i += 2) {
+		t[i]     = _mm256_unpacklo_epi32(r[i], r[i + 1]);
+		t[i + 1] = _mm256_unpackhi_epi32(r[i], r[i + 1]);
+	}
+	for (i = 0; i < 8; i += 4) {
+		u[i]     = _mm256_unpacklo_epi64(t[i], t[i + 2]);
+		u[i + 1] = _mm256_unpackhi_epi64(t[i], t[i + 2]);
+		u[i + 2] = _mm256_unpacklo_epi64(t[i + 1], t[i + 3]);
+		u[i + 3] = _mm256_unpackhi_epi64(t[i + 1], t[i + 3]);
+	}
+	for (i = 0; i < 4; i++) {
+		w[i]     = _mm256_permute2x128_si256(u[i], u[i + 4], 0x20);
+		w[i + 4] = _mm256_permute2x128_si256(u[i], u[i + 4], 0x31);
+	}
+}
+
+__attribute__((target("avx2")))
+static
+void
+md5_x8_avx2(union mb_state_u *const *state, const unsigned char *const *data, size_t nb_blocks)
+{
+	const __m256i ones = _mm256_set1_epi32(-1);
+	const unsigned char *p[8];
+	__m256i s[4];
+	unsigned i;
+
+	for (i = 0; i < 8; i++)
+		p[i] = data[i];
+	for (i = 0; i < 4; i++)
+		s[i] = _mm256_set_epi32
+			((int)state[7]->w32[i], (int)state[6]->w32[i], (int)state[5]->w32[i], (int)state[4]->w32[i]
+			,(int)state[3]->w32[i], (int)state[2]->w32[i], (int)state[1]->w32[i], (int)state[0]->w32[i]
+			);
+
+	while (nb_blocks--) {
+		__m256i a = s[0], b = s[1], c = s[2], d = s[3];
+		__m256i w[16];
+
+		md5_x8_load(w, p, 0);
+		md5_x8_load(w + 8, p, 32);
+
+		MB_ROUNDS();
+
+		s[0] = ADD(s[0], a); s[1] = ADD(s[1], b);
+		s[2] = ADD(s[2], c); s[3] = ADD(s[3], d);
+
+		for (i = 0; i < 8; i++)
+			p[i] += 64;
+	}
+
+	for (i = 0; i < 4; i++) {
+		unsigned lanes[8];
+		unsigned j;
+		_mm256_storeu_si256((__m256i *)lanes, s[i]);
+		for (j = 0; j < 8; j++)
+			state[j]->w32[i] = lanes[j] & 0xFFFFFFFFu;
+	}
+}
+
+#undef ADD
+#undef XOR
+#undef AND
+#undef OR
+#undef VROL
+#undef SET1
+
+#define ADD(x, y)    _mm_add_epi32(x, y)
+#define XOR(x, y)    _mm_xor_si128(x, y)
+#define AND(x, y)    _mm_and_si128(x, y)
+#define OR(x, y)     _mm_or_si128(x, y)
+#define VROL(x, c)   _mm_or_si128(_mm_slli_epi32(x, c), _mm_srli_epi32(x, 32 - (c)))
+#define SET1(x)      _mm_set1_epi32(x)
+
+/* Loads four words from each of the four lanes and transposes them so that
+ * w[i] holds word i of every lane. */
+__attribute__((target("sse2")))
+static
+void
+md5_x4_load(__m128i *w, const unsigned char *const *p, unsigned offset)
+{
+	__m128i r[4], t[4];
+	unsigned i;
+
+	for (i = 0; i < 4; i++)
+		r[i] = _mm_loadu_si128((const __m128i *)(p[i] + offset));
+
+	t[0] = _mm_unpacklo_epi32(r[0], r[1]);
+	t[1] = _mm_unpacklo_epi32(r[2], r[3]);
+	t[2] = _mm_unpackhi_epi32(r[0], r[1]);
+	t[3] = _mm_unpackhi_epi32(r[2], r[3]);
+	w[0] = _mm_unpacklo_epi64(t[0], t[1]);
+	w[1] = _mm_unpackhi_epi64(t[0], t[1]);
+	w[2] = _mm_unpacklo_epi64(t[2], t[3]);
+	w[3] = _mm_unpackhi_epi64(t[2], t[3]);
+}
+
+__attribute__((target("sse2")))
+static
+void
+md5_x4_sse2(union mb_state_u *const *state, const unsigned char *const *data, size_t nb_blocks)
+{
+	const __m128i ones = _mm_set1_epi32(-1);
+	const unsigned char *p[4];
+	__m128i s[4];
+	unsigned i;
+
+	for (i = 0; i < 4; i++)
+		p[i] = data[i];
+	for (i = 0; i < 4; i++)
+		s[i] = _mm_set_epi32
+			((int)state[3]->w32[i], (int)state[2]->w32[i], (int)state[1]->w32[i], (int)state[0]->w32[i]);
+
+	while (nb_blocks--) {
+		__m128i a = s[0], b = s[1], c = s[2], d = s[3];
+		__m128i w[16];
+
+		for (i = 0; i < 4; i++)
+			md5_x4_load(w + 4 * i, p, 16 * i);
+
+		MB_ROUNDS();
+
+		s[0] = ADD(s[0], a); s[1] = ADD(s[1], b);
+		s[2] = ADD(s[2], c); s[3] = ADD(s[3], d);
+
+		for (i = 0; i < 4; i++)
+			p[i] += 64;
+	}
+
+	for (i = 0; i < 4; i++) {
+		unsigned lanes[4];
+		unsigned j;
+		_mm_storeu_si128((__m128i *)lanes, s[i]);
+		for (j = 0; j < 4; j++)
+			state[j]->w32[i] = lanes[j] & 0xFFFFFFFFu;
+	}
+}
+
+#undef ADD
+#undef XOR
+#undef AND
+#undef OR
+#undef VROL
+#undef SET1
+#undef MB_ROUNDS
+#undef MB_STEPS4
+#undef MB_IDX_I
+#undef MB_IDX_H
+#undef MB_IDX_G
+#undef MB_IDX_F
+#undef MB_I
+#undef MB_H
+#undef MB_G
+#undef MB_F
+#undef MB_STEP
+
+static const struct mb_engine_s md5_mb_avx2 =
+{	"avx2-x8", 8, 64, 8, 0, 0x80, 0x00
+,	md5_x8_avx2, md5_mb_single, md5_mb_store
+};
+
+static const struct mb_engine_s md5_mb_sse2 =
+{	"sse2-x4", 4, 64, 8, 0, 0x80, 0x00
+,	md5_x4_sse2, md5_mb_single, md5_mb_store
+};
+
+#endif
+
+static const struct mb_engine_s md5_mb_portable =
+{	"portable", 1, 64, 8, 0, 0x80, 0x00
+,	md5_mb_portable_blocks, md5_mb_single, md5_mb_store
+};
+
+enum {
+	MD5_MB_AVX2,
+	MD5_MB_SSE2,
+	MD5_MB_SERIAL,
+	MD5_MB_PORTABLE
+};
+
+static const struct dispatch_kernel_s md5_mb_kernels[] =
+{	{"avx2", MCCL_CPU_AVX2, DISPATCH_X86}
+,	{"sse2", MCCL_CPU_SSE2, DISPATCH_X86}
+,	{"serial", 0, 1}
+,	{"portable", 0, 1}
+};
+
+const struct dispatch_slot_s md5_mb_dispatch =
+{	"md5.mb", "MD5 batches of messages", md5_mb_kernels, 4
+};
+
+const struct mb_engine_s *md5_mb_get_avx2(void)
+{
+#ifdef MCCL_CPUID_X86
+	if (dispatch_usable(&md5_mb_kernels[MD5_MB_AVX2]))
+		return &md5_mb_avx2;
+#endif
+	return NULL;
+}
+
+const struct mb_engine_s *md5_mb_get_sse2(void)
+{
+#ifdef MCCL_CPUID_X86
+	if (dispatch_usable(&md5_mb_kernels[MD5_MB_SSE2]))
+		return &md5_mb_sse2;
+#endif
+	return NULL;
+}
+
+const struct mb_engine_s *md5_mb_get_portable(void)
+{
+	return &md5_mb_portable;
+}
+
+const struct mb_engine_s *md5_mb_select(void)
+{
+	switch (dispatch_select(&md5_mb_dispatch)) {
+	case MD5_MB_AVX2:
+		return md5_mb_get_avx2();
+	case MD5_MB_SSE2:
+		return md5_mb_get_sse2();
+	case MD5_MB_PORTABLE:
+		return md5_mb_get_portable();
+	}
+	return NULL;
+}
+
 struct hash_pvt_s {
+	const struct mb_engine_s *mb;
 	mccl_uif32    h[4];
 	UINT64        length;
 	unsigned      buffer_index;
@@ -215,6 +542,51 @@ md5_end(struct hash_s *hash, unsigned char *result)
 		result[i] = (unsigned char)((context->h[i>>2] >> 8 * ((i & 0x03u))) & 0xFFu);
 }
 
+static
+void
+md5_digest_jobs(struct hash_s *hash, struct hash_job_s *jobs, unsigned nb_jobs)
+{
+	unsigned i;
+
+	if (hash->state->mb != NULL) {
+		union mb_state_u iv;
+		memset(&iv, 0, sizeof(iv));
+		iv.w32[0] = 0x67452301u;
+		iv.w32[1] = 0xEFCDAB89u;
+		iv.w32[2] = 0x98BADCFEu;
+		iv.w32[3] = 0x10325476u;
+		mb_run(hash->state->mb, &iv, 128, jobs, nb_jobs);
+		return;
+	}
+
+	for (i = 0; i < nb_jobs; i++) {
+		md5_begin(hash);
+		md5_process(hash, jobs[i].data, jobs[i].size);
+		md5_end(hash, jobs[i].result);
+	}
+}
+
+mccl_uif32 *md5_stitch_state(struct hash_s *hash, unsigned *buffered)
+{
+	if (hash->process != md5_process)
+		return NULL;
+	if (buffered != NULL)
+		*buffered = hash->state->buffer_index;
+	return hash->state->h;
+}
+
+void md5_stitch_advance(struct hash_s *hash, size_t nb_blocks)
+{
+	static const UINT64 incr = UINT64_INIT(0, 8*64);
+	struct hash_pvt_s *context = hash->state;
+
+	assert(hash->process == md5_process && !context->buffer_index);
+	while (nb_blocks--) {
+		context->length = UINT64_ADD(context->length, incr);
+		assert(UINT64_HIGH(context->length) || UINT64_LOW(context->length));
+	}
+}
+
 static
 void
 md5_destroy(struct hash_s *hash)
@@ -234,9 +606,11 @@ int md5_create(struct hash_s *hash)
 	hash->state = malloc(sizeof(struct hash_pvt_s));
 	if (!hash->state)
 		return -1;
+	hash->state->mb = md5_mb_select();
 	hash->begin = md5_begin;
 	hash->process = md5_process;
 	hash->end = md5_end;
+	hash->digest_jobs = md5_digest_jobs;
 	hash->destroy = md5_destroy;
 	hash->query_digest_size = md5_query_digest_size;
 	return 0;
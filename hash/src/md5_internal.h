@@ -0,0 +1,60 @@
+/* Copyright (c) 2014, Nicholas Appleton (http://www.appletonaudio.com)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither Nicholas Appleton nor the names of its contributors may be
+ *       used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL NICHOLAS APPLETON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE. */
+
+#ifndef MD5_INTERNAL_H
+#define MD5_INTERNAL_H
+
+#include "hash/hash.h"
+#include "mccl/mccl_fastints.h"
+#include "multibuf.h"
+#include <stddef.h>
+
+/* The sine derived constant added in each of the 64 steps. */
+extern const mccl_uif32 md5_k[64];
+
+/* Multi-buffer engines which hash eight messages in AVX2 registers or four
+ * in SSE2 registers. Each returns NULL if the processor does not support it
+ * or it was not compiled in. The portable engine hashes one message at a
+ * time and always exists. */
+const struct mb_engine_s *md5_mb_get_avx2(void);
+const struct mb_engine_s *md5_mb_get_sse2(void);
+const struct mb_engine_s *md5_mb_get_portable(void);
+
+/* Returns the multi-buffer engine to use for batches of messages or NULL if
+ * hashing them one after the other is faster on this processor. */
+const struct mb_engine_s *md5_mb_select(void);
+
+/* Returns the chaining value of an MD5 hash object so that blocks can be
+ * compressed into it by a stitched kernel (see hash/stitch.h), or NULL if
+ * the object is not an MD5. If buffered is not NULL, it receives the number
+ * of bytes of an incomplete block which the object is holding. */
+mccl_uif32 *md5_stitch_state(struct hash_s *hash, unsigned *buffered);
+
+/* Counts nb_blocks blocks which were compressed into the chaining value as
+ * processed. The object must not be holding an incomplete block. */
+void md5_stitch_advance(struct hash_s *hash, size_t nb_blocks);
+
+#endif
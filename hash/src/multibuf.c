@@ -0,0 +1,182 @@
+/* Copyright (c) 2014, Nicholas Appleton (http://www.appletonaudio.com)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither Nicholas Appleton nor the names of its contributors may be
+ *       used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL NICHOLAS APPLETON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE. */
+
+#include "multibuf.h"
+#include <assert.h>
+#include <limits.h>
+#include <string.h>
+
+struct mb_lane_s {
+	/* The job occupying the lane or NULL if the lane is idle. */
+	struct hash_job_s   *job;
+
+	/* The run of blocks the lane is working through. This is the whole
+	 * blocks of the message itself followed by the padded tail. */
+	const unsigned char *data;
+	size_t               nb_blocks;
+	int                  in_tail;
+
+	/* The last partial block of the message with the padding and bit count
+	 * appended. */
+	unsigned char        tail[2 * MB_MAX_BLOCK_SIZE];
+	size_t               nb_tail;
+};
+
+/* Builds the padded final block(s) of the message in the lane's tail buffer
+ * and returns how many blocks they occupy. */
+static
+size_t
+build_tail(const struct mb_engine_s *engine, struct mb_lane_s *lane)
+{
+	const struct hash_job_s *job = lane->job;
+	const size_t bs = engine->block_size;
+	const size_t rem = job->size % bs;
+	const size_t total = (rem + 1 + engine->length_size <= bs) ? bs : 2 * bs;
+	const size_t bits_lo = job->size << 3;
+	const size_t bits_hi = job->size >> (sizeof(size_t) * CHAR_BIT - 3);
+	unsigned i;
+
+	if (rem)
+		memcpy(lane->tail, job->data + job->size - rem, rem);
+	lane->tail[rem] = engine->pad_byte;
+	memset(lane->tail + rem + 1, 0, total - rem - 1);
+	lane->tail[total - 1] |= engine->pad_final;
+
+	for (i = 0; i < engine->length_size; i++) {
+		unsigned char byte = 0;
+		if (i < sizeof(size_t))
+			byte = (unsigned char)((bits_lo >> (8 * i)) & 0xFFu);
+		else if (i == sizeof(size_t))
+			byte = (unsigned char)bits_hi;
+		if (engine->length_big_endian)
+			lane->tail[total - 1 - i] = byte;
+		else
+			lane->tail[total - engine->length_size + i] = byte;
+	}
+
+	return total / bs;
+}
+
+static
+void
+lane_start(const struct mb_engine_s *engine, struct mb_lane_s *lane, union mb_state_u *state, const union mb_state_u *iv, struct hash_job_s *job)
+{
+	*state = *iv;
+	lane->job = job;
+	lane->nb_tail = build_tail(engine, lane);
+	lane->nb_blocks = job->size / engine->block_size;
+	lane->data = job->data;
+	lane->in_tail = 0;
+	if (!lane->nb_blocks) {
+		lane->data = lane->tail;
+		lane->nb_blocks = lane->nb_tail;
+		lane->in_tail = 1;
+	}
+}
+
+void mb_run(const struct mb_engine_s *engine, const union mb_state_u *iv, unsigned digest_bits, struct hash_job_s *jobs, unsigned nb_jobs)
+{
+	struct mb_lane_s     lanes[MB_MAX_LANES];
+	union mb_state_u     states[MB_MAX_LANES];
+	union mb_state_u     spare = *iv;
+	union mb_state_u    *state_ptrs[MB_MAX_LANES];
+	const unsigned char *data_ptrs[MB_MAX_LANES];
+	unsigned             next = 0;
+	unsigned             i;
+
+	assert(engine->lanes >= 1 && engine->lanes <= MB_MAX_LANES);
+	assert(engine->block_size <= MB_MAX_BLOCK_SIZE);
+
+	for (i = 0; i < engine->lanes; i++)
+		lanes[i].job = NULL;
+
+	for (;;) {
+		unsigned active = 0;
+		unsigned last = 0;
+		size_t run = 0;
+
+		/* Refill idle lanes and find the longest run of blocks which every
+		 * busy lane can take without changing source. */
+		for (i = 0; i < engine->lanes; i++) {
+			struct mb_lane_s *lane = &lanes[i];
+			if (!lane->job && next < nb_jobs)
+				lane_start(engine, lane, &states[i], iv, &jobs[next++]);
+			if (lane->job) {
+				if (!active || lane->nb_blocks < run)
+					run = lane->nb_blocks;
+				active++;
+				last = i;
+			}
+		}
+
+		if (!active)
+			break;
+
+		/* Nothing can share the kernel with the last message so there is no
+		 * point in paying for the full width. */
+		if (active == 1) {
+			struct mb_lane_s *lane = &lanes[last];
+			engine->single(&states[last], lane->data, lane->nb_blocks);
+			if (!lane->in_tail)
+				engine->single(&states[last], lane->tail, lane->nb_tail);
+			engine->store(&states[last], lane->job->result, digest_bits);
+			lane->job = NULL;
+			continue;
+		}
+
+		/* Idle lanes read a busy lane's data and write to a scratch state
+		 * whose contents are never used. */
+		for (i = 0; i < engine->lanes; i++) {
+			if (lanes[i].job) {
+				state_ptrs[i] = &states[i];
+				data_ptrs[i]  = lanes[i].data;
+			} else {
+				state_ptrs[i] = &spare;
+				data_ptrs[i]  = lanes[last].data;
+			}
+		}
+
+		engine->blocks(state_ptrs, data_ptrs, run);
+
+		for (i = 0; i < engine->lanes; i++) {
+			struct mb_lane_s *lane = &lanes[i];
+			if (!lane->job)
+				continue;
+			lane->data      += run * engine->block_size;
+			lane->nb_blocks -= run;
+			if (lane->nb_blocks)
+				continue;
+			if (!lane->in_tail) {
+				lane->data      = lane->tail;
+				lane->nb_blocks = lane->nb_tail;
+				lane->in_tail   = 1;
+			} else {
+				engine->store(&states[i], lane->job->result, digest_bits);
+				lane->job = NULL;
+			}
+		}
+	}
+}
@@ -0,0 +1,91 @@
+/* Copyright (c) 2014, Nicholas Appleton (http://www.appletonaudio.com)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither Nicholas Appleton nor the names of its contributors may be
+ *       used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL NICHOLAS APPLETON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE. */
+
+#ifndef MULTIBUF_H_
+#define MULTIBUF_H_
+
+#include "hash/hash.h"
+#include "mccl/mccl_fastints.h"
+#include "mccl/mccl_op_uint64.h"
+#include <stddef.h>
+
+/* Multi-buffer hashing.
+ *
+ * A multi-buffer kernel runs the compression function of a Merkle-Damgard
+ * hash (or the absorb step of a sponge) over several independent states at
+ * once, one state per SIMD lane.
+ * mb_run() keeps every lane of such a kernel busy while working through a
+ * list of jobs: a lane which finishes its message is padded, finalised and
+ * immediately given the next job, so messages of different lengths can be
+ * mixed freely. */
+
+/* The largest number of lanes and the largest block size of any engine. */
+#define MB_MAX_LANES      (8)
+#define MB_MAX_BLOCK_SIZE (144)
+
+/* The chaining value of one message. Large enough for a Keccak state. */
+union mb_state_u {
+	mccl_uif32 w32[16];
+	UINT64     w64[25];
+};
+
+/* Compresses nb_blocks consecutive blocks from data[i] into state[i] for
+ * every lane i of the engine. */
+typedef void (*mb_blocks_fn)(union mb_state_u *const *state, const unsigned char *const *data, size_t nb_blocks);
+
+/* Compresses nb_blocks consecutive blocks into a single state. */
+typedef void (*mb_single_fn)(union mb_state_u *state, const unsigned char *data, size_t nb_blocks);
+
+/* Writes the digest held in state to all (digest_bits + 7) / 8 bytes of
+ * result, exactly as the end() function of the hash object does. */
+typedef void (*mb_store_fn)(const union mb_state_u *state, unsigned char *result, unsigned digest_bits);
+
+struct mb_engine_s {
+	const char   *name;
+	unsigned      lanes;
+
+	/* The block size of the hash and the size of the bit count which ends
+	 * the padding of the last block (zero if there is none). */
+	unsigned      block_size;
+	unsigned      length_size;
+	int           length_big_endian;
+
+	/* The padding starts with pad_byte straight after the message and
+	 * pad_final is ORed into the last byte of the last block. */
+	unsigned char pad_byte;
+	unsigned char pad_final;
+
+	mb_blocks_fn  blocks;
+	mb_single_fn  single;
+	mb_store_fn   store;
+};
+
+/* Hashes nb_jobs messages, each starting from the chaining value iv. When
+ * only one message is left in flight it is finished with the engine's
+ * single stream function instead of the full width kernel. */
+void mb_run(const struct mb_engine_s *engine, const union mb_state_u *iv, unsigned digest_bits, struct hash_job_s *jobs, unsigned nb_jobs);
+
+#endif /* MULTIBUF_H_ */
@@ -28,15 +28,27 @@
 #include <string.h>
 #include <assert.h>
 #include "hash/sha1.h"
+#include "sha1_internal.h"
 #include "mccl/mccl_op_uint64.h"
 #include "mccl/mccl_bufcvt.h"
+#include "mccl/mccl_cpuid.h"
+#include "hash/dispatch.h"
+
+#if defined(MCCL_CPUID_X86) && defined(UIF32_SIZE) && (UIF32_SIZE == 4) && defined(UIF32_UNPADDED)
+#define SHA1_SHANI (1)
+#define SHA1_SHANI_BUILT (1)
+#include <immintrin.h>
+#else
+#define SHA1_SHANI_BUILT (0)
+#endif
 
 struct hash_pvt_s
 {
-	mccl_uif32    state[5];
-	UINT64        length;
-	unsigned      buffer_index;
-	unsigned char buffer_data[64];
+	mccl_uif32     state[5];
+	UINT64         length;
+	unsigned       buffer_index;
+	unsigned char  buffer_data[64];
+	sha1_blocks_fn process_blocks;
 };
 
 static
@@ -127,6 +139,111 @@ process_block
 	state[4] += E;
 }
 
+void sha1_process_blocks(mccl_uif32 *state, const unsigned char *data, size_t nb_blocks)
+{
+	while (nb_blocks--) {
+		process_block(state, data);
+		data += 64;
+	}
+}
+
+#ifdef SHA1_SHANI
+
+/* Computes the next four schedule words from the previous sixteen. */
+#define SHANI_SCHEDULE(w0, w1, w2, w3) \
+	(w0) = _mm_sha1msg2_epu32(_mm_xor_si128(_mm_sha1msg1_epu32((w0), (w1)), (w2)), (w3))
+
+/* Performs four rounds. sha1nexte derives E from the value A had four
+ * rounds earlier. */
+#define SHANI_ROUNDS(f, w) \
+	do { \
+		e    = _mm_sha1nexte_epu32(prev, (w)); \
+		prev = abcd; \
+		abcd = _mm_sha1rnds4_epu32(abcd, e, (f)); \
+	} while (0)
+
+__attribute__((target("sha,ssse3,sse4.1")))
+static
+void
+sha1_process_blocks_shani(mccl_uif32 *state, const unsigned char *data, size_t nb_blocks)
+{
+	const __m128i bswap = _mm_set_epi64x(0x0001020304050607ll, 0x08090A0B0C0D0E0Fll);
+	__m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)state), 0x1B);
+	__m128i e0   = _mm_set_epi32((int)state[4], 0, 0, 0);
+
+	while (nb_blocks--) {
+		const __m128i abcd_save = abcd;
+		const __m128i e0_save   = e0;
+		__m128i w0, w1, w2, w3, e, prev;
+
+		w0   = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 0)), bswap);
+		e    = _mm_add_epi32(e0, w0);
+		prev = abcd;
+		abcd = _mm_sha1rnds4_epu32(abcd, e, 0);
+
+		w1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 16)), bswap);
+		SHANI_ROUNDS(0, w1);
+		w2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 32)), bswap);
+		SHANI_ROUNDS(0, w2);
+		w3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 48)), bswap);
+		SHANI_ROUNDS(0, w3);
+
+		SHANI_SCHEDULE(w0, w1, w2, w3); SHANI_ROUNDS(0, w0);
+		SHANI_SCHEDULE(w1, w2, w3, w0); SHANI_ROUNDS(1, w1);
+		SHANI_SCHEDULE(w2, w3, w0, w1); SHANI_ROUNDS(1, w2);
+		SHANI_SCHEDULE(w3, w0, w1, w2); SHANI_ROUNDS(1, w3);
+		SHANI_SCHEDULE(w0, w1, w2, w3); SHANI_ROUNDS(1, w0);
+		SHANI_SCHEDULE(w1, w2, w3, w0); SHANI_ROUNDS(1, w1);
+		SHANI_SCHEDULE(w2, w3, w0, w1); SHANI_ROUNDS(2, w2);
+		SHANI_SCHEDULE(w3, w0, w1, w2); SHANI_ROUNDS(2, w3);
+		SHANI_SCHEDULE(w0, w1, w2, w3); SHANI_ROUNDS(2, w0);
+		SHANI_SCHEDULE(w1, w2, w3, w0); SHANI_ROUNDS(2, w1);
+		SHANI_SCHEDULE(w2, w3, w0, w1); SHANI_ROUNDS(2, w2);
+		SHANI_SCHEDULE(w3, w0, w1, w2); SHANI_ROUNDS(3, w3);
+		SHANI_SCHEDULE(w0, w1, w2, w3); SHANI_ROUNDS(3, w0);
+		SHANI_SCHEDULE(w1, w2, w3, w0); SHANI_ROUNDS(3, w1);
+		SHANI_SCHEDULE(w2, w3, w0, w1); SHANI_ROUNDS(3, w2);
+		SHANI_SCHEDULE(w3, w0, w1, w2); SHANI_ROUNDS(3, w3);
+
+		e0   = _mm_sha1nexte_epu32(prev, e0_save);
+		abcd = _mm_add_epi32(abcd, abcd_save);
+		data += 64;
+	}
+
+	_mm_storeu_si128((__m128i *)state, _mm_shuffle_epi32(abcd, 0x1B));
+	state[4] = (mccl_uif32)_mm_extract_epi32(e0, 3);
+}
+
+#undef SHANI_ROUNDS
+#undef SHANI_SCHEDULE
+
+#endif
+
+static const struct dispatch_kernel_s sha1_kernels[] =
+{	{"shani", MCCL_CPU_SHA | MCCL_CPU_SSSE3 | MCCL_CPU_SSE41, SHA1_SHANI_BUILT}
+,	{"portable", 0, 1}
+};
+
+const struct dispatch_slot_s sha1_dispatch =
+{	"sha1", "SHA-1 compression", sha1_kernels, 2
+};
+
+sha1_blocks_fn sha1_get_shani(void)
+{
+#ifdef SHA1_SHANI
+	if (dispatch_usable(&sha1_kernels[0]))
+		return sha1_process_blocks_shani;
+#endif
+	return NULL;
+}
+
+sha1_blocks_fn sha1_select(void)
+{
+	if (dispatch_select(&sha1_dispatch) == 0)
+		return sha1_get_shani();
+	return sha1_process_blocks;
+}
+
 static
 void
 sha1_process
@@ -151,18 +268,21 @@ sha1_process
 		data += cpy;
 		hash->state->buffer_index += cpy;
 		if (hash->state->buffer_index == 64) {
-			process_block(hash->state->state, hash->state->buffer_data);
+			context->process_blocks(hash->state->state, hash->state->buffer_data, 1);
 			context->length = UINT64_ADD(context->length, incr);
 			assert(UINT64_HIGH(context->length) || UINT64_LOW(context->length));
 			hash->state->buffer_index = 0;
 		}
 	}
-	while (size >= 64) {
-		process_block(hash->state->state, data);
-		context->length = UINT64_ADD(context->length, incr);
-		assert(UINT64_HIGH(context->length) || UINT64_LOW(context->length));
-		data += 64;
-		size -= 64;
+	if (size >= 64) {
+		size_t nb_blocks = size / 64;
+		context->process_blocks(hash->state->state, data, nb_blocks);
+		data += 64 * nb_blocks;
+		size -= 64 * nb_blocks;
+		while (nb_blocks--) {
+			context->length = UINT64_ADD(context->length, incr);
+			assert(UINT64_HIGH(context->length) || UINT64_LOW(context->length));
+		}
 	}
 	if (size) {
 		memcpy
@@ -190,7 +310,7 @@ sha1_end(struct hash_s *hash, unsigned char *result)
 	if (context->buffer_index > 56) {
 		while (context->buffer_index < 64)
 			context->buffer_data[context->buffer_index++] = 0;
-		process_block(context->state, context->buffer_data);
+		context->process_blocks(context->state, context->buffer_data, 1);
 		context->buffer_index = 0;
 	}
 
@@ -203,7 +323,7 @@ sha1_end(struct hash_s *hash, unsigned char *result)
 		context->length = UINT64_SHR(context->length, 8);
 	}
 
-	process_block(context->state, context->buffer_data);
+	context->process_blocks(context->state, context->buffer_data, 1);
 	for (i = 0; i < 20; i++)
 		result[i] = (unsigned char)((context->state[i>>2] >> 8 * (3 - (i & 0x03u))) & 0xFFu);
 }
@@ -222,14 +342,37 @@ sha1_destroy(struct hash_s *hash)
 	free(hash->state);
 }
 
+mccl_uif32 *sha1_stitch_state(struct hash_s *hash, unsigned *buffered)
+{
+	if (hash->process != sha1_process)
+		return NULL;
+	if (buffered != NULL)
+		*buffered = hash->state->buffer_index;
+	return hash->state->state;
+}
+
+void sha1_stitch_advance(struct hash_s *hash, size_t nb_blocks)
+{
+	static const UINT64 incr = UINT64_INIT(0, 8*64);
+	struct hash_pvt_s *context = hash->state;
+
+	assert(hash->process == sha1_process && !context->buffer_index);
+	while (nb_blocks--) {
+		context->length = UINT64_ADD(context->length, incr);
+		assert(UINT64_HIGH(context->length) || UINT64_LOW(context->length));
+	}
+}
+
 int sha1_create(struct hash_s *hash)
 {
 	struct hash_pvt_s *context = malloc(sizeof(*context));
 	if (!context)
 		return -1;
+	context->process_blocks = sha1_select();
 	hash->state = context;
 	hash->begin = sha1_begin;
 	hash->end = sha1_end;
+	hash->digest_jobs = NULL;
 	hash->process = sha1_process;
 	hash->query_digest_size = sha1_query_digest_size;
 	hash->destroy = sha1_destroy;
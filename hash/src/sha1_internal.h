@@ -0,0 +1,57 @@
+/* Copyright (c) 2014, Nicholas Appleton (http://www.appletonaudio.com)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither Nicholas Appleton nor the names of its contributors may be
+ *       used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL NICHOLAS APPLETON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE. */
+
+#ifndef SHA1_INTERNAL_H
+#define SHA1_INTERNAL_H
+
+#include "hash/hash.h"
+#include "mccl/mccl_fastints.h"
+#include <stddef.h>
+
+/* Compresses nb_blocks consecutive 64 byte blocks into the five word state. */
+typedef void (*sha1_blocks_fn)(mccl_uif32 *state, const unsigned char *data, size_t nb_blocks);
+
+/* The portable implementation. */
+void sha1_process_blocks(mccl_uif32 *state, const unsigned char *data, size_t nb_blocks);
+
+/* Returns the implementation which uses the Intel SHA extensions or NULL if
+ * they are not available on this processor or were not compiled in. */
+sha1_blocks_fn sha1_get_shani(void);
+
+/* Returns the fastest implementation available on this processor. */
+sha1_blocks_fn sha1_select(void);
+
+/* Returns the chaining value of a SHA-1 hash object so that blocks can be
+ * compressed into it by a stitched kernel (see hash/stitch.h), or NULL if
+ * the object is not a SHA-1. If buffered is not NULL, it receives the
+ * number of bytes of an incomplete block which the object is holding. */
+mccl_uif32 *sha1_stitch_state(struct hash_s *hash, unsigned *buffered);
+
+/* Counts nb_blocks blocks which were compressed into the chaining value as
+ * processed. The object must not be holding an incomplete block. */
+void sha1_stitch_advance(struct hash_s *hash, size_t nb_blocks);
+
+#endif
@@ -93,6 +93,13 @@ struct hash_pvt_s {
 
 	/* Storage for the arbitrary bit length initial vector for 512 */
 	UINT64        ivt[8];
+
+	/* Compression functions for 256 and 512, chosen for the processor. */
+	sha2_256_blocks_fn process256;
+	sha2_512_blocks_fn process512;
+
+	/* Multi-buffer engine for batches of messages or NULL. */
+	const struct mb_engine_s *mb;
 };
 
 static
@@ -129,23 +136,28 @@ sha2_process(struct hash_s *hash, const unsigned char *data, size_t size)
 		context->buffer_index += cpy;
 		if (context->buffer_index == context->buffer_length) {
 			if (context->buffer_length == 128)
-				sha2_512_process_block(context->hash.h512, context->buffer_data);
+				context->process512(context->hash.h512, context->buffer_data, 1);
 			else
-				sha2_256_process_block(context->hash.h256, context->buffer_data);
+				context->process256(context->hash.h256, context->buffer_data, 1);
 			context->length = UINT64_ADD(context->length, incr);
 			assert(UINT64_HIGH(context->length) || UINT64_LOW(context->length));
 			context->buffer_index = 0;
 		}
 	}
-	while (size >= context->buffer_length) {
+	if (size >= context->buffer_length) {
+		/* Hand every whole block over at once so that the state can stay
+		 * in registers. */
+		size_t nb_blocks = size / context->buffer_length;
 		if (context->buffer_length == 128)
-			sha2_512_process_block(context->hash.h512, data);
+			context->process512(context->hash.h512, data, nb_blocks);
 		else
-			sha2_256_process_block(context->hash.h256, data);
-		context->length = UINT64_ADD(context->length, incr);
-		assert(UINT64_HIGH(context->length) || UINT64_LOW(context->length));
-		data += context->buffer_length;
-		size -= context->buffer_length;
+			context->process256(context->hash.h256, data, nb_blocks);
+		data += context->buffer_length * nb_blocks;
+		size -= context->buffer_length * nb_blocks;
+		while (nb_blocks--) {
+			context->length = UINT64_ADD(context->length, incr);
+			assert(UINT64_HIGH(context->length) || UINT64_LOW(context->length));
+		}
 	}
 	if (size) {
 		memcpy
@@ -164,40 +176,74 @@ sha2_end(struct hash_s *hash, unsigned char *result)
 	unsigned i;
 	struct hash_pvt_s *context = hash->state;
 	const UINT64 incr = UINT64_MAKE(0, 8*context->buffer_index);
+	/* The bit count occupies 128 bits for 512 and 64 bits for 256. */
+	const unsigned length_size = context->buffer_length / 8;
 
 	context->length = UINT64_ADD(context->length, incr);
 	assert(UINT64_HIGH(context->length) || UINT64_LOW(context->length));
 
 	context->buffer_data[context->buffer_index++] = 0x80;
 
-	if (context->buffer_index > context->buffer_length - 16) {
+	if (context->buffer_index > context->buffer_length - length_size) {
 		while (context->buffer_index < context->buffer_length)
 			context->buffer_data[context->buffer_index++] = 0;
 		if (context->buffer_length == 128)
-			sha2_512_process_block(context->hash.h512, context->buffer_data);
+			context->process512(context->hash.h512, context->buffer_data, 1);
 		else
-			sha2_256_process_block(context->hash.h256, context->buffer_data);
+			context->process256(context->hash.h256, context->buffer_data, 1);
 		context->buffer_index = 0;
 	}
 
-	while (context->buffer_index < context->buffer_length - 16)
+	while (context->buffer_index < context->buffer_length - length_size)
 		context->buffer_data[context->buffer_index++] = 0;
 
 	context->buffer_index = context->buffer_length - 1;
-	while (context->buffer_index >= context->buffer_length - 16) {
+	while (context->buffer_index >= context->buffer_length - length_size) {
 		context->buffer_data[context->buffer_index--] = (unsigned char)(UINT64_LOW(context->length) & 0xFFu);
 		context->length = UINT64_SHR(context->length, 8);
 	}
 
 	if (context->buffer_length == 128) {
-		sha2_512_process_block(context->hash.h512, context->buffer_data);
+		context->process512(context->hash.h512, context->buffer_data, 1);
 		for (i = 0; i < context->digest_bits / 8; i++)
 			result[i] = (unsigned char)(UINT64_LOW(UINT64_SHR(context->hash.h512[i/8], 8u * (7u - (i & 0x07u)))) & 0xFFu);
 	} else {
-		sha2_256_process_block(context->hash.h256, context->buffer_data);
+		context->process256(context->hash.h256, context->buffer_data, 1);
 		for (i = 0; i < context->digest_bits / 8; i++)
 			result[i] = (unsigned char)((context->hash.h256[i/4] >> 8u * (3u - (i & 0x03u))) & 0xFFu);
 	}
+
+	/* Only whole bytes of the digest are stored. The byte holding the bits
+	 * of a truncated digest which do not fill one is cleared so that the
+	 * caller never sees whatever was in the buffer. */
+	if (context->digest_bits & 0x07u)
+		result[i] = 0;
+}
+
+static
+void
+sha2_digest_jobs(struct hash_s *hash, struct hash_job_s *jobs, unsigned nb_jobs)
+{
+	struct hash_pvt_s *ctx = hash->state;
+	unsigned i;
+
+	if (ctx->mb != NULL) {
+		union mb_state_u iv;
+		for (i = 0; i < 8; i++) {
+			if (ctx->buffer_length == 128)
+				iv.w64[i] = ctx->initial.h512[i];
+			else
+				iv.w32[i] = ctx->initial.h256[i];
+		}
+		mb_run(ctx->mb, &iv, ctx->digest_bits, jobs, nb_jobs);
+		return;
+	}
+
+	for (i = 0; i < nb_jobs; i++) {
+		sha2_begin(hash);
+		sha2_process(hash, jobs[i].data, jobs[i].size);
+		sha2_end(hash, jobs[i].result);
+	}
 }
 
 static
@@ -214,6 +260,27 @@ sha2_destroy(struct hash_s *hash)
 	free(hash->state);
 }
 
+mccl_uif32 *sha2_stitch_state(struct hash_s *hash, unsigned *buffered)
+{
+	if ((hash->process != sha2_process) || (hash->state->buffer_length != 64))
+		return NULL;
+	if (buffered != NULL)
+		*buffered = hash->state->buffer_index;
+	return hash->state->hash.h256;
+}
+
+void sha2_stitch_advance(struct hash_s *hash, size_t nb_blocks)
+{
+	struct hash_pvt_s *context = hash->state;
+	const UINT64 incr = UINT64_MAKE(0, 8 * 64);
+
+	assert(hash->process == sha2_process && context->buffer_length == 64 && !context->buffer_index);
+	while (nb_blocks--) {
+		context->length = UINT64_ADD(context->length, incr);
+		assert(UINT64_HIGH(context->length) || UINT64_LOW(context->length));
+	}
+}
+
 static void create_gen_string(unsigned char *p, unsigned digest_bits)
 {
 	static const char *prefix_str = "SHA-512/";
@@ -243,9 +310,13 @@ int sha2_create(struct hash_s *hash, unsigned digest_bits, int force_512)
 	hash->begin = sha2_begin;
 	hash->process = sha2_process;
 	hash->end = sha2_end;
+	hash->digest_jobs = sha2_digest_jobs;
 
 	ctx->digest_bits = digest_bits;
 	ctx->buffer_length = 64;
+	ctx->process256 = sha2_256_select();
+	ctx->process512 = sha2_512_select();
+	ctx->mb = sha2_256_mb_select();
 
 	if ((digest_bits == 256) && (!force_512))
 		ctx->initial.h256 = sha256_256_initial;
@@ -253,6 +324,7 @@ int sha2_create(struct hash_s *hash, unsigned digest_bits, int force_512)
 		ctx->initial.h256 = sha256_224_initial;
 	else {
 		ctx->buffer_length = 128;
+		ctx->mb = sha2_512_mb_select();
 		switch (digest_bits) {
 		case 512:
 			ctx->initial.h512 = sha512_512_initial;
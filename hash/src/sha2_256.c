@@ -26,10 +26,28 @@
 
 #include "sha2_256.h"
 #include "mccl/mccl_bufcvt.h"
+#include "mccl/mccl_cpuid.h"
+#include "hash/dispatch.h"
 #include <assert.h>
 #include <stdlib.h>
 
-static const mccl_uif32 sha256_table[64] =
+/* The SHA extension and vector schedule code loads the round constants
+ * straight out of the table so it needs mccl_uif32 to be exactly 32 bits. */
+#if defined(MCCL_CPUID_X86) && defined(UIF32_SIZE) && (UIF32_SIZE == 4) && defined(UIF32_UNPADDED)
+#define SHA2_256_SHANI (1)
+#define SHA2_256_SIMD (1)
+#define SHA2_256_SHANI_BUILT (1)
+#define SHA2_256_SIMD_BUILT (1)
+#else
+#define SHA2_256_SHANI_BUILT (0)
+#define SHA2_256_SIMD_BUILT (0)
+#endif
+
+#ifdef MCCL_CPUID_X86
+#include <immintrin.h>
+#endif
+
+const mccl_uif32 sha256_table[64] =
 {0x428A2F98u, 0x71374491u, 0xB5C0FBCFu, 0xE9B5DBA5u
 ,0x3956C25Bu, 0x59F111F1u, 0x923F82A4u, 0xAB1C5ED5u
 ,0xD807AA98u, 0x12835B01u, 0x243185BEu, 0x550C7DC3u
@@ -96,4 +114,684 @@ void sha2_256_process_block(mccl_uif32 *state, const unsigned char *words)
 	state[7] += h;
 }
 
+void sha2_256_process_blocks(mccl_uif32 *state, const unsigned char *data, size_t nb_blocks)
+{
+	while (nb_blocks--) {
+		sha2_256_process_block(state, data);
+		data += 64;
+	}
+}
+
+#ifdef SHA2_256_SHANI
+
+/* The state is kept in the ABEF/CDGH arrangement which sha256rnds2 expects
+ * for the duration of the call. Each iteration of the round loop performs
+ * four rounds and computes the next four schedule words. */
+__attribute__((target("sha,ssse3,sse4.1")))
+static
+void
+sha2_256_process_blocks_shani(mccl_uif32 *state, const unsigned char *data, size_t nb_blocks)
+{
+	const __m128i bswap = _mm_set_epi64x(0x0C0D0E0F08090A0Bll, 0x0405060700010203ll);
+	__m128i state0, state1, tmp;
+
+	tmp    = _mm_loadu_si128((const __m128i *)(state + 0));
+	state1 = _mm_loadu_si128((const __m128i *)(state + 4));
+	tmp    = _mm_shuffle_epi32(tmp, 0xB1);
+	state1 = _mm_shuffle_epi32(state1, 0x1B);
+	state0 = _mm_alignr_epi8(tmp, state1, 8);
+	state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+
+	while (nb_blocks--) {
+		const __m128i save0 = state0;
+		const __m128i save1 = state1;
+		__m128i w[4];
+		__m128i msg;
+		unsigned i;
+
+		for (i = 0; i < 16; i++) {
+			if (i < 4) {
+				w[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 16 * i)), bswap);
+			} else {
+				msg = _mm_add_epi32(_mm_sha256msg1_epu32(w[i & 3], w[(i + 1) & 3]), _mm_alignr_epi8(w[(i + 3) & 3], w[(i + 2) & 3], 4));
+				w[i & 3] = _mm_sha256msg2_epu32(msg, w[(i + 3) & 3]);
+			}
+			msg    = _mm_add_epi32(w[i & 3], _mm_loadu_si128((const __m128i *)(sha256_table + 4 * i)));
+			state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+			msg    = _mm_shuffle_epi32(msg, 0x0E);
+			state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+		}
+
+		state0 = _mm_add_epi32(state0, save0);
+		state1 = _mm_add_epi32(state1, save1);
+		data  += 64;
+	}
+
+	tmp    = _mm_shuffle_epi32(state0, 0x1B);
+	state1 = _mm_shuffle_epi32(state1, 0xB1);
+	state0 = _mm_blend_epi16(tmp, state1, 0xF0);
+	state1 = _mm_alignr_epi8(state1, tmp, 8);
+	_mm_storeu_si128((__m128i *)(state + 0), state0);
+	_mm_storeu_si128((__m128i *)(state + 4), state1);
+}
+
+#endif
+
+#ifdef SHA2_256_SIMD
+
+/* Single stream kernels which expand the message schedule four words at a
+ * time in vector registers while the rounds run in general purpose ones.
+ * Each vector holds four consecutive schedule words. The first two words of
+ * a new vector depend on the last two of the previous one so sigma1 is done
+ * in two halves on pairs of words spread into 64 bit lanes, where a 64 bit
+ * shift right of a word duplicated into both halves gives its rotation.
+ *
+ * The words are stored with the round constants already added (wk) for the
+ * rounds to pick up. The AVX2 kernel expands two blocks at once, one in each
+ * 128 bit half of the registers, so the rounds of the second block have no
+ * schedule work left to do. */
+
+#define X1_ROUND(a, b, c, d, e, f, g, h, wk) \
+	do { \
+		mccl_uif32 t1_ = h + BSIG1(e) + CH(e, f, g) + (wk); \
+		d += t1_; \
+		h = t1_ + BSIG0(a) + MAJ(a, b, c); \
+	} while (0)
+
+#define X1_ROUNDS4(a, b, c, d, e, f, g, h, wk) \
+	do { \
+		X1_ROUND(a, b, c, d, e, f, g, h, (wk)[0]); \
+		X1_ROUND(h, a, b, c, d, e, f, g, (wk)[1]); \
+		X1_ROUND(g, h, a, b, c, d, e, f, (wk)[2]); \
+		X1_ROUND(f, g, h, a, b, c, d, e, (wk)[3]); \
+	} while (0)
+
+#define X1_SSIG0(x) XOR(XOR(SHR32(x, 7), SHL32(x, 25)), XOR(XOR(SHR32(x, 18), SHL32(x, 14)), SHR32(x, 3)))
+#define X1_SSIG1(x) XOR(XOR(SHR64(x, 17), SHR64(x, 19)), SHR32(x, 10))
+
+/* Replaces x0 (words t-16 to t-13) with words t to t+3. */
+#define X1_SCHEDULE(x0, x1, x2, x3) \
+	do { \
+		VEC w15_ = ALIGNR(x1, x0, 1); \
+		VEC w7_  = ALIGNR(x3, x2, 1); \
+		x0 = ADD(ADD(x0, w7_), X1_SSIG0(w15_)); \
+		x0 = ADD(x0, SHUFB(X1_SSIG1(SHUF32(x3, 0xFA)), shuf_00ba)); \
+		x0 = ADD(x0, SHUFB(X1_SSIG1(SHUF32(x0, 0x50)), shuf_dc00)); \
+	} while (0)
+
+#define VEC          __m128i
+#define ADD(x, y)    _mm_add_epi32(x, y)
+#define XOR(x, y)    _mm_xor_si128(x, y)
+#define SHR32(x, c)  _mm_srli_epi32(x, c)
+#define SHL32(x, c)  _mm_slli_epi32(x, c)
+#define SHR64(x, c)  _mm_srli_epi64(x, c)
+#define ALIGNR(x, y, c) _mm_alignr_epi8(x, y, 4 * (c))
+#define SHUF32(x, c) _mm_shuffle_epi32(x, c)
+#define SHUFB(x, m)  _mm_shuffle_epi8(x, m)
+
+/* Four rounds starting at round t while the words for round t + 16 onwards
+ * are computed into x0. */
+#define X4_SCHEDULE_ROUNDS4(x0, x1, x2, x3, a, b, c, d, e, f, g, h, t) \
+	do { \
+		X1_SCHEDULE(x0, x1, x2, x3); \
+		X1_ROUNDS4(a, b, c, d, e, f, g, h, wk + ((t) & 15)); \
+		_mm_storeu_si128((__m128i *)(wk + ((t) & 15)), ADD(x0, _mm_loadu_si128((const __m128i *)(sha256_table + (t) + 16)))); \
+	} while (0)
+
+/* The SSSE3 and AVX kernels are the same code; the latter gets the three
+ * operand encodings which save most of the register copies. */
+#define SHA2_256_X4_KERNEL(name) \
+static \
+void \
+name(mccl_uif32 *state, const unsigned char *data, size_t nb_blocks) \
+{ \
+	const __m128i bswap     = _mm_set_epi64x(0x0C0D0E0F08090A0Bll, 0x0405060700010203ll); \
+	const __m128i shuf_00ba = _mm_set_epi64x(-1ll, 0x0B0A090803020100ll); \
+	const __m128i shuf_dc00 = _mm_set_epi64x(0x0B0A090803020100ll, -1ll); \
+	mccl_uif32 a = state[0], b = state[1], c = state[2], d = state[3]; \
+	mccl_uif32 e = state[4], f = state[5], g = state[6], h = state[7]; \
+	mccl_uif32 wk[16]; \
+	while (nb_blocks--) { \
+		__m128i x0 = SHUFB(_mm_loadu_si128((const __m128i *)(data + 0)), bswap); \
+		__m128i x1 = SHUFB(_mm_loadu_si128((const __m128i *)(data + 16)), bswap); \
+		__m128i x2 = SHUFB(_mm_loadu_si128((const __m128i *)(data + 32)), bswap); \
+		__m128i x3 = SHUFB(_mm_loadu_si128((const __m128i *)(data + 48)), bswap); \
+		unsigned t; \
+		_mm_storeu_si128((__m128i *)(wk + 0), ADD(x0, _mm_loadu_si128((const __m128i *)(sha256_table + 0)))); \
+		_mm_storeu_si128((__m128i *)(wk + 4), ADD(x1, _mm_loadu_si128((const __m128i *)(sha256_table + 4)))); \
+		_mm_storeu_si128((__m128i *)(wk + 8), ADD(x2, _mm_loadu_si128((const __m128i *)(sha256_table + 8)))); \
+		_mm_storeu_si128((__m128i *)(wk + 12), ADD(x3, _mm_loadu_si128((const __m128i *)(sha256_table + 12)))); \
+		for (t = 0; t < 48; t += 16) { \
+			X4_SCHEDULE_ROUNDS4(x0, x1, x2, x3, a, b, c, d, e, f, g, h, t + 0); \
+			X4_SCHEDULE_ROUNDS4(x1, x2, x3, x0, e, f, g, h, a, b, c, d, t + 4); \
+			X4_SCHEDULE_ROUNDS4(x2, x3, x0, x1, a, b, c, d, e, f, g, h, t + 8); \
+			X4_SCHEDULE_ROUNDS4(x3, x0, x1, x2, e, f, g, h, a, b, c, d, t + 12); \
+		} \
+		X1_ROUNDS4(a, b, c, d, e, f, g, h, wk + 0); \
+		X1_ROUNDS4(e, f, g, h, a, b, c, d, wk + 4); \
+		X1_ROUNDS4(a, b, c, d, e, f, g, h, wk + 8); \
+		X1_ROUNDS4(e, f, g, h, a, b, c, d, wk + 12); \
+		a = state[0] += a; b = state[1] += b; c = state[2] += c; d = state[3] += d; \
+		e = state[4] += e; f = state[5] += f; g = state[6] += g; h = state[7] += h; \
+		data += 64; \
+	} \
+}
+
+__attribute__((target("ssse3")))
+SHA2_256_X4_KERNEL(sha2_256_process_blocks_ssse3)
+__attribute__((target("avx")))
+SHA2_256_X4_KERNEL(sha2_256_process_blocks_avx)
+
+#undef X4_SCHEDULE_ROUNDS4
+#undef SHA2_256_X4_KERNEL
+#undef VEC
+#undef ADD
+#undef XOR
+#undef SHR32
+#undef SHL32
+#undef SHR64
+#undef ALIGNR
+#undef SHUF32
+#undef SHUFB
+
+#define VEC          __m256i
+#define ADD(x, y)    _mm256_add_epi32(x, y)
+#define XOR(x, y)    _mm256_xor_si256(x, y)
+#define SHR32(x, c)  _mm256_srli_epi32(x, c)
+#define SHL32(x, c)  _mm256_slli_epi32(x, c)
+#define SHR64(x, c)  _mm256_srli_epi64(x, c)
+#define ALIGNR(x, y, c) _mm256_alignr_epi8(x, y, 4 * (c))
+#define SHUF32(x, c) _mm256_shuffle_epi32(x, c)
+#define SHUFB(x, m)  _mm256_shuffle_epi8(x, m)
+
+/* Computes words t + 16 to t + 19 of both blocks into x0. The words of both
+ * blocks for a group of four rounds are stored next to each other. */
+#define X8_SCHEDULE_ROUNDS4(x0, x1, x2, x3, a, b, c, d, e, f, g, h, t) \
+	do { \
+		X1_SCHEDULE(x0, x1, x2, x3); \
+		X1_ROUNDS4(a, b, c, d, e, f, g, h, wk + 2 * (t)); \
+		_mm256_storeu_si256((__m256i *)(wk + 2 * (t) + 32), ADD(x0, _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(sha256_table + (t) + 16))))); \
+	} while (0)
+
+__attribute__((target("avx2,bmi2")))
+static
+void
+sha2_256_process_blocks_avx2(mccl_uif32 *state, const unsigned char *data, size_t nb_blocks)
+{
+	const __m256i bswap = _mm256_set_epi64x
+		(0x0C0D0E0F08090A0Bll, 0x0405060700010203ll
+		,0x0C0D0E0F08090A0Bll, 0x0405060700010203ll
+		);
+	const __m256i shuf_00ba = _mm256_set_epi64x(-1ll, 0x0B0A090803020100ll, -1ll, 0x0B0A090803020100ll);
+	const __m256i shuf_dc00 = _mm256_set_epi64x(0x0B0A090803020100ll, -1ll, 0x0B0A090803020100ll, -1ll);
+	mccl_uif32 a = state[0], b = state[1], c = state[2], d = state[3];
+	mccl_uif32 e = state[4], f = state[5], g = state[6], h = state[7];
+	mccl_uif32 wk[128];
+
+	while (nb_blocks) {
+		/* A lone last block goes through both halves and the second copy
+		 * of its words is not used. */
+		const unsigned char *next = (nb_blocks > 1) ? data + 64 : data;
+		__m256i x[4];
+		unsigned t;
+
+		for (t = 0; t < 4; t++) {
+			x[t] = _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(data + 16 * t)));
+			x[t] = _mm256_inserti128_si256(x[t], _mm_loadu_si128((const __m128i *)(next + 16 * t)), 1);
+			x[t] = SHUFB(x[t], bswap);
+			_mm256_storeu_si256((__m256i *)(wk + 8 * t), ADD(x[t], _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(sha256_table + 4 * t)))));
+		}
+
+		for (t = 0; t < 48; t += 16) {
+			X8_SCHEDULE_ROUNDS4(x[0], x[1], x[2], x[3], a, b, c, d, e, f, g, h, t + 0);
+			X8_SCHEDULE_ROUNDS4(x[1], x[2], x[3], x[0], e, f, g, h, a, b, c, d, t + 4);
+			X8_SCHEDULE_ROUNDS4(x[2], x[3], x[0], x[1], a, b, c, d, e, f, g, h, t + 8);
+			X8_SCHEDULE_ROUNDS4(x[3], x[0], x[1], x[2], e, f, g, h, a, b, c, d, t + 12);
+		}
+		for (; t < 64; t += 8) {
+			X1_ROUNDS4(a, b, c, d, e, f, g, h, wk + 2 * t);
+			X1_ROUNDS4(e, f, g, h, a, b, c, d, wk + 2 * t + 8);
+		}
+		a = state[0] += a; b = state[1] += b; c = state[2] += c; d = state[3] += d;
+		e = state[4] += e; f = state[5] += f; g = state[6] += g; h = state[7] += h;
+		data += 64;
+		nb_blocks--;
+
+		if (nb_blocks) {
+			for (t = 0; t < 64; t += 8) {
+				X1_ROUNDS4(a, b, c, d, e, f, g, h, wk + 2 * t + 4);
+				X1_ROUNDS4(e, f, g, h, a, b, c, d, wk + 2 * t + 12);
+			}
+			a = state[0] += a; b = state[1] += b; c = state[2] += c; d = state[3] += d;
+			e = state[4] += e; f = state[5] += f; g = state[6] += g; h = state[7] += h;
+			data += 64;
+			nb_blocks--;
+		}
+	}
+}
+
+#undef X8_SCHEDULE_ROUNDS4
+#undef VEC
+#undef ADD
+#undef XOR
+#undef SHR32
+#undef SHL32
+#undef SHR64
+#undef ALIGNR
+#undef SHUF32
+#undef SHUFB
+#undef X1_SCHEDULE
+#undef X1_SSIG1
+#undef X1_SSIG0
+#undef X1_ROUNDS4
+#undef X1_ROUND
+
+#endif
+
+enum {
+	SHA2_256_SHANI_KERNEL,
+	SHA2_256_AVX2_KERNEL,
+	SHA2_256_AVX_KERNEL,
+	SHA2_256_SSSE3_KERNEL,
+	SHA2_256_PORTABLE_KERNEL
+};
+
+static const struct dispatch_kernel_s sha2_256_kernels[] =
+{	{"shani", MCCL_CPU_SHA | MCCL_CPU_SSSE3 | MCCL_CPU_SSE41, SHA2_256_SHANI_BUILT}
+,	{"avx2", MCCL_CPU_AVX2 | MCCL_CPU_BMI2, SHA2_256_SIMD_BUILT}
+,	{"avx", MCCL_CPU_AVX, SHA2_256_SIMD_BUILT}
+,	{"ssse3", MCCL_CPU_SSSE3, SHA2_256_SIMD_BUILT}
+,	{"portable", 0, 1}
+};
+
+const struct dispatch_slot_s sha2_256_dispatch =
+{	"sha2.256", "SHA-224/256 compression", sha2_256_kernels, 5
+};
+
+sha2_256_blocks_fn sha2_256_get_shani(void)
+{
+#ifdef SHA2_256_SHANI
+	if (dispatch_usable(&sha2_256_kernels[SHA2_256_SHANI_KERNEL]))
+		return sha2_256_process_blocks_shani;
+#endif
+	return NULL;
+}
+
+sha2_256_blocks_fn sha2_256_get_avx2(void)
+{
+#ifdef SHA2_256_SIMD
+	if (dispatch_usable(&sha2_256_kernels[SHA2_256_AVX2_KERNEL]))
+		return sha2_256_process_blocks_avx2;
+#endif
+	return NULL;
+}
+
+sha2_256_blocks_fn sha2_256_get_avx(void)
+{
+#ifdef SHA2_256_SIMD
+	if (dispatch_usable(&sha2_256_kernels[SHA2_256_AVX_KERNEL]))
+		return sha2_256_process_blocks_avx;
+#endif
+	return NULL;
+}
+
+sha2_256_blocks_fn sha2_256_get_ssse3(void)
+{
+#ifdef SHA2_256_SIMD
+	if (dispatch_usable(&sha2_256_kernels[SHA2_256_SSSE3_KERNEL]))
+		return sha2_256_process_blocks_ssse3;
+#endif
+	return NULL;
+}
+
+sha2_256_blocks_fn sha2_256_select(void)
+{
+	switch (dispatch_select(&sha2_256_dispatch)) {
+	case SHA2_256_SHANI_KERNEL:
+		return sha2_256_get_shani();
+	case SHA2_256_AVX2_KERNEL:
+		return sha2_256_get_avx2();
+	case SHA2_256_AVX_KERNEL:
+		return sha2_256_get_avx();
+	case SHA2_256_SSSE3_KERNEL:
+		return sha2_256_get_ssse3();
+	}
+	return sha2_256_process_blocks;
+}
+
+/* Multi-buffer kernels.
+ *
+ * These run the portable algorithm with each 32-bit vector element holding
+ * the same word of a different message. Each round is the same sequence of
+ * instructions for every lane so the only extra work is transposing the
+ * message words on the way in. */
+
+static
+void
+sha2_256_mb_portable_blocks(union mb_state_u *const *state, const unsigned char *const *data, size_t nb_blocks)
+{
+	sha2_256_process_blocks(state[0]->w32, data[0], nb_blocks);
+}
+
+static
+void
+sha2_256_mb_single(union mb_state_u *state, const unsigned char *data, size_t nb_blocks)
+{
+	sha2_256_select()(state->w32, data, nb_blocks);
+}
+
+static
+void
+sha2_256_mb_store(const union mb_state_u *state, unsigned char *result, unsigned digest_bits)
+{
+	unsigned i;
+	for (i = 0; i < digest_bits / 8; i++)
+		result[i] = (unsigned char)((state->w32[i/4] >> 8u * (3u - (i & 0x03u))) & 0xFFu);
+	if (digest_bits & 0x07u)
+		result[i] = 0;
+}
+
+#ifdef MCCL_CPUID_X86
+
+/* One round of the compression function. The caller rotates the names of
+ * the working variables instead of moving them. */
+#define MB_ROUND(a, b, c, d, e, f, g, h, k, w) \
+	do { \
+		VEC t1_ = ADD(ADD(ADD(h, XOR(XOR(ROR(e, 6), ROR(e, 11)), ROR(e, 25))), \
+		                  XOR(AND(e, f), ANDNOT(e, g))), \
+		              ADD(SET1((int)(k)), w)); \
+		VEC t2_ = ADD(XOR(XOR(ROR(a, 2), ROR(a, 13)), ROR(a, 22)), \
+		              OR(AND(a, b), AND(c, OR(a, b)))); \
+		d = ADD(d, t1_); \
+		h = ADD(t1_, t2_); \
+	} while (0)
+
+/* Computes schedule word i (i >= 16) in place in the 16 word window. */
+#define MB_SCHEDULE(w, i) \
+	(w[(i) & 15] = ADD(ADD(w[(i) & 15], w[((i) - 7) & 15]), \
+	                   ADD(XOR(XOR(ROR(w[((i) - 15) & 15], 7), ROR(w[((i) - 15) & 15], 18)), SHR(w[((i) - 15) & 15], 3)), \
+	                       XOR(XOR(ROR(w[((i) - 2) & 15], 17), ROR(w[((i) - 2) & 15], 19)), SHR(w[((i) - 2) & 15], 10)))))
+
+/* Eight rounds starting at round i. */
+#define MB_ROUNDS8(i) \
+	do { \
+		if ((i) >= 16) { \
+			unsigned j_; \
+			for (j_ = (i); j_ < (i) + 8; j_++) \
+				MB_SCHEDULE(w, j_); \
+		} \
+		MB_ROUND(a, b, c, d, e, f, g, h, sha256_table[(i) + 0], w[((i) + 0) & 15]); \
+		MB_ROUND(h, a, b, c, d, e, f, g, sha256_table[(i) + 1], w[((i) + 1) & 15]); \
+		MB_ROUND(g, h, a, b, c, d, e, f, sha256_table[(i) + 2], w[((i) + 2) & 15]); \
+		MB_ROUND(f, g, h, a, b, c, d, e, sha256_table[(i) + 3], w[((i) + 3) & 15]); \
+		MB_ROUND(e, f, g, h, a, b, c, d, sha256_table[(i) + 4], w[((i) + 4) & 15]); \
+		MB_ROUND(d, e, f, g, h, a, b, c, sha256_table[(i) + 5], w[((i) + 5) & 15]); \
+		MB_ROUND(c, d, e, f, g, h, a, b, sha256_table[(i) + 6], w[((i) + 6) & 15]); \
+		MB_ROUND(b, c, d, e, f, g, h, a, sha256_table[(i) + 7], w[((i) + 7) & 15]); \
+	} while (0)
+
+#define VEC          __m256i
+#define ADD(x, y)    _mm256_add_epi32(x, y)
+#define XOR(x, y)    _mm256_xor_si256(x, y)
+#define AND(x, y)    _mm256_and_si256(x, y)
+#define OR(x, y)     _mm256_or_si256(x, y)
+#define ANDNOT(x, y) _mm256_andnot_si256(x, y)
+#define SHR(x, c)    _mm256_srli_epi32(x, c)
+#define ROR(x, c)    _mm256_or_si256(_mm256_srli_epi32(x, c), _mm256_slli_epi32(x, 32 - (c)))
+#define SET1(x)      _mm256_set1_epi32(x)
+
+/* Loads eight words from each of the eight lanes and transposes them so that
+ * w[i] holds word i of every lane. */
+__attribute__((target("avx2")))
+static
+void
+sha2_256_x8_load(__m256i *w, const unsigned char *const *p, unsigned offset)
+{
+	const __m256i bswap = _mm256_set_epi64x
+		(0x0C0D0E0F08090A0Bll, 0x0405060700010203ll
+		,0x0C0D0E0F08090A0Bll, 0x0405060700010203ll
+		);
+	__m256i r[8], t[8], u[8];
+	unsigned i;
+
+	for (i = 0; i < 8; i++)
+		r[i] = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)(p[i] + offset)), bswap);
+
+	for (i = 0; i < 8; i += 2) {
+		t[i]     = _mm256_unpacklo_epi32(r[i], r[i + 1]);
+		t[i + 1] = _mm256_unpackhi_epi32(r[i], r[i + 1]);
+	}
+	for (i = 0; i < 8; i += 4) {
+		u[i]     = _mm256_unpacklo_epi64(t[i], t[i + 2]);
+		u[i + 1] = _mm256_unpackhi_epi64(t[i], t[i + 2]);
+		u[i + 2] = _mm256_unpacklo_epi64(t[i + 1], t[i + 3]);
+		u[i + 3] = _mm256_unpackhi_epi64(t[i + 1], t[i + 3]);
+	}
+	for (i = 0; i < 4; i++) {
+		w[i]     = _mm256_permute2x128_si256(u[i], u[i + 4], 0x20);
+		w[i + 4] = _mm256_permute2x128_si256(u[i], u[i + 4], 0x31);
+	}
+}
+
+__attribute__((target("avx2")))
+static
+void
+sha2_256_x8_avx2(union mb_state_u *const *state, const unsigned char *const *data, size_t nb_blocks)
+{
+	const unsigned char *p[8];
+	__m256i s[8];
+	unsigned i;
+
+	for (i = 0; i < 8; i++) {
+		p[i] = data[i];
+		s[i] = _mm256_set_epi32
+			((int)state[7]->w32[i], (int)state[6]->w32[i], (int)state[5]->w32[i], (int)state[4]->w32[i]
+			,(int)state[3]->w32[i], (int)state[2]->w32[i], (int)state[1]->w32[i], (int)state[0]->w32[i]
+			);
+	}
+
+	while (nb_blocks--) {
+		__m256i a = s[0], b = s[1], c = s[2], d = s[3];
+		__m256i e = s[4], f = s[5], g = s[6], h = s[7];
+		__m256i w[16];
+
+		sha2_256_x8_load(w, p, 0);
+		sha2_256_x8_load(w + 8, p, 32);
+
+		MB_ROUNDS8(0);  MB_ROUNDS8(8);  MB_ROUNDS8(16); MB_ROUNDS8(24);
+		MB_ROUNDS8(32); MB_ROUNDS8(40); MB_ROUNDS8(48); MB_ROUNDS8(56);
+
+		s[0] = ADD(s[0], a); s[1] = ADD(s[1], b);
+		s[2] = ADD(s[2], c); s[3] = ADD(s[3], d);
+		s[4] = ADD(s[4], e); s[5] = ADD(s[5], f);
+		s[6] = ADD(s[6], g); s[7] = ADD(s[7], h);
+
+		for (i = 0; i < 8; i++)
+			p[i] += 64;
+	}
+
+	for (i = 0; i < 8; i++) {
+		unsigned lanes[8];
+		unsigned j;
+		_mm256_storeu_si256((__m256i *)lanes, s[i]);
+		for (j = 0; j < 8; j++)
+			state[j]->w32[i] = lanes[j] & 0xFFFFFFFFu;
+	}
+}
+
+#undef VEC
+#undef ADD
+#undef XOR
+#undef AND
+#undef OR
+#undef ANDNOT
+#undef SHR
+#undef ROR
+#undef SET1
 
+#define VEC          __m128i
+#define ADD(x, y)    _mm_add_epi32(x, y)
+#define XOR(x, y)    _mm_xor_si128(x, y)
+#define AND(x, y)    _mm_and_si128(x, y)
+#define OR(x, y)     _mm_or_si128(x, y)
+#define ANDNOT(x, y) _mm_andnot_si128(x, y)
+#define SHR(x, c)    _mm_srli_epi32(x, c)
+#define ROR(x, c)    _mm_or_si128(_mm_srli_epi32(x, c), _mm_slli_epi32(x, 32 - (c)))
+#define SET1(x)      _mm_set1_epi32(x)
+
+/* Loads four words from each of the four lanes and transposes them so that
+ * w[i] holds word i of every lane. */
+__attribute__((target("ssse3,sse4.1")))
+static
+void
+sha2_256_x4_load(__m128i *w, const unsigned char *const *p, unsigned offset)
+{
+	const __m128i bswap = _mm_set_epi64x(0x0C0D0E0F08090A0Bll, 0x0405060700010203ll);
+	__m128i r[4], t[4];
+	unsigned i;
+
+	for (i = 0; i < 4; i++)
+		r[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(p[i] + offset)), bswap);
+
+	t[0] = _mm_unpacklo_epi32(r[0], r[1]);
+	t[1] = _mm_unpacklo_epi32(r[2], r[3]);
+	t[2] = _mm_unpackhi_epi32(r[0], r[1]);
+	t[3] = _mm_unpackhi_epi32(r[2], r[3]);
+	w[0] = _mm_unpacklo_epi64(t[0], t[1]);
+	w[1] = _mm_unpackhi_epi64(t[0], t[1]);
+	w[2] = _mm_unpacklo_epi64(t[2], t[3]);
+	w[3] = _mm_unpackhi_epi64(t[2], t[3]);
+}
+
+__attribute__((target("ssse3,sse4.1")))
+static
+void
+sha2_256_x4_sse41(union mb_state_u *const *state, const unsigned char *const *data, size_t nb_blocks)
+{
+	const unsigned char *p[4];
+	__m128i s[8];
+	unsigned i;
+
+	for (i = 0; i < 4; i++)
+		p[i] = data[i];
+	for (i = 0; i < 8; i++)
+		s[i] = _mm_set_epi32
+			((int)state[3]->w32[i], (int)state[2]->w32[i], (int)state[1]->w32[i], (int)state[0]->w32[i]);
+
+	while (nb_blocks--) {
+		__m128i a = s[0], b = s[1], c = s[2], d = s[3];
+		__m128i e = s[4], f = s[5], g = s[6], h = s[7];
+		__m128i w[16];
+
+		for (i = 0; i < 4; i++)
+			sha2_256_x4_load(w + 4 * i, p, 16 * i);
+
+		MB_ROUNDS8(0);  MB_ROUNDS8(8);  MB_ROUNDS8(16); MB_ROUNDS8(24);
+		MB_ROUNDS8(32); MB_ROUNDS8(40); MB_ROUNDS8(48); MB_ROUNDS8(56);
+
+		s[0] = ADD(s[0], a); s[1] = ADD(s[1], b);
+		s[2] = ADD(s[2], c); s[3] = ADD(s[3], d);
+		s[4] = ADD(s[4], e); s[5] = ADD(s[5], f);
+		s[6] = ADD(s[6], g); s[7] = ADD(s[7], h);
+
+		for (i = 0; i < 4; i++)
+			p[i] += 64;
+	}
+
+	for (i = 0; i < 8; i++) {
+		state[0]->w32[i] = (unsigned)_mm_extract_epi32(s[i], 0) & 0xFFFFFFFFu;
+		state[1]->w32[i] = (unsigned)_mm_extract_epi32(s[i], 1) & 0xFFFFFFFFu;
+		state[2]->w32[i] = (unsigned)_mm_extract_epi32(s[i], 2) & 0xFFFFFFFFu;
+		state[3]->w32[i] = (unsigned)_mm_extract_epi32(s[i], 3) & 0xFFFFFFFFu;
+	}
+}
+
+#undef VEC
+#undef ADD
+#undef XOR
+#undef AND
+#undef OR
+#undef ANDNOT
+#undef SHR
+#undef ROR
+#undef SET1
+#undef MB_ROUNDS8
+#undef MB_SCHEDULE
+#undef MB_ROUND
+
+static const struct mb_engine_s sha2_256_mb_avx2 =
+{	"avx2-x8", 8, 64, 8, 1, 0x80, 0x00
+,	sha2_256_x8_avx2, sha2_256_mb_single, sha2_256_mb_store
+};
+
+static const struct mb_engine_s sha2_256_mb_sse41 =
+{	"sse4.1-x4", 4, 64, 8, 1, 0x80, 0x00
+,	sha2_256_x4_sse41, sha2_256_mb_single, sha2_256_mb_store
+};
+
+#endif
+
+static const struct mb_engine_s sha2_256_mb_portable =
+{	"portable", 1, 64, 8, 1, 0x80, 0x00
+,	sha2_256_mb_portable_blocks, sha2_256_mb_single, sha2_256_mb_store
+};
+
+/* A single stream on the SHA extensions is faster than any number of streams
+ * on the general purpose vector units, so the first choice is to hash the
+ * messages one after the other ("shani"). "serial" does the same with
+ * whichever compression function was chosen. */
+enum {
+	SHA2_256_MB_SHANI,
+	SHA2_256_MB_AVX2,
+	SHA2_256_MB_SSE41,
+	SHA2_256_MB_SERIAL,
+	SHA2_256_MB_PORTABLE
+};
+
+static const struct dispatch_kernel_s sha2_256_mb_kernels[] =
+{	{"shani", MCCL_CPU_SHA | MCCL_CPU_SSSE3 | MCCL_CPU_SSE41, SHA2_256_SHANI_BUILT}
+,	{"avx2", MCCL_CPU_AVX2, DISPATCH_X86}
+,	{"sse41", MCCL_CPU_SSSE3 | MCCL_CPU_SSE41, DISPATCH_X86}
+,	{"serial", 0, 1}
+,	{"portable", 0, 1}
+};
+
+const struct dispatch_slot_s sha2_256_mb_dispatch =
+{	"sha2.256.mb", "SHA-224/256 batches of messages", sha2_256_mb_kernels, 5
+};
+
+const struct mb_engine_s *sha2_256_mb_get_avx2(void)
+{
+#ifdef MCCL_CPUID_X86
+	if (dispatch_usable(&sha2_256_mb_kernels[SHA2_256_MB_AVX2]))
+		return &sha2_256_mb_avx2;
+#endif
+	return NULL;
+}
+
+const struct mb_engine_s *sha2_256_mb_get_sse41(void)
+{
+#ifdef MCCL_CPUID_X86
+	if (dispatch_usable(&sha2_256_mb_kernels[SHA2_256_MB_SSE41]))
+		return &sha2_256_mb_sse41;
+#endif
+	return NULL;
+}
+
+const struct mb_engine_s *sha2_256_mb_get_portable(void)
+{
+	return &sha2_256_mb_portable;
+}
+
+const struct mb_engine_s *sha2_256_mb_select(void)
+{
+	switch (dispatch_select(&sha2_256_mb_dispatch)) {
+	case SHA2_256_MB_AVX2:
+		return sha2_256_mb_get_avx2();
+	case SHA2_256_MB_SSE41:
+		return sha2_256_mb_get_sse41();
+	case SHA2_256_MB_PORTABLE:
+		return sha2_256_mb_get_portable();
+	}
+	return NULL;
+}
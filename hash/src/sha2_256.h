@@ -27,8 +27,57 @@
 #ifndef SHA2_256_H_
 #define SHA2_256_H_
 
+#include "hash/hash.h"
 #include "mccl/mccl_fastints.h"
+#include "multibuf.h"
+#include <stddef.h>
+
+/* The round constants. */
+extern const mccl_uif32 sha256_table[64];
+
+/* Compresses nb_blocks consecutive 64 byte blocks into the state. */
+typedef void (*sha2_256_blocks_fn)(mccl_uif32 *state, const unsigned char *data, size_t nb_blocks);
 
 void sha2_256_process_block(mccl_uif32 *state, const unsigned char *words);
 
+/* The portable implementation. */
+void sha2_256_process_blocks(mccl_uif32 *state, const unsigned char *data, size_t nb_blocks);
+
+/* Returns the implementation which uses the Intel SHA extensions or NULL if
+ * they are not available on this processor or were not compiled in. */
+sha2_256_blocks_fn sha2_256_get_shani(void);
+
+/* Implementations which expand the message schedule in AVX2 (two blocks at
+ * a time, with BMI2 rotates in the rounds), AVX or SSSE3 registers. Each
+ * returns NULL if it cannot be used on this processor. */
+sha2_256_blocks_fn sha2_256_get_avx2(void);
+sha2_256_blocks_fn sha2_256_get_avx(void);
+sha2_256_blocks_fn sha2_256_get_ssse3(void);
+
+/* Returns the fastest implementation available on this processor. */
+sha2_256_blocks_fn sha2_256_select(void);
+
+/* Multi-buffer engines which hash eight messages in AVX2 registers or four
+ * in SSE4.1 registers. Each returns NULL if the processor does not support
+ * it or it was not compiled in. The portable engine hashes one message at a
+ * time and always exists. */
+const struct mb_engine_s *sha2_256_mb_get_avx2(void);
+const struct mb_engine_s *sha2_256_mb_get_sse41(void);
+const struct mb_engine_s *sha2_256_mb_get_portable(void);
+
+/* Returns the multi-buffer engine to use for batches of messages or NULL if
+ * hashing them one after the other is faster on this processor. */
+const struct mb_engine_s *sha2_256_mb_select(void);
+
+/* Returns the chaining value of a SHA-2 hash object so that blocks can be
+ * compressed into it by a stitched kernel (see hash/stitch.h), or NULL if
+ * the object is not a SHA-2 which uses the 256 bit compression function
+ * (SHA-224 and SHA-256). If buffered is not NULL, it receives the number of
+ * bytes of an incomplete block which the object is holding. */
+mccl_uif32 *sha2_stitch_state(struct hash_s *hash, unsigned *buffered);
+
+/* Counts nb_blocks blocks which were compressed into the chaining value as
+ * processed. The object must not be holding an incomplete block. */
+void sha2_stitch_advance(struct hash_s *hash, size_t nb_blocks);
+
 #endif /* SHA2_256_H_ */
@@ -29,6 +29,12 @@
 #include <stdlib.h>
 #include <assert.h>
 #include "mccl/mccl_bufcvt.h"
+#include "mccl/mccl_cpuid.h"
+#include "hash/dispatch.h"
+
+#ifdef MCCL_CPUID_X86
+#include <immintrin.h>
+#endif
 
 static const UINT64 sha512_table[80] =
 {	UINT64_INIT(0x428A2F98u, 0xD728AE22u), UINT64_INIT(0x71374491u, 0x23EF65CDu)
@@ -130,4 +136,455 @@ void sha2_512_process_block(UINT64 *state, const unsigned char *words)
 		state[i] = UINT64_ADD(h[i], state[i]);
 }
 
+void sha2_512_process_blocks(UINT64 *state, const unsigned char *data, size_t nb_blocks)
+{
+	while (nb_blocks--) {
+		sha2_512_process_block(state, data);
+		data += 128;
+	}
+}
+
+/* Kernels which work on the native 64 bit type rather than through the
+ * UINT64 operators. The schedule is kept in a rolling window of sixteen
+ * words and the rounds are unrolled so that the working variables are
+ * renamed rather than moved. */
+#if defined(UIF64_MAX) && defined(UIF64_SIZE) && (UIF64_SIZE == 8) && defined(UIF64_UNPADDED) && !FORCE_32BIT && !TYPE_DEBUG
+#define SHA2_512_NATIVE (1)
+#define SHA2_512_NATIVE_BUILT (1)
+#else
+#define SHA2_512_NATIVE_BUILT (0)
+#endif
+
+#if defined(SHA2_512_NATIVE) && defined(MCCL_CPUID_X86)
+#define SHA2_512_AVX2 (1)
+#define SHA2_512_AVX2_BUILT (1)
+#else
+#define SHA2_512_AVX2_BUILT (0)
+#endif
+
+#ifdef SHA2_512_NATIVE
+
+#define X1_ROR(x, c)       (((x) >> (c)) | ((x) << (64 - (c))))
+#define X1_BSIG0(x)        (X1_ROR(x, 28) ^ X1_ROR(x, 34) ^ X1_ROR(x, 39))
+#define X1_BSIG1(x)        (X1_ROR(x, 14) ^ X1_ROR(x, 18) ^ X1_ROR(x, 41))
+#define X1_SSIG0(x)        (X1_ROR(x, 1) ^ X1_ROR(x, 8) ^ ((x) >> 7))
+#define X1_SSIG1(x)        (X1_ROR(x, 19) ^ X1_ROR(x, 61) ^ ((x) >> 6))
+#define X1_CH(x, y, z)     ((z) ^ ((x) & ((y) ^ (z))))
+#define X1_MAJ(x, y, z)    (((x) & (y)) | ((z) & ((x) | (y))))
+
+#define X1_ROUND(a, b, c, d, e, f, g, h, wk) \
+	do { \
+		mccl_uif64 t1_ = h + X1_BSIG1(e) + X1_CH(e, f, g) + (wk); \
+		d += t1_; \
+		h = t1_ + X1_BSIG0(a) + X1_MAJ(a, b, c); \
+	} while (0)
+
+#define X1_ROUNDS4(a, b, c, d, e, f, g, h, wk) \
+	do { \
+		X1_ROUND(a, b, c, d, e, f, g, h, (wk)[0]); \
+		X1_ROUND(h, a, b, c, d, e, f, g, (wk)[1]); \
+		X1_ROUND(g, h, a, b, c, d, e, f, (wk)[2]); \
+		X1_ROUND(f, g, h, a, b, c, d, e, (wk)[3]); \
+	} while (0)
+
+/* Word j of the window either as loaded or after expanding it in place. */
+#define X1_LOADED(j)   (w[j])
+#define X1_EXPANDED(j) (w[j] += X1_SSIG1(w[((j) + 14) & 15]) + w[((j) + 9) & 15] + X1_SSIG0(w[((j) + 1) & 15]))
+
+#define X1_ROUNDS8(W, a, b, c, d, e, f, g, h, i, j) \
+	do { \
+		X1_ROUND(a, b, c, d, e, f, g, h, W((j) + 0) + sha512_table[(i) + (j) + 0]); \
+		X1_ROUND(h, a, b, c, d, e, f, g, W((j) + 1) + sha512_table[(i) + (j) + 1]); \
+		X1_ROUND(g, h, a, b, c, d, e, f, W((j) + 2) + sha512_table[(i) + (j) + 2]); \
+		X1_ROUND(f, g, h, a, b, c, d, e, W((j) + 3) + sha512_table[(i) + (j) + 3]); \
+		X1_ROUND(e, f, g, h, a, b, c, d, W((j) + 4) + sha512_table[(i) + (j) + 4]); \
+		X1_ROUND(d, e, f, g, h, a, b, c, W((j) + 5) + sha512_table[(i) + (j) + 5]); \
+		X1_ROUND(c, d, e, f, g, h, a, b, W((j) + 6) + sha512_table[(i) + (j) + 6]); \
+		X1_ROUND(b, c, d, e, f, g, h, a, W((j) + 7) + sha512_table[(i) + (j) + 7]); \
+	} while (0)
+
+static
+void
+sha2_512_process_blocks_native(UINT64 *state, const unsigned char *data, size_t nb_blocks)
+{
+	mccl_uif64 a = state[0], b = state[1], c = state[2], d = state[3];
+	mccl_uif64 e = state[4], f = state[5], g = state[6], h = state[7];
+
+	while (nb_blocks--) {
+		mccl_uif64 w[16];
+		unsigned i;
+
+		bufcvt_be64_to_UINT64(w, data, 16);
+		X1_ROUNDS8(X1_LOADED, a, b, c, d, e, f, g, h, 0, 0);
+		X1_ROUNDS8(X1_LOADED, a, b, c, d, e, f, g, h, 0, 8);
+		for (i = 16; i < 80; i += 16) {
+			X1_ROUNDS8(X1_EXPANDED, a, b, c, d, e, f, g, h, i, 0);
+			X1_ROUNDS8(X1_EXPANDED, a, b, c, d, e, f, g, h, i, 8);
+		}
+
+		a = state[0] += a; b = state[1] += b; c = state[2] += c; d = state[3] += d;
+		e = state[4] += e; f = state[5] += f; g = state[6] += g; h = state[7] += h;
+		data += 128;
+	}
+}
+
+#undef X1_ROUNDS8
+#undef X1_EXPANDED
+#undef X1_LOADED
+
+#endif
+
+#ifdef SHA2_512_AVX2
+
+/* Expands the schedule four words at a time in AVX2 registers while the
+ * rounds run in general purpose ones with BMI2 rotates. Each vector holds
+ * four consecutive schedule words. AVX2 has no 64 bit rotate so they are
+ * made from a pair of shifts, and the words one and seven behind the start
+ * of a vector straddle its 128 bit halves so they are gathered with a cross
+ * lane permute followed by an in lane alignr. The first two words of a new
+ * vector depend on the last two of the previous one so sigma1 is applied
+ * to each half in turn. */
+
+#define ROR(x, c)   _mm256_or_si256(_mm256_srli_epi64(x, c), _mm256_slli_epi64(x, 64 - (c)))
+#define SSIG0(x)    _mm256_xor_si256(_mm256_xor_si256(ROR(x, 1), ROR(x, 8)), _mm256_srli_epi64(x, 7))
+#define SSIG1(x)    _mm256_xor_si256(_mm256_xor_si256(ROR(x, 19), ROR(x, 61)), _mm256_srli_epi64(x, 6))
+
+/* Words 1 to 4 of the eight in y:x. */
+#define SHIFT1(x, y) _mm256_alignr_epi8(_mm256_permute2x128_si256(x, y, 0x21), x, 8)
+
+/* Replaces x0 (words t-16 to t-13) with words t to t+3. */
+#define SCHEDULE(x0, x1, x2, x3) \
+	do { \
+		x0 = _mm256_add_epi64(_mm256_add_epi64(x0, SHIFT1(x2, x3)), SSIG0(SHIFT1(x0, x1))); \
+		x0 = _mm256_add_epi64(x0, SSIG1(_mm256_permute2x128_si256(x3, x3, 0x81))); \
+		x0 = _mm256_add_epi64(x0, SSIG1(_mm256_permute2x128_si256(x0, x0, 0x08))); \
+	} while (0)
+
+/* Four rounds starting at round t while the words for round t + 16 onwards
+ * are computed into x0. */
+#define SCHEDULE_ROUNDS4(x0, x1, x2, x3, a, b, c, d, e, f, g, h, t) \
+	do { \
+		SCHEDULE(x0, x1, x2, x3); \
+		X1_ROUNDS4(a, b, c, d, e, f, g, h, wk + ((t) & 15)); \
+		_mm256_storeu_si256((__m256i *)(wk + ((t) & 15)), _mm256_add_epi64(x0, _mm256_loadu_si256((const __m256i *)(sha512_table + (t) + 16)))); \
+	} while (0)
+
+__attribute__((target("avx2,bmi2")))
+static
+void
+sha2_512_process_blocks_avx2(UINT64 *state, const unsigned char *data, size_t nb_blocks)
+{
+	const __m256i bswap = _mm256_set_epi64x
+		(0x08090A0B0C0D0E0Fll, 0x0001020304050607ll
+		,0x08090A0B0C0D0E0Fll, 0x0001020304050607ll
+		);
+	mccl_uif64 a = state[0], b = state[1], c = state[2], d = state[3];
+	mccl_uif64 e = state[4], f = state[5], g = state[6], h = state[7];
+	mccl_uif64 wk[16];
+
+	while (nb_blocks--) {
+		__m256i x[4];
+		unsigned t;
+
+		for (t = 0; t < 4; t++) {
+			x[t] = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)(data + 32 * t)), bswap);
+			_mm256_storeu_si256((__m256i *)(wk + 4 * t), _mm256_add_epi64(x[t], _mm256_loadu_si256((const __m256i *)(sha512_table + 4 * t))));
+		}
+
+		for (t = 0; t < 64; t += 16) {
+			SCHEDULE_ROUNDS4(x[0], x[1], x[2], x[3], a, b, c, d, e, f, g, h, t + 0);
+			SCHEDULE_ROUNDS4(x[1], x[2], x[3], x[0], e, f, g, h, a, b, c, d, t + 4);
+			SCHEDULE_ROUNDS4(x[2], x[3], x[0], x[1], a, b, c, d, e, f, g, h, t + 8);
+			SCHEDULE_ROUNDS4(x[3], x[0], x[1], x[2], e, f, g, h, a, b, c, d, t + 12);
+		}
+		X1_ROUNDS4(a, b, c, d, e, f, g, h, wk + 0);
+		X1_ROUNDS4(e, f, g, h, a, b, c, d, wk + 4);
+		X1_ROUNDS4(a, b, c, d, e, f, g, h, wk + 8);
+		X1_ROUNDS4(e, f, g, h, a, b, c, d, wk + 12);
+
+		a = state[0] += a; b = state[1] += b; c = state[2] += c; d = state[3] += d;
+		e = state[4] += e; f = state[5] += f; g = state[6] += g; h = state[7] += h;
+		data += 128;
+	}
+}
+
+#undef SCHEDULE_ROUNDS4
+#undef SCHEDULE
+#undef SHIFT1
+#undef SSIG1
+#undef SSIG0
+#undef ROR
+
+#endif
+
+#ifdef SHA2_512_NATIVE
+#undef X1_ROUNDS4
+#undef X1_ROUND
+#undef X1_MAJ
+#undef X1_CH
+#undef X1_SSIG1
+#undef X1_SSIG0
+#undef X1_BSIG1
+#undef X1_BSIG0
+#undef X1_ROR
+#endif
+
+/* Multi-buffer kernels. See the SHA-256 ones for the arrangement. */
+
+static
+void
+sha2_512_mb_single(union mb_state_u *state, const unsigned char *data, size_t nb_blocks)
+{
+	sha2_512_select()(state->w64, data, nb_blocks);
+}
+
+static
+void
+sha2_512_mb_blocks(union mb_state_u *const *state, const unsigned char *const *data, size_t nb_blocks)
+{
+	sha2_512_process_blocks(state[0]->w64, data[0], nb_blocks);
+}
+
+static
+void
+sha2_512_mb_store(const union mb_state_u *state, unsigned char *result, unsigned digest_bits)
+{
+	unsigned i;
+	for (i = 0; i < digest_bits / 8; i++)
+		result[i] = (unsigned char)(UINT64_LOW(UINT64_SHR(state->w64[i/8], 8u * (7u - (i & 0x07u)))) & 0xFFu);
+	if (digest_bits & 0x07u)
+		result[i] = 0;
+}
+
+#ifdef MCCL_CPUID_X86
+
+/* Converts between UINT64 (which need not be a native type) and the
+ * argument type of the vector intrinsics. */
+#define TO_LL(x)   ((long long)(((unsigned long long)UINT64_HIGH(x) << 32) | UINT64_LOW(x)))
+#define FROM_LL(x) UINT64_MAKE((mccl_uif32)((unsigned long long)(x) >> 32), (mccl_uif32)((unsigned long long)(x) & 0xFFFFFFFFu))
+
+#define ADD(x, y)    _mm256_add_epi64(x, y)
+#define XOR(x, y)    _mm256_xor_si256(x, y)
+#define AND(x, y)    _mm256_and_si256(x, y)
+#define OR(x, y)     _mm256_or_si256(x, y)
+#define ANDNOT(x, y) _mm256_andnot_si256(x, y)
+#define SHR(x, c)    _mm256_srli_epi64(x, c)
+#define ROR(x, c)    _mm256_or_si256(_mm256_srli_epi64(x, c), _mm256_slli_epi64(x, 64 - (c)))
+
+#define MB_ROUND(a, b, c, d, e, f, g, h, k, w) \
+	do { \
+		__m256i t1_ = ADD(ADD(ADD(h, XOR(XOR(ROR(e, 14), ROR(e, 18)), ROR(e, 41))), \
+		                      XOR(AND(e, f), ANDNOT(e, g))), \
+		                  ADD(_mm256_set1_epi64x(TO_LL(k)), w)); \
+		__m256i t2_ = ADD(XOR(XOR(ROR(a, 28), ROR(a, 34)), ROR(a, 39)), \
+		                  OR(AND(a, b), AND(c, OR(a, b)))); \
+		d = ADD(d, t1_); \
+		h = ADD(t1_, t2_); \
+	} while (0)
+
+#define MB_SCHEDULE(w, i) \
+	(w[(i) & 15] = ADD(ADD(w[(i) & 15], w[((i) - 7) & 15]), \
+	                   ADD(XOR(XOR(ROR(w[((i) - 15) & 15], 1), ROR(w[((i) - 15) & 15], 8)), SHR(w[((i) - 15) & 15], 7)), \
+	                       XOR(XOR(ROR(w[((i) - 2) & 15], 19), ROR(w[((i) - 2) & 15], 61)), SHR(w[((i) - 2) & 15], 6)))))
+
+#define MB_ROUNDS8(i) \
+	do { \
+		if ((i) >= 16) { \
+			unsigned j_; \
+			for (j_ = (i); j_ < (i) + 8; j_++) \
+				MB_SCHEDULE(w, j_); \
+		} \
+		MB_ROUND(a, b, c, d, e, f, g, h, sha512_table[(i) + 0], w[((i) + 0) & 15]); \
+		MB_ROUND(h, a, b, c, d, e, f, g, sha512_table[(i) + 1], w[((i) + 1) & 15]); \
+		MB_ROUND(g, h, a, b, c, d, e, f, sha512_table[(i) + 2], w[((i) + 2) & 15]); \
+		MB_ROUND(f, g, h, a, b, c, d, e, sha512_table[(i) + 3], w[((i) + 3) & 15]); \
+		MB_ROUND(e, f, g, h, a, b, c, d, sha512_table[(i) + 4], w[((i) + 4) & 15]); \
+		MB_ROUND(d, e, f, g, h, a, b, c, sha512_table[(i) + 5], w[((i) + 5) & 15]); \
+		MB_ROUND(c, d, e, f, g, h, a, b, sha512_table[(i) + 6], w[((i) + 6) & 15]); \
+		MB_ROUND(b, c, d, e, f, g, h, a, sha512_table[(i) + 7], w[((i) + 7) & 15]); \
+	} while (0)
+
+/* Loads four words from each of the four lanes and transposes them so that
+ * w[i] holds word i of every lane. */
+__attribute__((target("avx2")))
+static
+void
+sha2_512_x4_load(__m256i *w, const unsigned char *const *p, unsigned offset)
+{
+	const __m256i bswap = _mm256_set_epi64x
+		(0x08090A0B0C0D0E0Fll, 0x0001020304050607ll
+		,0x08090A0B0C0D0E0Fll, 0x0001020304050607ll
+		);
+	__m256i r[4], t[4];
+	unsigned i;
+
+	for (i = 0; i < 4; i++)
+		r[i] = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)(p[i] + offset)), bswap);
+
+	t[0] = _mm256_unpacklo_epi64(r[0], r[1]);
+	t[1] = _mm256_unpackhi_epi64(r[0], r[1]);
+	t[2] = _mm256_unpacklo_epi64(r[2], r[3]);
+	t[3] = _mm256_unpackhi_epi64(r[2], r[3]);
+	w[0] = _mm256_permute2x128_si256(t[0], t[2], 0x20);
+	w[1] = _mm256_permute2x128_si256(t[1], t[3], 0x20);
+	w[2] = _mm256_permute2x128_si256(t[0], t[2], 0x31);
+	w[3] = _mm256_permute2x128_si256(t[1], t[3], 0x31);
+}
+
+__attribute__((target("avx2")))
+static
+void
+sha2_512_x4_avx2(union mb_state_u *const *state, const unsigned char *const *data, size_t nb_blocks)
+{
+	const unsigned char *p[4];
+	__m256i s[8];
+	unsigned i;
+
+	for (i = 0; i < 4; i++)
+		p[i] = data[i];
+	for (i = 0; i < 8; i++)
+		s[i] = _mm256_set_epi64x
+			(TO_LL(state[3]->w64[i]), TO_LL(state[2]->w64[i]), TO_LL(state[1]->w64[i]), TO_LL(state[0]->w64[i]));
+
+	while (nb_blocks--) {
+		__m256i a = s[0], b = s[1], c = s[2], d = s[3];
+		__m256i e = s[4], f = s[5], g = s[6], h = s[7];
+		__m256i w[16];
+
+		for (i = 0; i < 4; i++)
+			sha2_512_x4_load(w + 4 * i, p, 32 * i);
+
+		MB_ROUNDS8(0);  MB_ROUNDS8(8);  MB_ROUNDS8(16); MB_ROUNDS8(24);
+		MB_ROUNDS8(32); MB_ROUNDS8(40); MB_ROUNDS8(48); MB_ROUNDS8(56);
+		MB_ROUNDS8(64); MB_ROUNDS8(72);
+
+		s[0] = ADD(s[0], a); s[1] = ADD(s[1], b);
+		s[2] = ADD(s[2], c); s[3] = ADD(s[3], d);
+		s[4] = ADD(s[4], e); s[5] = ADD(s[5], f);
+		s[6] = ADD(s[6], g); s[7] = ADD(s[7], h);
+
+		for (i = 0; i < 4; i++)
+			p[i] += 128;
+	}
+
+	for (i = 0; i < 8; i++) {
+		long long lanes[4];
+		unsigned j;
+		_mm256_storeu_si256((__m256i *)lanes, s[i]);
+		for (j = 0; j < 4; j++)
+			state[j]->w64[i] = FROM_LL(lanes[j]);
+	}
+}
+
+#undef MB_ROUNDS8
+#undef MB_SCHEDULE
+#undef MB_ROUND
+#undef ADD
+#undef XOR
+#undef AND
+#undef OR
+#undef ANDNOT
+#undef SHR
+#undef ROR
+#undef TO_LL
+#undef FROM_LL
+
+static const struct mb_engine_s sha2_512_mb_avx2 =
+{	"avx2-x4", 4, 128, 16, 1, 0x80, 0x00
+,	sha2_512_x4_avx2, sha2_512_mb_single, sha2_512_mb_store
+};
+
+#endif
+
+static const struct mb_engine_s sha2_512_mb_portable =
+{	"portable", 1, 128, 16, 1, 0x80, 0x00
+,	sha2_512_mb_blocks, sha2_512_mb_single, sha2_512_mb_store
+};
+
+enum {
+	SHA2_512_AVX2_KERNEL,
+	SHA2_512_NATIVE_KERNEL,
+	SHA2_512_PORTABLE_KERNEL
+};
+
+/* The SHA512 instructions are detected (MCCL_CPU_SHA512) but the compilers
+ * this is built with do not support them yet. */
+static const struct dispatch_kernel_s sha2_512_kernels[] =
+{	{"avx2", MCCL_CPU_AVX2 | MCCL_CPU_BMI2, SHA2_512_AVX2_BUILT}
+,	{"native", 0, SHA2_512_NATIVE_BUILT}
+,	{"portable", 0, 1}
+};
+
+const struct dispatch_slot_s sha2_512_dispatch =
+{	"sha2.512", "SHA-384/512 compression", sha2_512_kernels, 3
+};
+
+sha2_512_blocks_fn sha2_512_get_avx2(void)
+{
+#ifdef SHA2_512_AVX2
+	if (dispatch_usable(&sha2_512_kernels[SHA2_512_AVX2_KERNEL]))
+		return sha2_512_process_blocks_avx2;
+#endif
+	return NULL;
+}
+
+sha2_512_blocks_fn sha2_512_get_native(void)
+{
+#ifdef SHA2_512_NATIVE
+	return sha2_512_process_blocks_native;
+#else
+	return NULL;
+#endif
+}
+
+sha2_512_blocks_fn sha2_512_select(void)
+{
+	switch (dispatch_select(&sha2_512_dispatch)) {
+	case SHA2_512_AVX2_KERNEL:
+		return sha2_512_get_avx2();
+	case SHA2_512_NATIVE_KERNEL:
+		return sha2_512_get_native();
+	}
+	return sha2_512_process_blocks;
+}
+
+enum {
+	SHA2_512_MB_AVX2,
+	SHA2_512_MB_SERIAL,
+	SHA2_512_MB_PORTABLE
+};
+
+static const struct dispatch_kernel_s sha2_512_mb_kernels[] =
+{	{"avx2", MCCL_CPU_AVX2, DISPATCH_X86}
+,	{"serial", 0, 1}
+,	{"portable", 0, 1}
+};
+
+const struct dispatch_slot_s sha2_512_mb_dispatch =
+{	"sha2.512.mb", "SHA-384/512 batches of messages", sha2_512_mb_kernels, 3
+};
+
+const struct mb_engine_s *sha2_512_mb_get_avx2(void)
+{
+#ifdef MCCL_CPUID_X86
+	if (dispatch_usable(&sha2_512_mb_kernels[SHA2_512_MB_AVX2]))
+		return &sha2_512_mb_avx2;
+#endif
+	return NULL;
+}
+
+const struct mb_engine_s *sha2_512_mb_get_portable(void)
+{
+	return &sha2_512_mb_portable;
+}
 
+const struct mb_engine_s *sha2_512_mb_select(void)
+{
+	switch (dispatch_select(&sha2_512_mb_dispatch)) {
+	case SHA2_512_MB_AVX2:
+		return sha2_512_mb_get_avx2();
+	case SHA2_512_MB_PORTABLE:
+		return sha2_512_mb_get_portable();
+	}
+	return NULL;
+}
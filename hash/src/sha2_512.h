@@ -28,7 +28,35 @@
 #define SHA2_512_H_
 
 #include "mccl/mccl_op_uint64.h"
+#include "multibuf.h"
+#include <stddef.h>
 
 void sha2_512_process_block(UINT64 *state, const unsigned char *words);
 
+/* Compresses nb_blocks consecutive 128 byte blocks into the state. */
+typedef void (*sha2_512_blocks_fn)(UINT64 *state, const unsigned char *data, size_t nb_blocks);
+
+/* The portable implementation. */
+void sha2_512_process_blocks(UINT64 *state, const unsigned char *data, size_t nb_blocks);
+
+/* Returns the implementation which works on the native 64 bit type, or the
+ * one which also expands the message schedule in AVX2 registers and rotates
+ * with BMI2. Each returns NULL if it cannot be used on this processor or
+ * was not compiled in. */
+sha2_512_blocks_fn sha2_512_get_native(void);
+sha2_512_blocks_fn sha2_512_get_avx2(void);
+
+/* Returns the fastest implementation available on this processor. */
+sha2_512_blocks_fn sha2_512_select(void);
+
+/* A multi-buffer engine which hashes four messages in AVX2 registers.
+ * Returns NULL if the processor does not support it or it was not compiled
+ * in. The portable engine hashes one message at a time and always exists. */
+const struct mb_engine_s *sha2_512_mb_get_avx2(void);
+const struct mb_engine_s *sha2_512_mb_get_portable(void);
+
+/* Returns the multi-buffer engine to use for batches of messages or NULL if
+ * hashing them one after the other is faster on this processor. */
+const struct mb_engine_s *sha2_512_mb_select(void);
+
 #endif /* SHA2_H_ */
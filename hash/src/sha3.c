@@ -26,93 +26,419 @@
 
 #include "mccl/mccl_op_uint64.h"
 #include "mccl/mccl_bufcvt.h"
+#include "mccl/mccl_cpuid.h"
+#include "hash/dispatch.h"
 #include "hash/sha3.h"
+#include "sha3_internal.h"
 #include <stdlib.h>
 #include <assert.h>
 
-static void theta(UINT64 *B, const UINT64 *A)
+#ifdef MCCL_CPUID_X86
+#include <immintrin.h>
+#endif
+
+static const UINT64 keccak_round_constants[24] =
+{	UINT64_INIT(0x00000000u, 0x00000001u), UINT64_INIT(0x00000000u, 0x00008082u)
+,	UINT64_INIT(0x80000000u, 0x0000808Au), UINT64_INIT(0x80000000u, 0x80008000u)
+,	UINT64_INIT(0x00000000u, 0x0000808Bu), UINT64_INIT(0x00000000u, 0x80000001u)
+,	UINT64_INIT(0x80000000u, 0x80008081u), UINT64_INIT(0x80000000u, 0x00008009u)
+,	UINT64_INIT(0x00000000u, 0x0000008Au), UINT64_INIT(0x00000000u, 0x00000088u)
+,	UINT64_INIT(0x00000000u, 0x80008009u), UINT64_INIT(0x00000000u, 0x8000000Au)
+,	UINT64_INIT(0x00000000u, 0x8000808Bu), UINT64_INIT(0x80000000u, 0x0000008Bu)
+,	UINT64_INIT(0x80000000u, 0x00008089u), UINT64_INIT(0x80000000u, 0x00008003u)
+,	UINT64_INIT(0x80000000u, 0x00008002u), UINT64_INIT(0x80000000u, 0x00000080u)
+,	UINT64_INIT(0x00000000u, 0x0000800Au), UINT64_INIT(0x80000000u, 0x8000000Au)
+,	UINT64_INIT(0x80000000u, 0x80008081u), UINT64_INIT(0x80000000u, 0x00008080u)
+,	UINT64_INIT(0x00000000u, 0x80000001u), UINT64_INIT(0x80000000u, 0x80008008u)
+};
+
+/* The permutation is written as one fused round which performs theta, rho,
+ * pi, chi and iota in a single pass from one set of 25 lane variables (A) to
+ * another (E), also accumulating the column parities the next theta needs.
+ * Rounds alternate between the two sets so the state never leaves
+ * registers (or at least never goes through an array).
+ *
+ * Lanes are named after their position in the state: the first letter is
+ * the row (b, g, k, m, s for y = 0 to 4) and the second is the column (a, e,
+ * i, o, u for x = 0 to 4). Lane x + 5y is therefore ba, be, bi, bo, bu, ga,
+ * ... su.
+ *
+ * Lane complementing: be, bi, go, ki, mi and sa are kept inverted while the
+ * permutation runs. That turns all but one of the NOTs in each row of chi
+ * into free changes between AND and OR, leaving six NOTs per round instead
+ * of twenty-five.
+ *
+ * The operations are macros so that the round can be reused for other lane
+ * types. */
+#define KECCAK_ROUND(i, A, E) \
+	do { \
+		Da = K_XOR(Cu, K_ROL(Ce, 1)); \
+		De = K_XOR(Ca, K_ROL(Ci, 1)); \
+		Di = K_XOR(Ce, K_ROL(Co, 1)); \
+		Do = K_XOR(Ci, K_ROL(Cu, 1)); \
+		Du = K_XOR(Co, K_ROL(Ca, 1)); \
+		\
+		A##ba = K_XOR(A##ba, Da); Bba = A##ba; \
+		A##ge = K_XOR(A##ge, De); Bbe = K_ROL(A##ge, 44); \
+		A##ki = K_XOR(A##ki, Di); Bbi = K_ROL(A##ki, 43); \
+		A##mo = K_XOR(A##mo, Do); Bbo = K_ROL(A##mo, 21); \
+		A##su = K_XOR(A##su, Du); Bbu = K_ROL(A##su, 14); \
+		E##ba = K_XOR(K_XOR(Bba, K_OR(Bbe, Bbi)), K_RC(i)); Ca = E##ba; \
+		E##be = K_XOR(Bbe, K_OR(K_NOT(Bbi), Bbo));          Ce = E##be; \
+		E##bi = K_XOR(Bbi, K_AND(Bbo, Bbu));                Ci = E##bi; \
+		E##bo = K_XOR(Bbo, K_OR(Bbu, Bba));                 Co = E##bo; \
+		E##bu = K_XOR(Bbu, K_AND(Bba, Bbe));                Cu = E##bu; \
+		\
+		A##bo = K_XOR(A##bo, Do); Bga = K_ROL(A##bo, 28); \
+		A##gu = K_XOR(A##gu, Du); Bge = K_ROL(A##gu, 20); \
+		A##ka = K_XOR(A##ka, Da); Bgi = K_ROL(A##ka, 3); \
+		A##me = K_XOR(A##me, De); Bgo = K_ROL(A##me, 45); \
+		A##si = K_XOR(A##si, Di); Bgu = K_ROL(A##si, 61); \
+		E##ga = K_XOR(Bga, K_OR(Bge, Bgi));          Ca = K_XOR(Ca, E##ga); \
+		E##ge = K_XOR(Bge, K_AND(Bgi, Bgo));         Ce = K_XOR(Ce, E##ge); \
+		E##gi = K_XOR(Bgi, K_OR(Bgo, K_NOT(Bgu)));   Ci = K_XOR(Ci, E##gi); \
+		E##go = K_XOR(Bgo, K_OR(Bgu, Bga));          Co = K_XOR(Co, E##go); \
+		E##gu = K_XOR(Bgu, K_AND(Bga, Bge));         Cu = K_XOR(Cu, E##gu); \
+		\
+		A##be = K_XOR(A##be, De); Bka = K_ROL(A##be, 1); \
+		A##gi = K_XOR(A##gi, Di); Bke = K_ROL(A##gi, 6); \
+		A##ko = K_XOR(A##ko, Do); Bki = K_ROL(A##ko, 25); \
+		A##mu = K_XOR(A##mu, Du); Bko = K_ROL(A##mu, 8); \
+		A##sa = K_XOR(A##sa, Da); Bku = K_ROL(A##sa, 18); \
+		E##ka = K_XOR(Bka, K_OR(Bke, Bki));          Ca = K_XOR(Ca, E##ka); \
+		E##ke = K_XOR(Bke, K_AND(Bki, Bko));         Ce = K_XOR(Ce, E##ke); \
+		E##ki = K_XOR(Bki, K_AND(K_NOT(Bko), Bku));  Ci = K_XOR(Ci, E##ki); \
+		E##ko = K_XOR(K_NOT(Bko), K_OR(Bku, Bka));   Co = K_XOR(Co, E##ko); \
+		E##ku = K_XOR(Bku, K_AND(Bka, Bke));         Cu = K_XOR(Cu, E##ku); \
+		\
+		A##bu = K_XOR(A##bu, Du); Bma = K_ROL(A##bu, 27); \
+		A##ga = K_XOR(A##ga, Da); Bme = K_ROL(A##ga, 36); \
+		A##ke = K_XOR(A##ke, De); Bmi = K_ROL(A##ke, 10); \
+		A##mi = K_XOR(A##mi, Di); Bmo = K_ROL(A##mi, 15); \
+		A##so = K_XOR(A##so, Do); Bmu = K_ROL(A##so, 56); \
+		E##ma = K_XOR(Bma, K_AND(Bme, Bmi));         Ca = K_XOR(Ca, E##ma); \
+		E##me = K_XOR(Bme, K_OR(Bmi, Bmo));          Ce = K_XOR(Ce, E##me); \
+		E##mi = K_XOR(Bmi, K_OR(K_NOT(Bmo), Bmu));   Ci = K_XOR(Ci, E##mi); \
+		E##mo = K_XOR(K_NOT(Bmo), K_AND(Bmu, Bma));  Co = K_XOR(Co, E##mo); \
+		E##mu = K_XOR(Bmu, K_OR(Bma, Bme));          Cu = K_XOR(Cu, E##mu); \
+		\
+		A##bi = K_XOR(A##bi, Di); Bsa = K_ROL(A##bi, 62); \
+		A##go = K_XOR(A##go, Do); Bse = K_ROL(A##go, 55); \
+		A##ku = K_XOR(A##ku, Du); Bsi = K_ROL(A##ku, 39); \
+		A##ma = K_XOR(A##ma, Da); Bso = K_ROL(A##ma, 41); \
+		A##se = K_XOR(A##se, De); Bsu = K_ROL(A##se, 2); \
+		E##sa = K_XOR(Bsa, K_AND(K_NOT(Bse), Bsi));  Ca = K_XOR(Ca, E##sa); \
+		E##se = K_XOR(K_NOT(Bse), K_OR(Bsi, Bso));   Ce = K_XOR(Ce, E##se); \
+		E##si = K_XOR(Bsi, K_AND(Bso, Bsu));         Ci = K_XOR(Ci, E##si); \
+		E##so = K_XOR(Bso, K_OR(Bsu, Bsa));          Co = K_XOR(Co, E##so); \
+		E##su = K_XOR(Bsu, K_AND(Bsa, Bse));         Cu = K_XOR(Cu, E##su); \
+	} while (0)
+
+/* All 24 rounds, starting and finishing in the A lanes. Needs the column
+ * parities of A in Ca to Cu. Unrolling further than a pair of rounds makes
+ * the code too large to stay in the decoded instruction cache and is
+ * slower. */
+#define KECCAK_PERMUTE() \
+	do { \
+		unsigned r_; \
+		for (r_ = 0; r_ < 24; r_ += 2) { \
+			KECCAK_ROUND(r_, A, E); KECCAK_ROUND(r_ + 1, E, A); \
+		} \
+	} while (0)
+
+#define KECCAK_PARITY() \
+	do { \
+		Ca = K_XOR(K_XOR(K_XOR(Aba, Aga), K_XOR(Aka, Ama)), Asa); \
+		Ce = K_XOR(K_XOR(K_XOR(Abe, Age), K_XOR(Ake, Ame)), Ase); \
+		Ci = K_XOR(K_XOR(K_XOR(Abi, Agi), K_XOR(Aki, Ami)), Asi); \
+		Co = K_XOR(K_XOR(K_XOR(Abo, Ago), K_XOR(Ako, Amo)), Aso); \
+		Cu = K_XOR(K_XOR(K_XOR(Abu, Agu), K_XOR(Aku, Amu)), Asu); \
+	} while (0)
+
+/* Applies the lane complementing transform (its own inverse). */
+#define KECCAK_COMPLEMENT() \
+	do { \
+		Abe = K_NOT(Abe); Abi = K_NOT(Abi); Ago = K_NOT(Ago); \
+		Aki = K_NOT(Aki); Ami = K_NOT(Ami); Asa = K_NOT(Asa); \
+	} while (0)
+
+/* Lists the lanes in state order with a macro applied to each. */
+#define KECCAK_LANES(X) \
+	X(ba, 0)  X(be, 1)  X(bi, 2)  X(bo, 3)  X(bu, 4) \
+	X(ga, 5)  X(ge, 6)  X(gi, 7)  X(go, 8)  X(gu, 9) \
+	X(ka, 10) X(ke, 11) X(ki, 12) X(ko, 13) X(ku, 14) \
+	X(ma, 15) X(me, 16) X(mi, 17) X(mo, 18) X(mu, 19) \
+	X(sa, 20) X(se, 21) X(si, 22) X(so, 23) X(su, 24)
+
+#define K_XOR(x, y) UINT64_XOR(x, y)
+#define K_AND(x, y) UINT64_AND(x, y)
+#define K_OR(x, y)  UINT64_OR(x, y)
+#define K_NOT(x)    UINT64_COMP(x)
+#define K_ROL(x, c) UINT64_ROL(x, c)
+#define K_RC(i)     keccak_round_constants[i]
+
+static INLINE UINT64 load_le64(const unsigned char *data)
+{
+	UINT64 v;
+	bufcvt_le64_to_UINT64(&v, data, 1);
+	return v;
+}
+
+/* Absorbs nb_blocks consecutive blocks of rate_lanes 64-bit lanes each. The
+ * block is XORed into the lanes straight from the input. */
+static
+void
+keccak_absorb(UINT64 *state, const unsigned char *data, unsigned rate_lanes, size_t nb_blocks)
 {
-	unsigned x, y;
-	UINT64 C[5], D[5];
+#define DECLARE_LANE(n, i) UINT64 A##n, E##n, B##n;
+	KECCAK_LANES(DECLARE_LANE)
+#undef DECLARE_LANE
+	UINT64 Ca, Ce, Ci, Co, Cu;
+	UINT64 Da, De, Di, Do, Du;
 
-	for (x = 0; x < 5; x++)
-		C[x] = UINT64_MAKE(0, 0);
+#define LOAD_LANE(n, i) A##n = state[i];
+	KECCAK_LANES(LOAD_LANE)
+#undef LOAD_LANE
+	KECCAK_COMPLEMENT();
 
-	for (y = 0; y < 5; y++)
-		for (x = 0; x < 5; x++)
-			C[x] = UINT64_XOR(C[x], A[x + 5*y]);
+	assert((rate_lanes == 9) || (rate_lanes == 13) || (rate_lanes == 17) || (rate_lanes == 18));
 
-	D[0] = UINT64_XOR(UINT64_ROL(C[1], 1), C[4]);
-	D[1] = UINT64_XOR(UINT64_ROL(C[2], 1), C[0]);
-	D[2] = UINT64_XOR(UINT64_ROL(C[3], 1), C[1]);
-	D[3] = UINT64_XOR(UINT64_ROL(C[4], 1), C[2]);
-	D[4] = UINT64_XOR(UINT64_ROL(C[0], 1), C[3]);
+	while (nb_blocks--) {
+#define XOR_LANE(n, i) A##n = UINT64_XOR(A##n, load_le64(data + 8 * (i)));
+		XOR_LANE(ba, 0)  XOR_LANE(be, 1)  XOR_LANE(bi, 2)  XOR_LANE(bo, 3)
+		XOR_LANE(bu, 4)  XOR_LANE(ga, 5)  XOR_LANE(ge, 6)  XOR_LANE(gi, 7)
+		XOR_LANE(go, 8)
+		if (rate_lanes > 9) {
+			XOR_LANE(gu, 9)  XOR_LANE(ka, 10) XOR_LANE(ke, 11) XOR_LANE(ki, 12)
+		}
+		if (rate_lanes > 13) {
+			XOR_LANE(ko, 13) XOR_LANE(ku, 14) XOR_LANE(ma, 15) XOR_LANE(me, 16)
+		}
+		if (rate_lanes > 17) {
+			XOR_LANE(mi, 17)
+		}
+#undef XOR_LANE
 
-	for (y = 0; y < 5; y++)
-		for (x = 0; x < 5; x++)
-			B[x + 5*y] = UINT64_XOR(A[x + 5*y], D[x]);
+		KECCAK_PARITY();
+		KECCAK_PERMUTE();
+		data += 8 * rate_lanes;
+	}
+
+	KECCAK_COMPLEMENT();
+#define STORE_LANE(n, i) state[i] = A##n;
+	KECCAK_LANES(STORE_LANE)
+#undef STORE_LANE
 }
 
-static void rho(UINT64 *B, const UINT64 *A)
+#undef K_XOR
+#undef K_AND
+#undef K_OR
+#undef K_NOT
+#undef K_ROL
+#undef K_RC
+
+/* Multi-buffer absorb. Messages are padded by mb_run() so each "block" of
+ * an engine is one rate sized chunk of input followed by a permutation. */
+
+static
+void
+sha3_mb_store(const union mb_state_u *state, unsigned char *result, unsigned digest_bits)
 {
-	static const unsigned offsets[25] =
-	{	0,  1,  62, 28, 27
-	,	36, 44, 6,  55, 20
-	,	3,  10, 43, 25, 39
-	,	41, 45, 15, 21, 8
-	,	18, 2,  61, 56, 14
-	};
-	unsigned x, y;
-	for (y = 0; y < 5; y++)
-		for (x = 0; x < 5; x++)
-			B[x + 5*y] = UINT64_ROL(A[x + 5*y], offsets[x + 5*y]);
+	unsigned i;
+	for (i = 0; i < digest_bits / 8; i++)
+		result[i] = (unsigned char)(UINT64_LOW(UINT64_SHR(state->w64[i/8], 8u * (i & 0x07u))) & 0xFFu);
 }
 
-static void pi(UINT64 *out, const UINT64 *in)
+#ifdef MCCL_CPUID_X86
+
+#define TO_LL(x)   ((long long)(((unsigned long long)UINT64_HIGH(x) << 32) | UINT64_LOW(x)))
+#define FROM_LL(x) UINT64_MAKE((mccl_uif32)((unsigned long long)(x) >> 32), (mccl_uif32)((unsigned long long)(x) & 0xFFFFFFFFu))
+
+#define K_XOR(x, y) _mm256_xor_si256(x, y)
+#define K_AND(x, y) _mm256_and_si256(x, y)
+#define K_OR(x, y)  _mm256_or_si256(x, y)
+#define K_NOT(x)    _mm256_xor_si256(x, ones)
+#define K_ROL(x, c) _mm256_or_si256(_mm256_slli_epi64(x, c), _mm256_srli_epi64(x, 64 - (c)))
+#define K_RC(i)     _mm256_set1_epi64x(TO_LL(keccak_round_constants[i]))
+
+/* Loads lane i of the block from each of the four messages. x86 is little
+ * endian so the lanes need no conversion. */
+__attribute__((target("avx2")))
+static INLINE
+__m256i
+keccak_x4_word(const unsigned char *const *p, unsigned i)
 {
-	static const unsigned offsets[25] =
-	{	0,  10, 20, 5,  15
-	,	16, 1,  11, 21, 6
-	,	7,  17, 2,  12, 22
-	,	23, 8,  18, 3,  13
-	,	14, 24, 9,  19, 4
+	long long w[4];
+	memcpy(&w[0], p[0] + 8 * i, 8);
+	memcpy(&w[1], p[1] + 8 * i, 8);
+	memcpy(&w[2], p[2] + 8 * i, 8);
+	memcpy(&w[3], p[3] + 8 * i, 8);
+	return _mm256_set_epi64x(w[3], w[2], w[1], w[0]);
+}
+
+/* Four independent Keccak states, one in each 64-bit element of the
+ * vectors. The round is the same code as the scalar one. */
+__attribute__((target("avx2")))
+static INLINE
+void
+keccak_x4_avx2(union mb_state_u *const *state, const unsigned char *const *data, unsigned rate_lanes, size_t nb_blocks)
+{
+	const __m256i ones = _mm256_set1_epi64x(-1);
+	const unsigned char *p[4];
+	unsigned i;
+#define DECLARE_LANE(n, i) __m256i A##n, E##n, B##n;
+	KECCAK_LANES(DECLARE_LANE)
+#undef DECLARE_LANE
+	__m256i Ca, Ce, Ci, Co, Cu;
+	__m256i Da, De, Di, Do, Du;
+
+	for (i = 0; i < 4; i++)
+		p[i] = data[i];
+
+#define LOAD_LANE(n, i) A##n = _mm256_set_epi64x(TO_LL(state[3]->w64[i]), TO_LL(state[2]->w64[i]), TO_LL(state[1]->w64[i]), TO_LL(state[0]->w64[i]));
+	KECCAK_LANES(LOAD_LANE)
+#undef LOAD_LANE
+	KECCAK_COMPLEMENT();
+
+	while (nb_blocks--) {
+#define XOR_LANE(n, i) A##n = K_XOR(A##n, keccak_x4_word(p, i));
+		XOR_LANE(ba, 0)  XOR_LANE(be, 1)  XOR_LANE(bi, 2)  XOR_LANE(bo, 3)
+		XOR_LANE(bu, 4)  XOR_LANE(ga, 5)  XOR_LANE(ge, 6)  XOR_LANE(gi, 7)
+		XOR_LANE(go, 8)
+		if (rate_lanes > 9) {
+			XOR_LANE(gu, 9)  XOR_LANE(ka, 10) XOR_LANE(ke, 11) XOR_LANE(ki, 12)
+		}
+		if (rate_lanes > 13) {
+			XOR_LANE(ko, 13) XOR_LANE(ku, 14) XOR_LANE(ma, 15) XOR_LANE(me, 16)
+		}
+		if (rate_lanes > 17) {
+			XOR_LANE(mi, 17)
+		}
+#undef XOR_LANE
+
+		KECCAK_PARITY();
+		KECCAK_PERMUTE();
+
+		for (i = 0; i < 4; i++)
+			p[i] += 8 * rate_lanes;
+	}
+
+	KECCAK_COMPLEMENT();
+#define STORE_LANE(n, i) \
+	{ \
+		long long v_[4]; \
+		_mm256_storeu_si256((__m256i *)v_, A##n); \
+		state[0]->w64[i] = FROM_LL(v_[0]); \
+		state[1]->w64[i] = FROM_LL(v_[1]); \
+		state[2]->w64[i] = FROM_LL(v_[2]); \
+		state[3]->w64[i] = FROM_LL(v_[3]); \
+	}
+	KECCAK_LANES(STORE_LANE)
+#undef STORE_LANE
+}
+
+#undef K_XOR
+#undef K_AND
+#undef K_OR
+#undef K_NOT
+#undef K_ROL
+#undef K_RC
+#undef TO_LL
+#undef FROM_LL
+
+#endif
+
+/* Each rate needs its own engine as the kernels are not told which one
+ * they belong to. */
+#define SHA3_MB_RATE(bits, rate_lanes) \
+	static \
+	void \
+	sha3_mb_single_##bits(union mb_state_u *state, const unsigned char *data, size_t nb_blocks) \
+	{ \
+		keccak_absorb(state->w64, data, rate_lanes, nb_blocks); \
+	} \
+	static const struct mb_engine_s sha3_mb_portable_##bits = \
+	{	"portable", 1, 8 * rate_lanes, 0, 0, 0x01, 0x80 \
+	,	NULL, sha3_mb_single_##bits, sha3_mb_store \
+	}; \
+	SHA3_MB_RATE_AVX2(bits, rate_lanes)
+
+#ifdef MCCL_CPUID_X86
+#define SHA3_MB_RATE_AVX2(bits, rate_lanes) \
+	__attribute__((target("avx2"))) \
+	static \
+	void \
+	sha3_mb_x4_##bits(union mb_state_u *const *state, const unsigned char *const *data, size_t nb_blocks) \
+	{ \
+		keccak_x4_avx2(state, data, rate_lanes, nb_blocks); \
+	} \
+	static const struct mb_engine_s sha3_mb_avx2_##bits = \
+	{	"avx2-x4", 4, 8 * rate_lanes, 0, 0, 0x01, 0x80 \
+	,	sha3_mb_x4_##bits, sha3_mb_single_##bits, sha3_mb_store \
 	};
+#else
+#define SHA3_MB_RATE_AVX2(bits, rate_lanes)
+#endif
+
+SHA3_MB_RATE(224, 18)
+SHA3_MB_RATE(256, 17)
+SHA3_MB_RATE(384, 13)
+SHA3_MB_RATE(512, 9)
+
+#undef SHA3_MB_RATE
+#undef SHA3_MB_RATE_AVX2
+
+enum {
+	SHA3_MB_AVX2,
+	SHA3_MB_SERIAL,
+	SHA3_MB_PORTABLE
+};
 
-	unsigned int x, y;
-	for (y = 0; y < 5; y++)
-		for (x = 0; x < 5; x++)
-			out[offsets[x + 5*y]] = in[x + 5*y];
+static const struct dispatch_kernel_s sha3_mb_kernels[] =
+{	{"avx2", MCCL_CPU_AVX2, DISPATCH_X86}
+,	{"serial", 0, 1}
+,	{"portable", 0, 1}
+};
+
+const struct dispatch_slot_s sha3_mb_dispatch =
+{	"sha3.mb", "SHA-3 batches of messages", sha3_mb_kernels, 3
+};
+
+const struct mb_engine_s *sha3_mb_get_avx2(unsigned digest_bits)
+{
+#ifdef MCCL_CPUID_X86
+	if (dispatch_usable(&sha3_mb_kernels[SHA3_MB_AVX2])) {
+		switch (digest_bits) {
+		case 224: return &sha3_mb_avx2_224;
+		case 256: return &sha3_mb_avx2_256;
+		case 384: return &sha3_mb_avx2_384;
+		case 512: return &sha3_mb_avx2_512;
+		}
+	}
+#endif
+	return NULL;
 }
 
-static void chi(UINT64 *out, const UINT64 *in)
+const struct mb_engine_s *sha3_mb_get_portable(unsigned digest_bits)
 {
-	unsigned int y;
-	for (y = 0; y < 5; y++, in+=5, out+=5) {
-		out[0] = UINT64_XOR(in[0], UINT64_AND(UINT64_COMP(in[1]), in[2]));
-		out[1] = UINT64_XOR(in[1], UINT64_AND(UINT64_COMP(in[2]), in[3]));
-		out[2] = UINT64_XOR(in[2], UINT64_AND(UINT64_COMP(in[3]), in[4]));
-		out[3] = UINT64_XOR(in[3], UINT64_AND(UINT64_COMP(in[4]), in[0]));
-		out[4] = UINT64_XOR(in[4], UINT64_AND(UINT64_COMP(in[0]), in[1]));
+	switch (digest_bits) {
+	case 224: return &sha3_mb_portable_224;
+	case 256: return &sha3_mb_portable_256;
+	case 384: return &sha3_mb_portable_384;
+	case 512: return &sha3_mb_portable_512;
 	}
+	return NULL;
 }
 
-static void iota(UINT64 *A, unsigned round)
+const struct mb_engine_s *sha3_mb_select(unsigned digest_bits)
 {
-	static const UINT64 k[] =
-	{	UINT64_INIT(0x00000000u, 0x00000001u), UINT64_INIT(0x00000000u, 0x00008082u)
-	,	UINT64_INIT(0x80000000u, 0x0000808Au), UINT64_INIT(0x80000000u, 0x80008000u)
-	,	UINT64_INIT(0x00000000u, 0x0000808Bu), UINT64_INIT(0x00000000u, 0x80000001u)
-	,	UINT64_INIT(0x80000000u, 0x80008081u), UINT64_INIT(0x80000000u, 0x00008009u)
-	,	UINT64_INIT(0x00000000u, 0x0000008Au), UINT64_INIT(0x00000000u, 0x00000088u)
-	,	UINT64_INIT(0x00000000u, 0x80008009u), UINT64_INIT(0x00000000u, 0x8000000Au)
-	,	UINT64_INIT(0x00000000u, 0x8000808Bu), UINT64_INIT(0x80000000u, 0x0000008Bu)
-	,	UINT64_INIT(0x80000000u, 0x00008089u), UINT64_INIT(0x80000000u, 0x00008003u)
-	,	UINT64_INIT(0x80000000u, 0x00008002u), UINT64_INIT(0x80000000u, 0x00000080u)
-	,	UINT64_INIT(0x00000000u, 0x0000800Au), UINT64_INIT(0x80000000u, 0x8000000Au)
-	,	UINT64_INIT(0x80000000u, 0x80008081u), UINT64_INIT(0x80000000u, 0x00008080u)
-	,	UINT64_INIT(0x00000000u, 0x80000001u), UINT64_INIT(0x80000000u, 0x80008008u)
-	};
-	A[0] = UINT64_XOR(A[0], k[round]);
+	switch (dispatch_select(&sha3_mb_dispatch)) {
+	case SHA3_MB_AVX2:
+		return sha3_mb_get_avx2(digest_bits);
+	case SHA3_MB_PORTABLE:
+		return sha3_mb_get_portable(digest_bits);
+	}
+	return NULL;
 }
 
 struct hash_pvt_s {
@@ -121,6 +447,9 @@ struct hash_pvt_s {
 	unsigned      digest_bits;
 	unsigned char buffer_data[192];
 	UINT64        state[25];
+
+	/* Multi-buffer engine for batches of messages or NULL. */
+	const struct mb_engine_s *mb;
 } spongeState;
 
 static void sha3_begin(struct hash_s *hash)
@@ -130,24 +459,6 @@ static void sha3_begin(struct hash_s *hash)
 	memset(ctx->state, 0, sizeof(ctx->state));
 }
 
-static void sha3_absorb(UINT64 *state, const unsigned char *data, size_t size)
-{
-	UINT64 buf[25];
-	unsigned elements, i;
-	assert((size & 0x7u) == 0);
-	elements = size / 8;
-	bufcvt_le64_to_UINT64(buf, data, elements);
-	for (i = 0; i < elements; i++)
-		state[i] = UINT64_XOR(state[i], buf[i]);
-	for (i = 0; i < 24; i++) {
-		theta(buf, state);
-		rho(state, buf);
-		pi(buf, state);
-		chi(state, buf);
-		iota(state, i);
-	}
-}
-
 static void sha3_process(struct hash_s *hash, const unsigned char *data, size_t size)
 {
 	struct hash_pvt_s *context = hash->state;
@@ -165,14 +476,15 @@ static void sha3_process(struct hash_s *hash, const unsigned char *data, size_t
 		data += cpy;
 		context->buffer_index += cpy;
 		if (context->buffer_index == context->buffer_length) {
-			sha3_absorb(context->state, context->buffer_data, context->buffer_length);
+			keccak_absorb(context->state, context->buffer_data, context->buffer_length / 8, 1);
 			context->buffer_index = 0;
 		}
 	}
-	while (size >= context->buffer_length) {
-		sha3_absorb(context->state, data, context->buffer_length);
-		data += context->buffer_length;
-		size -= context->buffer_length;
+	if (size >= context->buffer_length) {
+		size_t nb_blocks = size / context->buffer_length;
+		keccak_absorb(context->state, data, context->buffer_length / 8, nb_blocks);
+		data += nb_blocks * context->buffer_length;
+		size -= nb_blocks * context->buffer_length;
 	}
 	if (size) {
 		memcpy
@@ -201,12 +513,33 @@ sha3_end(struct hash_s *hash, unsigned char *result)
 		context->buffer_data[context->buffer_index++] = 0x81;
 	}
 
-	sha3_absorb(context->state, context->buffer_data, context->buffer_length);
+	keccak_absorb(context->state, context->buffer_data, context->buffer_length / 8, 1);
 
 	for (i = 0; i < context->digest_bits / 8; i++)
 		result[i] = (unsigned char)(UINT64_LOW(UINT64_SHR(context->state[i/8], 8u * (i & 0x07u))) & 0xFFu);
 }
 
+static
+void
+sha3_digest_jobs(struct hash_s *hash, struct hash_job_s *jobs, unsigned nb_jobs)
+{
+	struct hash_pvt_s *ctx = hash->state;
+	unsigned i;
+
+	if (ctx->mb != NULL) {
+		union mb_state_u iv;
+		memset(&iv, 0, sizeof(iv));
+		mb_run(ctx->mb, &iv, ctx->digest_bits, jobs, nb_jobs);
+		return;
+	}
+
+	for (i = 0; i < nb_jobs; i++) {
+		sha3_begin(hash);
+		sha3_process(hash, jobs[i].data, jobs[i].size);
+		sha3_end(hash, jobs[i].result);
+	}
+}
+
 static
 unsigned
 sha3_query_digest_size(const struct hash_s *hash)
@@ -241,11 +574,13 @@ int sha3_create(struct hash_s *hash, unsigned digest_bits)
 
 	ctx->buffer_length     = (800u - digest_bits) / 4u;
 	ctx->digest_bits       = digest_bits;
+	ctx->mb                = sha3_mb_select(digest_bits);
 
 	hash->state = ctx;
 	hash->begin = sha3_begin;
 	hash->process = sha3_process;
 	hash->end = sha3_end;
+	hash->digest_jobs = sha3_digest_jobs;
 	hash->query_digest_size = sha3_query_digest_size;
 	hash->destroy = sha3_destroy;
 
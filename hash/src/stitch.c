@@ -0,0 +1,437 @@
+/* Copyright (c) 2014, Nicholas Appleton (http://www.appletonaudio.com)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither Nicholas Appleton nor the names of its contributors may be
+ *       used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL NICHOLAS APPLETON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE. */
+
+#include "hash/stitch.h"
+#include "stitch_internal.h"
+#include "md5_internal.h"
+#include "sha1_internal.h"
+#include "sha2_256.h"
+#include "mccl/mccl_bufcvt.h"
+#include "mccl/mccl_cpuid.h"
+#include "hash/dispatch.h"
+#include <assert.h>
+
+/* The SHA extension kernels load the SHA-256 round constants straight out of
+ * the table so they need mccl_uif32 to be exactly 32 bits. */
+#if defined(MCCL_CPUID_X86) && defined(UIF32_SIZE) && (UIF32_SIZE == 4) && defined(UIF32_UNPADDED)
+#define STITCH_SHANI (1)
+#define STITCH_SHANI_BUILT (1)
+#include <immintrin.h>
+#else
+#define STITCH_SHANI_BUILT (0)
+#endif
+
+/* Every kernel is made of sixteen slices per block. A slice is four steps of
+ * MD5 followed by five rounds of SHA-1 and four rounds of SHA-256 (or a
+ * quarter of a round group when the SHA extensions are used). The working
+ * variables of each algorithm live in small arrays which are only indexed
+ * by constants so that they stay in registers and the names rotate by
+ * indexing rather than by moving values.
+ *
+ * Each algorithm supplies _DECL, _LOAD, _BEGIN, _SLICE, _END and _STORE
+ * macros which are pasted together by STITCH_KERNEL(). */
+
+#define ROL32(x, c)  (((x) << (c)) | (((x) & 0xFFFFFFFFu) >> (32 - (c))))
+#define ROR32(x, c)  (((x) << (32 - (c))) | (((x) & 0xFFFFFFFFu) >> (c)))
+
+/* MD5 */
+
+static const unsigned char md5_s[4][4] =
+	{	{7, 12, 17, 22}
+	,	{5,  9, 14, 20}
+	,	{4, 11, 16, 23}
+	,	{6, 10, 15, 21}
+	};
+
+#define MD5_V(i, j) m5[((j) - (i)) & 3]
+
+#define MD5_FN(i, b, c, d) \
+	(((i) < 16) ? ((d) ^ ((b) & ((c) ^ (d)))) : \
+	 ((i) < 32) ? ((c) ^ ((d) & ((b) ^ (c)))) : \
+	 ((i) < 48) ? ((b) ^ (c) ^ (d)) : \
+	              ((c) ^ ((b) | ~(d))))
+
+#define MD5_X(i) \
+	(((i) < 16) ? (i) : \
+	 ((i) < 32) ? ((5 * (i) + 1) & 15) : \
+	 ((i) < 48) ? ((3 * (i) + 5) & 15) : \
+	              ((7 * (i)) & 15))
+
+#define MD5_STEP(i) \
+	do { \
+		mccl_uif32 t_ = MD5_V(i, 0) + MD5_FN(i, MD5_V(i, 1), MD5_V(i, 2), MD5_V(i, 3)) + md5_k[i] + x5[MD5_X(i)]; \
+		MD5_V(i, 0) = MD5_V(i, 1) + ROL32(t_, md5_s[(i) >> 4][(i) & 3]); \
+	} while (0)
+
+#define MD5_DECL       mccl_uif32 m5[4], x5[16];
+#define MD5_LOAD
+#define MD5_BEGIN \
+	bufcvt_le32_to_uif32(x5, data, 16); \
+	m5[0] = md5[0]; m5[1] = md5[1]; m5[2] = md5[2]; m5[3] = md5[3];
+#define MD5_SLICE(k) \
+	MD5_STEP(4 * (k) + 0); MD5_STEP(4 * (k) + 1); \
+	MD5_STEP(4 * (k) + 2); MD5_STEP(4 * (k) + 3);
+#define MD5_END \
+	md5[0] += m5[0]; md5[1] += m5[1]; md5[2] += m5[2]; md5[3] += m5[3];
+#define MD5_STORE
+
+/* SHA-1 */
+
+#define SHA1_V(t, j) v1[((j) + 80 - (t)) % 5]
+
+#define SHA1_FN(t, b, c, d) \
+	(((t) < 20) ? ((d) ^ ((b) & ((c) ^ (d)))) : \
+	 (((t) < 40) || ((t) >= 60)) ? ((b) ^ (c) ^ (d)) : \
+	              (((b) & (c)) | ((d) & ((b) | (c)))))
+
+#define SHA1_K(t) \
+	(((t) < 20) ? 0x5A827999u : ((t) < 40) ? 0x6ED9EBA1u : ((t) < 60) ? 0x8F1BBCDCu : 0xCA62C1D6u)
+
+#define SHA1_ROUND(t) \
+	do { \
+		if ((t) >= 16) \
+			w1[(t) & 15] = ROL32(w1[((t) - 3) & 15] ^ w1[((t) - 8) & 15] ^ w1[((t) - 14) & 15] ^ w1[(t) & 15], 1); \
+		SHA1_V(t, 4) += ROL32(SHA1_V(t, 0), 5) + SHA1_FN(t, SHA1_V(t, 1), SHA1_V(t, 2), SHA1_V(t, 3)) + w1[(t) & 15] + SHA1_K(t); \
+		SHA1_V(t, 1) = ROL32(SHA1_V(t, 1), 30); \
+	} while (0)
+
+#define SHA1_DECL      mccl_uif32 v1[5], w1[16];
+#define SHA1_LOAD
+#define SHA1_BEGIN \
+	bufcvt_be32_to_uif32(w1, data, 16); \
+	v1[0] = sha1[0]; v1[1] = sha1[1]; v1[2] = sha1[2]; v1[3] = sha1[3]; v1[4] = sha1[4];
+#define SHA1_SLICE(k) \
+	SHA1_ROUND(5 * (k) + 0); SHA1_ROUND(5 * (k) + 1); SHA1_ROUND(5 * (k) + 2); \
+	SHA1_ROUND(5 * (k) + 3); SHA1_ROUND(5 * (k) + 4);
+#define SHA1_END \
+	sha1[0] += v1[0]; sha1[1] += v1[1]; sha1[2] += v1[2]; sha1[3] += v1[3]; sha1[4] += v1[4];
+#define SHA1_STORE
+
+/* SHA-256. Unlike SHA-1, the schedule is expanded in full at the start of
+ * each block: computing it in the rounds leaves too many values live next to
+ * MD5 and was measurably slower. */
+
+#define CH(x, y, z)  (((x) & (y)) ^ ((z) & ~(x)))
+#define MAJ(x, y, z) (((x) & (y)) ^ ((x) & (z)) ^ ((y) & (z)))
+#define BSIG0(x)     (ROR32(x, 2) ^  ROR32(x, 13) ^ ROR32(x, 22))
+#define BSIG1(x)     (ROR32(x, 6) ^  ROR32(x, 11) ^ ROR32(x, 25))
+#define SSIG0(x)     (ROR32(x, 7) ^  ROR32(x, 18) ^ (((x) & 0xFFFFFFFFu) >> 3))
+#define SSIG1(x)     (ROR32(x, 17) ^ ROR32(x, 19) ^ (((x) & 0xFFFFFFFFu) >> 10))
+
+#define SHA256_V(t, j) v2[((j) - (t)) & 7]
+
+#define SHA256_ROUND(t) \
+	do { \
+		mccl_uif32 t1_; \
+		t1_ = SHA256_V(t, 7) + BSIG1(SHA256_V(t, 4)) + CH(SHA256_V(t, 4), SHA256_V(t, 5), SHA256_V(t, 6)) + sha256_table[t] + w2[t]; \
+		SHA256_V(t, 3) += t1_; \
+		SHA256_V(t, 7)  = t1_ + BSIG0(SHA256_V(t, 0)) + MAJ(SHA256_V(t, 0), SHA256_V(t, 1), SHA256_V(t, 2)); \
+	} while (0)
+
+#define SHA256_DECL    mccl_uif32 v2[8], w2[64]; unsigned j2;
+#define SHA256_LOAD
+#define SHA256_BEGIN \
+	bufcvt_be32_to_uif32(w2, data, 16); \
+	for (j2 = 16; j2 < 64; j2++) \
+		w2[j2] = SSIG1(w2[j2 - 2]) + w2[j2 - 7] + SSIG0(w2[j2 - 15]) + w2[j2 - 16]; \
+	v2[0] = sha256[0]; v2[1] = sha256[1]; v2[2] = sha256[2]; v2[3] = sha256[3]; \
+	v2[4] = sha256[4]; v2[5] = sha256[5]; v2[6] = sha256[6]; v2[7] = sha256[7];
+#define SHA256_SLICE(k) \
+	SHA256_ROUND(4 * (k) + 0); SHA256_ROUND(4 * (k) + 1); \
+	SHA256_ROUND(4 * (k) + 2); SHA256_ROUND(4 * (k) + 3);
+#define SHA256_END \
+	sha256[0] += v2[0]; sha256[1] += v2[1]; sha256[2] += v2[2]; sha256[3] += v2[3]; \
+	sha256[4] += v2[4]; sha256[5] += v2[5]; sha256[6] += v2[6]; sha256[7] += v2[7];
+#define SHA256_STORE
+
+#ifdef STITCH_SHANI
+
+/* SHA-1 with the SHA extensions. Each sha1rnds4 performs four rounds so the
+ * twenty of them are spread over the sixteen slices by doing two in every
+ * fourth slice. The schedule and the use of sha1nexte follow
+ * sha1_process_blocks_shani(). */
+
+#define SHA1NI_QUAD(q) \
+	do { \
+		if ((q) < 4) \
+			s1w[(q) & 3] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 16 * (q))), s1bswap); \
+		else \
+			s1w[(q) & 3] = _mm_sha1msg2_epu32(_mm_xor_si128(_mm_sha1msg1_epu32(s1w[(q) & 3], s1w[((q) + 1) & 3]), s1w[((q) + 2) & 3]), s1w[((q) + 3) & 3]); \
+		s1e    = ((q) == 0) ? _mm_add_epi32(s1e0, s1w[0]) : _mm_sha1nexte_epu32(s1prev, s1w[(q) & 3]); \
+		s1prev = s1abcd; \
+		s1abcd = _mm_sha1rnds4_epu32(s1abcd, s1e, (q) / 5); \
+	} while (0)
+
+#define SHA1NI_DECL \
+	const __m128i s1bswap = _mm_set_epi64x(0x0001020304050607ll, 0x08090A0B0C0D0E0Fll); \
+	__m128i s1abcd, s1e0, s1abcd_save, s1e0_save, s1e, s1prev, s1w[4];
+#define SHA1NI_LOAD \
+	s1abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)sha1), 0x1B); \
+	s1e0   = _mm_set_epi32((int)sha1[4], 0, 0, 0);
+#define SHA1NI_BEGIN \
+	s1abcd_save = s1abcd; \
+	s1e0_save   = s1e0;
+#define SHA1NI_SLICE(k) \
+	SHA1NI_QUAD((5 * (k)) / 4); \
+	if ((5 * (k) + 5) / 4 - (5 * (k)) / 4 == 2) \
+		SHA1NI_QUAD((5 * (k)) / 4 + 1);
+#define SHA1NI_END \
+	s1e0   = _mm_sha1nexte_epu32(s1prev, s1e0_save); \
+	s1abcd = _mm_add_epi32(s1abcd, s1abcd_save);
+#define SHA1NI_STORE \
+	_mm_storeu_si128((__m128i *)sha1, _mm_shuffle_epi32(s1abcd, 0x1B)); \
+	sha1[4] = (mccl_uif32)_mm_extract_epi32(s1e0, 3);
+
+/* SHA-256 with the SHA extensions: one slice is one iteration of the round
+ * loop of sha2_256_process_blocks_shani(). */
+
+#define SHA256NI_DECL \
+	const __m128i s2bswap = _mm_set_epi64x(0x0C0D0E0F08090A0Bll, 0x0405060700010203ll); \
+	__m128i s2st0, s2st1, s2save0, s2save1, s2w[4], s2msg;
+#define SHA256NI_LOAD \
+	s2msg = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)(sha256 + 0)), 0xB1); \
+	s2st1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)(sha256 + 4)), 0x1B); \
+	s2st0 = _mm_alignr_epi8(s2msg, s2st1, 8); \
+	s2st1 = _mm_blend_epi16(s2st1, s2msg, 0xF0);
+#define SHA256NI_BEGIN \
+	s2save0 = s2st0; \
+	s2save1 = s2st1;
+#define SHA256NI_SLICE(i) \
+	do { \
+		if ((i) < 4) { \
+			s2w[(i) & 3] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 16 * (i))), s2bswap); \
+		} else { \
+			s2msg = _mm_add_epi32(_mm_sha256msg1_epu32(s2w[(i) & 3], s2w[((i) + 1) & 3]), _mm_alignr_epi8(s2w[((i) + 3) & 3], s2w[((i) + 2) & 3], 4)); \
+			s2w[(i) & 3] = _mm_sha256msg2_epu32(s2msg, s2w[((i) + 3) & 3]); \
+		} \
+		s2msg = _mm_add_epi32(s2w[(i) & 3], _mm_loadu_si128((const __m128i *)(sha256_table + 4 * (i)))); \
+		s2st1 = _mm_sha256rnds2_epu32(s2st1, s2st0, s2msg); \
+		s2msg = _mm_shuffle_epi32(s2msg, 0x0E); \
+		s2st0 = _mm_sha256rnds2_epu32(s2st0, s2st1, s2msg); \
+	} while (0);
+#define SHA256NI_END \
+	s2st0 = _mm_add_epi32(s2st0, s2save0); \
+	s2st1 = _mm_add_epi32(s2st1, s2save1);
+#define SHA256NI_STORE \
+	s2msg = _mm_shuffle_epi32(s2st0, 0x1B); \
+	s2st1 = _mm_shuffle_epi32(s2st1, 0xB1); \
+	_mm_storeu_si128((__m128i *)(sha256 + 0), _mm_blend_epi16(s2msg, s2st1, 0xF0)); \
+	_mm_storeu_si128((__m128i *)(sha256 + 4), _mm_alignr_epi8(s2st1, s2msg, 8));
+
+#endif
+
+/* Stands in for an algorithm which is not part of a kernel. */
+#define NONE_DECL
+#define NONE_LOAD
+#define NONE_BEGIN
+#define NONE_SLICE(k)
+#define NONE_END
+#define NONE_STORE
+
+#define STITCH_SLICE(k, p1, p2) \
+	MD5_SLICE(k) \
+	p1##_SLICE(k) \
+	p2##_SLICE(k)
+
+#define STITCH_KERNEL(name, p1, p2) \
+static \
+void \
+name(mccl_uif32 *md5, mccl_uif32 *sha1, mccl_uif32 *sha256, const unsigned char *data, size_t nb_blocks) \
+{ \
+	MD5_DECL \
+	p1##_DECL \
+	p2##_DECL \
+	MD5_LOAD \
+	p1##_LOAD \
+	p2##_LOAD \
+	for (; nb_blocks; nb_blocks--, data += 64) { \
+		MD5_BEGIN \
+		p1##_BEGIN \
+		p2##_BEGIN \
+		STITCH_SLICE(0, p1, p2)  STITCH_SLICE(1, p1, p2) \
+		STITCH_SLICE(2, p1, p2)  STITCH_SLICE(3, p1, p2) \
+		STITCH_SLICE(4, p1, p2)  STITCH_SLICE(5, p1, p2) \
+		STITCH_SLICE(6, p1, p2)  STITCH_SLICE(7, p1, p2) \
+		STITCH_SLICE(8, p1, p2)  STITCH_SLICE(9, p1, p2) \
+		STITCH_SLICE(10, p1, p2) STITCH_SLICE(11, p1, p2) \
+		STITCH_SLICE(12, p1, p2) STITCH_SLICE(13, p1, p2) \
+		STITCH_SLICE(14, p1, p2) STITCH_SLICE(15, p1, p2) \
+		MD5_END \
+		p1##_END \
+		p2##_END \
+	} \
+	MD5_STORE \
+	p1##_STORE \
+	p2##_STORE \
+}
+
+STITCH_KERNEL(stitch_md5_sha1_portable, SHA1, NONE)
+STITCH_KERNEL(stitch_md5_sha256_portable, SHA256, NONE)
+STITCH_KERNEL(stitch_md5_sha1_sha256_portable, SHA1, SHA256)
+
+#ifdef STITCH_SHANI
+
+__attribute__((target("sha,ssse3,sse4.1")))
+STITCH_KERNEL(stitch_md5_sha1_shani, SHA1NI, NONE)
+__attribute__((target("sha,ssse3,sse4.1")))
+STITCH_KERNEL(stitch_md5_sha256_shani, SHA256NI, NONE)
+__attribute__((target("sha,ssse3,sse4.1")))
+STITCH_KERNEL(stitch_md5_sha1_sha256_shani, SHA1NI, SHA256NI)
+
+#endif
+
+enum {
+	STITCH_KERNEL_SHANI,
+	STITCH_KERNEL_PORTABLE,
+	STITCH_KERNEL_OFF
+};
+
+static const struct dispatch_kernel_s stitch_kernels[] =
+{	{"shani", MCCL_CPU_SHA | MCCL_CPU_SSSE3 | MCCL_CPU_SSE41, STITCH_SHANI_BUILT}
+,	{"portable", 0, 1}
+,	{"off", 0, 1}
+};
+
+const struct dispatch_slot_s stitch_dispatch =
+{	"stitch", "MD5 stitched with SHA-1/SHA-256", stitch_kernels, 3
+};
+
+stitch_blocks_fn stitch_get_shani(unsigned roles)
+{
+#ifdef STITCH_SHANI
+	if (dispatch_usable(&stitch_kernels[STITCH_KERNEL_SHANI])) {
+		switch (roles & (STITCH_SHA1 | STITCH_SHA256)) {
+		case STITCH_SHA1:
+			return stitch_md5_sha1_shani;
+		case STITCH_SHA256:
+			return stitch_md5_sha256_shani;
+		case STITCH_SHA1 | STITCH_SHA256:
+			return stitch_md5_sha1_sha256_shani;
+		}
+	}
+#endif
+	return NULL;
+}
+
+stitch_blocks_fn stitch_get_portable(unsigned roles)
+{
+	switch (roles & (STITCH_SHA1 | STITCH_SHA256)) {
+	case STITCH_SHA1:
+		return stitch_md5_sha1_portable;
+	case STITCH_SHA256:
+		return stitch_md5_sha256_portable;
+	case STITCH_SHA1 | STITCH_SHA256:
+		return stitch_md5_sha1_sha256_portable;
+	}
+	return NULL;
+}
+
+stitch_blocks_fn stitch_select(unsigned roles)
+{
+	switch (dispatch_select(&stitch_dispatch)) {
+	case STITCH_KERNEL_SHANI:
+		return stitch_get_shani(roles);
+	case STITCH_KERNEL_PORTABLE:
+		return stitch_get_portable(roles);
+	}
+	return NULL;
+}
+
+unsigned stitch_role(struct hash_s *hash)
+{
+	if (md5_stitch_state(hash, NULL) != NULL)
+		return STITCH_MD5;
+	if (sha1_stitch_state(hash, NULL) != NULL)
+		return STITCH_SHA1;
+	if (sha2_stitch_state(hash, NULL) != NULL)
+		return STITCH_SHA256;
+	return 0;
+}
+
+/* Feeds the data to each of the objects on their own. */
+static
+void
+stitch_each
+	(struct hash_s       *md5
+	,struct hash_s       *sha1
+	,struct hash_s       *sha256
+	,const unsigned char *data
+	,size_t               size
+	)
+{
+	md5->process(md5, data, size);
+	if (sha1 != NULL)
+		sha1->process(sha1, data, size);
+	if (sha256 != NULL)
+		sha256->process(sha256, data, size);
+}
+
+void
+stitch_process
+	(struct hash_s       *md5
+	,struct hash_s       *sha1
+	,struct hash_s       *sha256
+	,const unsigned char *data
+	,size_t               size
+	)
+{
+	unsigned roles = ((sha1 != NULL) ? STITCH_SHA1 : 0) | ((sha256 != NULL) ? STITCH_SHA256 : 0);
+	unsigned buffered;
+	size_t nb_blocks;
+	stitch_blocks_fn fn = (roles) ? stitch_select(roles) : NULL;
+	mccl_uif32 *state = md5_stitch_state(md5, &buffered);
+
+	assert(state != NULL);
+
+	/* The objects have all seen the same data so they are all holding the
+	 * same number of bytes of an incomplete block. Complete it first. */
+	if (buffered) {
+		size_t cpy = 64 - buffered;
+		if (cpy > size)
+			cpy = size;
+		stitch_each(md5, sha1, sha256, data, cpy);
+		data += cpy;
+		size -= cpy;
+	}
+
+	nb_blocks = size / 64;
+	if (nb_blocks && fn != NULL) {
+		mccl_uif32 *s1 = (sha1 != NULL) ? sha1_stitch_state(sha1, NULL) : NULL;
+		mccl_uif32 *s2 = (sha256 != NULL) ? sha2_stitch_state(sha256, NULL) : NULL;
+		assert(((sha1 == NULL) || (s1 != NULL)) && ((sha256 == NULL) || (s2 != NULL)));
+		fn(state, s1, s2, data, nb_blocks);
+		md5_stitch_advance(md5, nb_blocks);
+		if (sha1 != NULL)
+			sha1_stitch_advance(sha1, nb_blocks);
+		if (sha256 != NULL)
+			sha2_stitch_advance(sha256, nb_blocks);
+		data += 64 * nb_blocks;
+		size -= 64 * nb_blocks;
+	}
+
+	if (size)
+		stitch_each(md5, sha1, sha256, data, size);
+}
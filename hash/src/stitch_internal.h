@@ -0,0 +1,49 @@
+/* Copyright (c) 2014, Nicholas Appleton (http://www.appletonaudio.com)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither Nicholas Appleton nor the names of its contributors may be
+ *       used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL NICHOLAS APPLETON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE. */
+
+#ifndef STITCH_INTERNAL_H
+#define STITCH_INTERNAL_H
+
+#include "mccl/mccl_fastints.h"
+#include <stddef.h>
+
+/* Compresses nb_blocks consecutive 64 byte blocks into the MD5 chaining
+ * value and the SHA-1 and/or SHA-256 ones. Kernels which do not stitch one
+ * of the latter ignore its argument. */
+typedef void (*stitch_blocks_fn)(mccl_uif32 *md5, mccl_uif32 *sha1, mccl_uif32 *sha256, const unsigned char *data, size_t nb_blocks);
+
+/* Return the kernel for MD5 together with the algorithms given in roles
+ * (STITCH_SHA1 and/or STITCH_SHA256). The SHA extension kernel is NULL if
+ * the processor does not support them or they were not compiled in. */
+stitch_blocks_fn stitch_get_shani(unsigned roles);
+stitch_blocks_fn stitch_get_portable(unsigned roles);
+
+/* Returns the kernel picked by the "stitch" dispatch slot, or NULL if
+ * stitching has been switched off in which case the blocks go through each
+ * object on its own. */
+stitch_blocks_fn stitch_select(unsigned roles);
+
+#endif
@@ -33,7 +33,13 @@
 #include "tiger_coefs.h"
 #include "tiger_internal.h"
 
+static const UINT64 initial_hash[3] = {
+		UINT64_INIT(0x01234567u, 0x89ABCDEFu),
+		UINT64_INIT(0xFEDCBA98u, 0x76543210u),
+		UINT64_INIT(0xF096A5B4u, 0xC3B2E187u) };
+
 struct hash_pvt_s {
+	const struct mb_engine_s *mb;
 	UINT64          hash[3];
 	UINT64          length;
 	unsigned char   work[64];
@@ -44,10 +50,6 @@ static
 void
 tiger_begin(struct hash_s *hash)
 {
-	static const UINT64 initial_hash[3] = {
-			UINT64_INIT(0x01234567u, 0x89ABCDEFu),
-			UINT64_INIT(0xFEDCBA98u, 0x76543210u),
-			UINT64_INIT(0xF096A5B4u, 0xC3B2E187u) };
 	hash->state->hash[0] = initial_hash[0];
 	hash->state->hash[1] = initial_hash[1];
 	hash->state->hash[2] = initial_hash[2];
@@ -141,6 +143,29 @@ tiger_end(struct hash_s *hash, unsigned char *raw_data)
 	}
 }
 
+static
+void
+tiger_digest_jobs(struct hash_s *hash, struct hash_job_s *jobs, unsigned nb_jobs)
+{
+	unsigned i;
+
+	if (hash->state->mb != NULL) {
+		union mb_state_u iv;
+		memset(&iv, 0, sizeof(iv));
+		iv.w64[0] = initial_hash[0];
+		iv.w64[1] = initial_hash[1];
+		iv.w64[2] = initial_hash[2];
+		mb_run(hash->state->mb, &iv, 24*8, jobs, nb_jobs);
+		return;
+	}
+
+	for (i = 0; i < nb_jobs; i++) {
+		tiger_begin(hash);
+		tiger_process(hash, jobs[i].data, jobs[i].size);
+		tiger_end(hash, jobs[i].result);
+	}
+}
+
 static
 void
 tiger_destroy(struct hash_s *tiger)
@@ -160,6 +185,7 @@ tiger_create(struct hash_s *tiger)
 {
 	tiger->begin = tiger_begin;
 	tiger->end = tiger_end;
+	tiger->digest_jobs = tiger_digest_jobs;
 	tiger->process = tiger_process;
 	tiger->destroy = tiger_destroy;
 	tiger->query_digest_size = tiger_query_digest_size;
@@ -167,6 +193,7 @@ tiger_create(struct hash_s *tiger)
 	if (!tiger->state)
 		return 1;
 	memset(tiger->state, 0, sizeof(struct hash_pvt_s));
+	tiger->state->mb = tiger_mb_select();
 	return 0;
 }
 
@@ -27,6 +27,8 @@
 #include "tiger_internal.h"
 #include "tiger_coefs.h"
 #include "mccl/mccl_inline.h"
+#include "mccl/mccl_bufcvt.h"
+#include "hash/dispatch.h"
 #include <string.h>
 
 #define TIGER_PASSES (3)
@@ -127,3 +129,199 @@ tiger_compress(UINT64 *aa, UINT64 *bb, UINT64 *cc, UINT64 *str)
 	*cc = UINT64_ADD(c, *cc);
 }
 
+/* The interleaved variants below run each round over every state before
+ * moving on to the next round. A single Tiger state spends most of its time
+ * waiting on S-box loads whose addresses depend on the previous round; the
+ * rounds of independent states have no such dependency between them, so
+ * their loads overlap. */
+
+#define tiger_round_n(n, a, b, c, str, i, mul) \
+		do { \
+		unsigned l_; \
+		for (l_ = 0; l_ < (n); l_++) \
+			tiger_round(a[l_], b[l_], c[l_], str[l_][i], mul); } while (0)
+
+#define tiger_pass_n(n, a, b, c, str, mul) \
+		do { \
+		tiger_round_n(n, a, b, c, str, 0, mul); \
+		tiger_round_n(n, b, c, a, str, 1, mul); \
+		tiger_round_n(n, c, a, b, str, 2, mul); \
+		tiger_round_n(n, a, b, c, str, 3, mul); \
+		tiger_round_n(n, b, c, a, str, 4, mul); \
+		tiger_round_n(n, c, a, b, str, 5, mul); \
+		tiger_round_n(n, a, b, c, str, 6, mul); \
+		tiger_round_n(n, b, c, a, str, 7, mul); } while (0)
+
+#define tiger_schedule_n(n, str) \
+		do { \
+		unsigned l_; \
+		for (l_ = 0; l_ < (n); l_++) \
+			tiger_schedule(str[l_]); } while (0)
+
+#define TIGER_COMPRESS_N(name, n) \
+void \
+name(UINT64 *const *hash, UINT64 (*str)[8]) \
+{ \
+	UINT64 a[n]; \
+	UINT64 b[n]; \
+	UINT64 c[n]; \
+	unsigned i, l; \
+	for (l = 0; l < (n); l++) { \
+		a[l] = hash[l][0]; \
+		b[l] = hash[l][1]; \
+		c[l] = hash[l][2]; \
+	} \
+	tiger_pass_n(n, a, b, c, str, 5); \
+	tiger_schedule_n(n, str); \
+	tiger_pass_n(n, c, a, b, str, 7); \
+	tiger_schedule_n(n, str); \
+	tiger_pass_n(n, b, c, a, str, 9); \
+	for (i = 3u; i < TIGER_PASSES; i++) { \
+		tiger_schedule_n(n, str); \
+		tiger_pass_n(n, a, b, c, str, 9); \
+		for (l = 0; l < (n); l++) { \
+			UINT64 tmp = a[l]; \
+			a[l] = c[l]; \
+			c[l] = b[l]; \
+			b[l] = tmp; \
+		} \
+	} \
+	for (l = 0; l < (n); l++) { \
+		hash[l][0] = UINT64_XOR(a[l], hash[l][0]); \
+		hash[l][1] = UINT64_SUB(b[l], hash[l][1]); \
+		hash[l][2] = UINT64_ADD(c[l], hash[l][2]); \
+	} \
+}
+
+TIGER_COMPRESS_N(tiger_compress_x2, 2)
+TIGER_COMPRESS_N(tiger_compress_x4, 4)
+
+#undef TIGER_COMPRESS_N
+#undef tiger_schedule_n
+#undef tiger_pass_n
+#undef tiger_round_n
+
+/* Multi-buffer kernels. The lanes of these engines are the independent
+ * states of the interleaved compression functions above rather than SIMD
+ * lanes. */
+
+static
+void
+tiger_mb_single(union mb_state_u *state, const unsigned char *data, size_t nb_blocks)
+{
+	UINT64 str[8];
+	for (; nb_blocks; nb_blocks--, data += 64) {
+		bufcvt_le64_to_UINT64(str, data, 8);
+		tiger_compress(state->w64, state->w64 + 1, state->w64 + 2, str);
+	}
+}
+
+static
+void
+tiger_mb_x2(union mb_state_u *const *state, const unsigned char *const *data, size_t nb_blocks)
+{
+	UINT64 *const hash[2] = {state[0]->w64, state[1]->w64};
+	UINT64 str[2][8];
+	size_t offset;
+	for (offset = 0; nb_blocks; nb_blocks--, offset += 64) {
+		bufcvt_le64_to_UINT64(str[0], data[0] + offset, 8);
+		bufcvt_le64_to_UINT64(str[1], data[1] + offset, 8);
+		tiger_compress_x2(hash, str);
+	}
+}
+
+static
+void
+tiger_mb_x4(union mb_state_u *const *state, const unsigned char *const *data, size_t nb_blocks)
+{
+	UINT64 *const hash[4] = {state[0]->w64, state[1]->w64, state[2]->w64, state[3]->w64};
+	UINT64 str[4][8];
+	size_t offset;
+	for (offset = 0; nb_blocks; nb_blocks--, offset += 64) {
+		bufcvt_le64_to_UINT64(str[0], data[0] + offset, 8);
+		bufcvt_le64_to_UINT64(str[1], data[1] + offset, 8);
+		bufcvt_le64_to_UINT64(str[2], data[2] + offset, 8);
+		bufcvt_le64_to_UINT64(str[3], data[3] + offset, 8);
+		tiger_compress_x4(hash, str);
+	}
+}
+
+static
+void
+tiger_mb_blocks(union mb_state_u *const *state, const unsigned char *const *data, size_t nb_blocks)
+{
+	tiger_mb_single(state[0], data[0], nb_blocks);
+}
+
+static
+void
+tiger_mb_store(const union mb_state_u *state, unsigned char *result, unsigned digest_bits)
+{
+	unsigned i;
+	for (i = 0; i < digest_bits / 8; i++)
+		result[i] = (unsigned char)(UINT64_LOW(UINT64_SHR(state->w64[i/8], 8u * (i & 0x07u))) & 0xFFu);
+}
+
+static const struct mb_engine_s tiger_mb_engine_x4 =
+{	"x4", 4, 64, 8, 0, 0x01, 0x00
+,	tiger_mb_x4, tiger_mb_single, tiger_mb_store
+};
+
+static const struct mb_engine_s tiger_mb_engine_x2 =
+{	"x2", 2, 64, 8, 0, 0x01, 0x00
+,	tiger_mb_x2, tiger_mb_single, tiger_mb_store
+};
+
+static const struct mb_engine_s tiger_mb_engine_portable =
+{	"portable", 1, 64, 8, 0, 0x01, 0x00
+,	tiger_mb_blocks, tiger_mb_single, tiger_mb_store
+};
+
+const struct mb_engine_s *tiger_mb_get_x4(void)
+{
+	return &tiger_mb_engine_x4;
+}
+
+const struct mb_engine_s *tiger_mb_get_x2(void)
+{
+	return &tiger_mb_engine_x2;
+}
+
+const struct mb_engine_s *tiger_mb_get_portable(void)
+{
+	return &tiger_mb_engine_portable;
+}
+
+enum {
+	TIGER_MB_X2,
+	TIGER_MB_X4,
+	TIGER_MB_PORTABLE,
+	TIGER_MB_SERIAL
+};
+
+/* The four way variant needs twelve state words live across a round which
+ * does not fit in the general purpose registers of x86-64; two states fit
+ * and are the faster choice there. */
+static const struct dispatch_kernel_s tiger_mb_kernels[] =
+{	{"x2", 0, 1}
+,	{"x4", 0, 1}
+,	{"portable", 0, 1}
+,	{"serial", 0, 1}
+};
+
+const struct dispatch_slot_s tiger_mb_dispatch =
+{	"tiger.mb", "Tiger batches of messages", tiger_mb_kernels, 4
+};
+
+const struct mb_engine_s *tiger_mb_select(void)
+{
+	switch (dispatch_select(&tiger_mb_dispatch)) {
+	case TIGER_MB_X2:
+		return tiger_mb_get_x2();
+	case TIGER_MB_X4:
+		return tiger_mb_get_x4();
+	case TIGER_MB_PORTABLE:
+		return tiger_mb_get_portable();
+	}
+	return NULL;
+}
@@ -28,10 +28,27 @@
 #define TIGER_INTERNAL_H
 
 #include "mccl/mccl_op_uint64.h"
+#include "multibuf.h"
 
 /* str is the input buffer and contains 16 UINT64 values. The input is used as
  * scratch and will be mangled after the function is called. */
 void tiger_compress(UINT64 *aa, UINT64 *bb, UINT64 *cc, UINT64 *str);
 
+/* As tiger_compress() but for two or four independent states, advanced in
+ * lockstep. hash[i] points to the three words of state i and str[i] is its
+ * input (which is mangled in the same way). */
+void tiger_compress_x2(UINT64 *const *hash, UINT64 (*str)[8]);
+void tiger_compress_x4(UINT64 *const *hash, UINT64 (*str)[8]);
+
+/* Multi-buffer engines built on the interleaved compression functions. The
+ * portable engine hashes one message at a time. The state of a message is
+ * held in the first three words of w64. */
+const struct mb_engine_s *tiger_mb_get_x4(void);
+const struct mb_engine_s *tiger_mb_get_x2(void);
+const struct mb_engine_s *tiger_mb_get_portable(void);
+
+/* Returns the multi-buffer engine to use for batches of messages. */
+const struct mb_engine_s *tiger_mb_select(void);
+
 #endif
 
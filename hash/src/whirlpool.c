@@ -30,63 +30,95 @@
 #include <assert.h>
 #include <stdlib.h>
 
-static void whirlpool_round(UINT64 *state, UINT64 *k, UINT64 salt)
-{
-	UINT64 l[8];
-	unsigned i;
-
-	for (i = 0; i < 8; i++)
-	{
-		unsigned t;
-		l[i] = UINT64_MAKE(0, 0);
-		for (t = 0; t < 8; t++)
-			l[i] =
-				UINT64_XOR
-					(l[i]
-					,whirlpool_sboxes[t][UINT64_LOW(UINT64_SHR(k[(i - t) & 7], 56 - t * 8)) & 0xFFu]
-					);
-	}
-
-	l[0] = k[0] = UINT64_XOR(l[0], salt);
-	for (i = 1; i < 8; i++)
-		k[i] = l[i];
-
-	for (i = 0; i < 8; i++) {
-		unsigned t;
-		for (t = 0; t < 8; t++)
-			l[i] =
-				UINT64_XOR
-					(l[i]
-					,whirlpool_sboxes[t][UINT64_LOW(UINT64_SHR(state[(i - t) & 7], 56 - t * 8)) & 0xFFu]
-					);
-	}
-
-	for (i = 0; i < 8; i++)
-		state[i] = l[i];
-}
+/* Byte t (0 being the most significant) of x. t is always a constant so
+ * this reduces to a single shift and mask; splitting on the half of the
+ * word avoids 64-bit shifts when UINT64 is not a native type. */
+#define WP_BYTE(x, t) \
+	((unsigned)(((t) < 4 \
+		? UINT64_HIGH(x) >> (24 - 8 * (t)) \
+		: UINT64_LOW(x) >> (56 - 8 * (t))) & 0xFFu))
+
+#define WP_T(t, x) whirlpool_sboxes[t][WP_BYTE(x, t)]
+
+/* One row of the combined SubBytes/ShiftColumns/MixRows step. The XORs are
+ * paired up so the eight lookups form a tree rather than a chain. */
+#define WP_ROW(a0, a1, a2, a3, a4, a5, a6, a7) \
+	UINT64_XOR \
+		(UINT64_XOR(UINT64_XOR(WP_T(0, a0), WP_T(1, a1)), UINT64_XOR(WP_T(2, a2), WP_T(3, a3))) \
+		,UINT64_XOR(UINT64_XOR(WP_T(4, a4), WP_T(5, a5)), UINT64_XOR(WP_T(6, a6), WP_T(7, a7))) \
+		)
+
+/* Rows of the key schedule and of the state are computed side by side: the
+ * two sets of lookups are independent, which gives the processor sixteen
+ * loads to overlap rather than eight. */
+#define WP_ROUND(salt) \
+	do { \
+		UINT64 n0, n1, n2, n3, n4, n5, n6, n7; \
+		UINT64 m0, m1, m2, m3, m4, m5, m6, m7; \
+		n0 = UINT64_XOR(WP_ROW(k0, k7, k6, k5, k4, k3, k2, k1), salt); \
+		m0 = WP_ROW(s0, s7, s6, s5, s4, s3, s2, s1); \
+		n1 = WP_ROW(k1, k0, k7, k6, k5, k4, k3, k2); \
+		m1 = WP_ROW(s1, s0, s7, s6, s5, s4, s3, s2); \
+		n2 = WP_ROW(k2, k1, k0, k7, k6, k5, k4, k3); \
+		m2 = WP_ROW(s2, s1, s0, s7, s6, s5, s4, s3); \
+		n3 = WP_ROW(k3, k2, k1, k0, k7, k6, k5, k4); \
+		m3 = WP_ROW(s3, s2, s1, s0, s7, s6, s5, s4); \
+		n4 = WP_ROW(k4, k3, k2, k1, k0, k7, k6, k5); \
+		m4 = WP_ROW(s4, s3, s2, s1, s0, s7, s6, s5); \
+		n5 = WP_ROW(k5, k4, k3, k2, k1, k0, k7, k6); \
+		m5 = WP_ROW(s5, s4, s3, s2, s1, s0, s7, s6); \
+		n6 = WP_ROW(k6, k5, k4, k3, k2, k1, k0, k7); \
+		m6 = WP_ROW(s6, s5, s4, s3, s2, s1, s0, s7); \
+		n7 = WP_ROW(k7, k6, k5, k4, k3, k2, k1, k0); \
+		m7 = WP_ROW(s7, s6, s5, s4, s3, s2, s1, s0); \
+		k0 = n0; k1 = n1; k2 = n2; k3 = n3; \
+		k4 = n4; k5 = n5; k6 = n6; k7 = n7; \
+		s0 = UINT64_XOR(m0, n0); s1 = UINT64_XOR(m1, n1); \
+		s2 = UINT64_XOR(m2, n2); s3 = UINT64_XOR(m3, n3); \
+		s4 = UINT64_XOR(m4, n4); s5 = UINT64_XOR(m5, n5); \
+		s6 = UINT64_XOR(m6, n6); s7 = UINT64_XOR(m7, n7); \
+	} while (0)
 
 static void whirlpool_process_buffer(const unsigned char *buffer, UINT64 *hash)
 {
 	UINT64 block[8];
-	UINT64 k[8];
-	UINT64 state[8];
-	unsigned i;
+	UINT64 k0, k1, k2, k3, k4, k5, k6, k7;
+	UINT64 s0, s1, s2, s3, s4, s5, s6, s7;
 	unsigned r;
 
 	bufcvt_be64_to_UINT64(block, buffer, 8);
 
-	for (i = 0; i < 8; i++) {
-		k[i] = hash[i];
-		state[i] = UINT64_XOR(block[i], hash[i]);
+	k0 = hash[0]; s0 = UINT64_XOR(block[0], k0);
+	k1 = hash[1]; s1 = UINT64_XOR(block[1], k1);
+	k2 = hash[2]; s2 = UINT64_XOR(block[2], k2);
+	k3 = hash[3]; s3 = UINT64_XOR(block[3], k3);
+	k4 = hash[4]; s4 = UINT64_XOR(block[4], k4);
+	k5 = hash[5]; s5 = UINT64_XOR(block[5], k5);
+	k6 = hash[6]; s6 = UINT64_XOR(block[6], k6);
+	k7 = hash[7]; s7 = UINT64_XOR(block[7], k7);
+
+	for (r = 0; r < WHIRLPOOL_NB_ROUNDS; r += 2) {
+		WP_ROUND(whirlpool_rounds[r]);
+		WP_ROUND(whirlpool_rounds[r + 1]);
 	}
 
-	for (r = 0; r < WHIRLPOOL_NB_ROUNDS; r++)
-		whirlpool_round(state, k, whirlpool_rounds[r]);
-
-	for (i = 0; i < 8; i++)
-		hash[i] = UINT64_XOR(hash[i], UINT64_XOR(state[i], block[i]));
+	/* Miyaguchi-Preneel: the chaining value, the cipher output and the
+	 * message block are combined. */
+	hash[0] = UINT64_XOR(hash[0], UINT64_XOR(s0, block[0]));
+	hash[1] = UINT64_XOR(hash[1], UINT64_XOR(s1, block[1]));
+	hash[2] = UINT64_XOR(hash[2], UINT64_XOR(s2, block[2]));
+	hash[3] = UINT64_XOR(hash[3], UINT64_XOR(s3, block[3]));
+	hash[4] = UINT64_XOR(hash[4], UINT64_XOR(s4, block[4]));
+	hash[5] = UINT64_XOR(hash[5], UINT64_XOR(s5, block[5]));
+	hash[6] = UINT64_XOR(hash[6], UINT64_XOR(s6, block[6]));
+	hash[7] = UINT64_XOR(hash[7], UINT64_XOR(s7, block[7]));
 }
 
+#undef WP_ROUND
+#undef WP_ROW
+#undef WP_T
+#undef WP_BYTE
+
 
 struct hash_pvt_s {
 	UINT64        h[8];
@@ -208,6 +240,7 @@ int whirlpool_create(struct hash_s *hash)
 	hash->begin = whirlpool_begin;
 	hash->process = whirlpool_process;
 	hash->end = whirlpool_end;
+	hash->digest_jobs = NULL;
 	hash->destroy = whirlpool_destroy;
 	hash->query_digest_size = whirlpool_query_digest_size;
 	return 0;
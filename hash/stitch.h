@@ -0,0 +1,61 @@
+/* Copyright (c) 2014, Nicholas Appleton (http://www.appletonaudio.com)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither Nicholas Appleton nor the names of its contributors may be
+ *       used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL NICHOLAS APPLETON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE. */
+
+#ifndef STITCH_H_
+#define STITCH_H_
+
+#include "hash.h"
+
+/* Stitching runs the compression functions of MD5 and SHA-1 and/or SHA-256
+ * over the same block at the same time. MD5 spends most of its time waiting
+ * on a single chain of dependent instructions, so interleaving it with the
+ * other algorithms fills slots which would otherwise be wasted and the data
+ * is only walked once. */
+
+#define STITCH_MD5    (1u)
+#define STITCH_SHA1   (2u)
+#define STITCH_SHA256 (4u)
+
+/* Returns which argument of stitch_process() the hash object can be passed
+ * as: STITCH_MD5 for objects made by md5_create(), STITCH_SHA1 for
+ * sha1_create() and STITCH_SHA256 for sha2_create() with a 224 or 256 bit
+ * digest. Returns zero for anything else. */
+unsigned stitch_role(struct hash_s *hash);
+
+/* Has exactly the same effect as calling process() on md5, sha1 and sha256
+ * with the same data. Either of sha1 and sha256 may be NULL. The objects
+ * must be in the initialised state and must all have been given the same
+ * data since begin(). */
+void
+stitch_process
+	(struct hash_s       *md5
+	,struct hash_s       *sha1
+	,struct hash_s       *sha256
+	,const unsigned char *data
+	,size_t               size
+	);
+
+#endif /* STITCH_H_ */
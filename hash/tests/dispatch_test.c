@@ -0,0 +1,110 @@
+/* Copyright (c) 2014, Nicholas Appleton (http://www.appletonaudio.com)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither Nicholas Appleton nor the names of its contributors may be
+ *       used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL NICHOLAS APPLETON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE. */
+
+#include <string.h>
+#include "hash/dispatch.h"
+#include "unittest/unittest.h"
+
+/* A slot which does not depend on the processor: "missing" is never usable
+ * and the others always are. */
+static const struct dispatch_kernel_s test_kernels[] =
+{	{"missing", 0, 0}
+,	{"fast", 0, 1}
+,	{"slow", 0, 1}
+,	{"fallback", 0, 1}
+};
+
+static const struct dispatch_slot_s test_slot =
+{	"test", "Dispatch test slot", test_kernels, 4
+};
+
+struct dispatch_test_s {
+	const char *force;
+	unsigned    expected;
+};
+
+static const struct dispatch_test_s dispatch_testcases[] =
+{	{NULL, 1}
+,	{"", 1}
+,	{"slow", 2}
+,	{"test=fallback", 3}
+,	{"other=slow,test=slow", 2}
+,	{"test=slow,other=fallback", 2}
+,	{"fallback,test=slow", 2}
+,	{"slow,fallback", 2}
+,	{"missing", 1}
+,	{"test=missing", 1}
+,	{"test=missing,fallback", 3}
+,	{"other=fallback", 1}
+,	{"sl,test=fa", 1}
+};
+
+static
+void run_dispatch_choose(struct unittest_manager *manager, const void *parameter)
+{
+	unsigned i;
+	for (i = 0; i < sizeof(dispatch_testcases) / sizeof(dispatch_testcases[0]); i++) {
+		const struct dispatch_test_s *test = &dispatch_testcases[i];
+		unsigned k = dispatch_choose(&test_slot, test->force);
+		if (k != test->expected)
+			unittest_fail(manager, "\"%s\" chose %u instead of %u\n", (test->force != NULL) ? test->force : "(null)", k, test->expected);
+	}
+}
+
+static
+void run_dispatch_slots(struct unittest_manager *manager, const void *parameter)
+{
+	unsigned s;
+	for (s = 0; dispatch_slots[s] != NULL; s++) {
+		const struct dispatch_slot_s *slot = dispatch_slots[s];
+		unsigned k = dispatch_select(slot);
+		if (k >= slot->nb_kernels || !dispatch_usable(&slot->kernels[k]))
+			unittest_fail(manager, "slot %s selected an unusable kernel\n", slot->name);
+		if (!dispatch_usable(&slot->kernels[slot->nb_kernels - 1]))
+			unittest_fail(manager, "slot %s has no fallback kernel\n", slot->name);
+		if (dispatch_select(slot) != k)
+			unittest_fail(manager, "slot %s changed its choice\n", slot->name);
+	}
+}
+
+static const struct unittest dispatch_internal_tests[] =
+{	{"choose", NULL, run_dispatch_choose, NULL, NULL}
+,	{"slots", NULL, run_dispatch_slots, NULL, NULL}
+};
+
+static const struct unittest *dispatch_subtests[] =
+{	&dispatch_internal_tests[0]
+,	&dispatch_internal_tests[1]
+,	NULL
+};
+
+const struct unittest dispatch_tests =
+{	"dispatch"
+,	"Kernel selection"
+,	NULL
+,	NULL
+,	dispatch_subtests
+};
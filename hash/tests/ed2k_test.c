@@ -0,0 +1,168 @@
+/* Copyright (c) 2014, Nicholas Appleton (http://www.appletonaudio.com)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither Nicholas Appleton nor the names of its contributors may be
+ *       used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL NICHOLAS APPLETON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hash/ed2k.h"
+#include "simple_hash_test.h"
+
+struct simple_ed2k_test {
+	const char *input;
+	unsigned    input_repeats;
+	const char *hash;
+};
+
+/* Shorter than a chunk, so these are plain MD4. */
+static const struct simple_ed2k_test simple_tests[] =
+{	{"", 1
+	,"31D6CFE0D16AE931B73C59D7E0C089C0"
+	}
+,	{"abc", 1
+	,"A448017AAF21D8525FC10AE87AA6729D"
+	}
+};
+
+static
+void run_simple_ed2k(struct unittest_manager *manager, const void *parameter)
+{
+	const struct simple_ed2k_test *p_test = parameter;
+	struct hash_s ed2k;
+
+	if (ed2k_create(&ed2k)) {
+		unittest_fail(manager, "failed to get hash context\n");
+		return;
+	}
+
+	hashtest_string_test
+		(manager
+		,&ed2k
+		,p_test->input
+		,p_test->input_repeats
+		,p_test->hash
+		);
+
+	ed2k.destroy(&ed2k);
+}
+
+struct chunked_ed2k_test {
+	size_t      size;
+	int         zeros;
+	const char *hash;
+};
+
+/* Inputs around the chunk size. The data is either zeros or the byte
+ * pattern (i * 31 + 7) & 0xFF. The digest of one chunk of zeros is the
+ * well known value produced by eMule. */
+static const struct chunked_ed2k_test chunked_tests[] =
+{	{ED2K_CHUNK_SIZE, 1
+	,"FC21D9AF828F92A8DF64BEAC3357425D"
+	}
+,	{ED2K_CHUNK_SIZE - 1, 0
+	,"06569F8FB82043D15EBEB265D1B3F101"
+	}
+,	{2 * (size_t)ED2K_CHUNK_SIZE, 0
+	,"116CC03B953983F4F4AE2FF41BF6157F"
+	}
+,	{2 * (size_t)ED2K_CHUNK_SIZE + 12345, 0
+	,"0B986A254495E9D96D126771477DBAF8"
+	}
+};
+
+/* Hashes the input in a single call, which gives the whole chunks to the
+ * multi-buffer path, and again in pieces which straddle the chunks. */
+static
+void run_chunked_ed2k(struct unittest_manager *manager, const void *parameter)
+{
+	static const size_t pieces[2] = {0, 1000003};
+	const struct chunked_ed2k_test *p_test = parameter;
+	unsigned char *data = malloc(p_test->size);
+	unsigned char digest[16];
+	char hex[33];
+	struct hash_s ed2k;
+	size_t i;
+	unsigned p;
+
+	if (!data) {
+		unittest_fail(manager, "out of memory\n");
+		return;
+	}
+	for (i = 0; i < p_test->size; i++)
+		data[i] = (p_test->zeros) ? 0 : (unsigned char)((i * 31u + 7u) & 0xFFu);
+
+	if (ed2k_create(&ed2k)) {
+		unittest_fail(manager, "failed to get hash context\n");
+		free(data);
+		return;
+	}
+
+	for (p = 0; p < 2; p++) {
+		ed2k.begin(&ed2k);
+		if (pieces[p]) {
+			for (i = 0; i < p_test->size; i += pieces[p])
+				ed2k.process(&ed2k, data + i, (p_test->size - i < pieces[p]) ? (p_test->size - i) : pieces[p]);
+		} else {
+			ed2k.process(&ed2k, data, p_test->size);
+		}
+		ed2k.end(&ed2k, digest);
+		for (i = 0; i < 16; i++)
+			sprintf(hex + 2 * i, "%02X", digest[i]);
+		if (strcmp(hex, p_test->hash)) {
+			unittest_fail(manager, "expected %s got %s for %lu bytes\n", p_test->hash, hex, (unsigned long)p_test->size);
+			break;
+		}
+	}
+
+	ed2k.destroy(&ed2k);
+	free(data);
+}
+
+static const struct unittest ed2k_internal_tests[] =
+{	{"test1", NULL, run_simple_ed2k, &simple_tests[0], NULL}
+,	{"test2", NULL, run_simple_ed2k, &simple_tests[1], NULL}
+,	{"test3", NULL, run_chunked_ed2k, &chunked_tests[0], NULL}
+,	{"test4", NULL, run_chunked_ed2k, &chunked_tests[1], NULL}
+,	{"test5", NULL, run_chunked_ed2k, &chunked_tests[2], NULL}
+,	{"test6", NULL, run_chunked_ed2k, &chunked_tests[3], NULL}
+};
+
+static const struct unittest *ed2k_subtests[] =
+{	&ed2k_internal_tests[0]
+,	&ed2k_internal_tests[1]
+,	&ed2k_internal_tests[2]
+,	&ed2k_internal_tests[3]
+,	&ed2k_internal_tests[4]
+,	&ed2k_internal_tests[5]
+,	NULL
+};
+
+const struct unittest ed2k_tests =
+{	"ed2k"
+,	"ed2k tests"
+,	NULL
+,	NULL
+,	ed2k_subtests
+};
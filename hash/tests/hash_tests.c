@@ -27,18 +27,24 @@
 #include "hash/hash_tests.h"
 #include <stdio.h>
 
+extern const struct unittest dispatch_tests;
 extern const struct unittest sha1_tests;
 extern const struct unittest sha2_tests;
 extern const struct unittest sha3_tests;
 extern const struct unittest tiger_tests;
 extern const struct unittest tigertree_tests;
 extern const struct unittest md4_tests;
+extern const struct unittest ed2k_tests;
 extern const struct unittest md5_tests;
+extern const struct unittest stitch_tests;
 extern const struct unittest whirlpool_tests;
 
 const struct unittest *sub_tests[] =
-{	&md4_tests
+{	&dispatch_tests
+,	&md4_tests
+,	&ed2k_tests
 ,	&md5_tests
+,	&stitch_tests
 ,	&sha1_tests
 ,	&sha2_tests
 ,	&sha3_tests
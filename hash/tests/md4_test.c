@@ -25,6 +25,7 @@
  * DAMAGE. */
 
 #include "hash/md4.h"
+#include "hash/src/md4_internal.h"
 #include "simple_hash_test.h"
 
 struct simple_md4_test {
@@ -80,6 +81,57 @@ void run_simple_md4(struct unittest_manager *manager, const void *parameter)
 	md4.destroy(&md4);
 }
 
+static
+int
+md4_mb_create(struct hash_s *hash, unsigned digest_bits)
+{
+	(void)digest_bits;
+	return md4_create(hash);
+}
+
+static
+void
+md4_mb_iv(union mb_state_u *iv, unsigned digest_bits)
+{
+	(void)digest_bits;
+	iv->w32[0] = 0x67452301u;
+	iv->w32[1] = 0xEFCDAB89u;
+	iv->w32[2] = 0x98BADCFEu;
+	iv->w32[3] = 0x10325476u;
+}
+
+static const unsigned md4_mb_bits[] = {128, 0};
+
+static const struct hashtest_mb md4_mbs[] =
+{	{"avx2", md4_mb_create, md4_mb_get_avx2, NULL, md4_mb_iv, md4_mb_bits}
+,	{"sse2", md4_mb_create, md4_mb_get_sse2, NULL, md4_mb_iv, md4_mb_bits}
+,	{"portable", md4_mb_create, md4_mb_get_portable, NULL, md4_mb_iv, md4_mb_bits}
+,	{"jobs", md4_mb_create, NULL, NULL, NULL, md4_mb_bits}
+};
+
+static const struct unittest md4_mb_internal_tests[] =
+{	{"avx2", NULL, hashtest_mb_test, &md4_mbs[0], NULL}
+,	{"sse2", NULL, hashtest_mb_test, &md4_mbs[1], NULL}
+,	{"portable", NULL, hashtest_mb_test, &md4_mbs[2], NULL}
+,	{"jobs", NULL, hashtest_mb_test, &md4_mbs[3], NULL}
+};
+
+static const struct unittest *md4_mb_subtests[] =
+{	&md4_mb_internal_tests[0]
+,	&md4_mb_internal_tests[1]
+,	&md4_mb_internal_tests[2]
+,	&md4_mb_internal_tests[3]
+,	NULL
+};
+
+static const struct unittest md4_mb_tests =
+{	"mb"
+,	"MD4 multi-buffer engines against the hash object"
+,	NULL
+,	NULL
+,	md4_mb_subtests
+};
+
 static const struct unittest md4_internal_tests[] =
 {	{"test1", NULL, run_simple_md4, &simple_tests[0], NULL}
 ,	{"test2", NULL, run_simple_md4, &simple_tests[1], NULL}
@@ -98,6 +150,7 @@ static const struct unittest *md4_subtests[] =
 ,	&md4_internal_tests[4]
 ,	&md4_internal_tests[5]
 ,	&md4_internal_tests[6]
+,	&md4_mb_tests
 ,	NULL
 };
 
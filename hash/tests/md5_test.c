@@ -25,6 +25,7 @@
  * DAMAGE. */
 
 #include "hash/md5.h"
+#include "hash/src/md5_internal.h"
 #include "simple_hash_test.h"
 
 struct simple_md5_test {
@@ -80,6 +81,57 @@ void run_simple_md5(struct unittest_manager *manager, const void *parameter)
 	md5.destroy(&md5);
 }
 
+static
+int
+md5_mb_create(struct hash_s *hash, unsigned digest_bits)
+{
+	(void)digest_bits;
+	return md5_create(hash);
+}
+
+static
+void
+md5_mb_iv(union mb_state_u *iv, unsigned digest_bits)
+{
+	(void)digest_bits;
+	iv->w32[0] = 0x67452301u;
+	iv->w32[1] = 0xEFCDAB89u;
+	iv->w32[2] = 0x98BADCFEu;
+	iv->w32[3] = 0x10325476u;
+}
+
+static const unsigned md5_mb_bits[] = {128, 0};
+
+static const struct hashtest_mb md5_mbs[] =
+{	{"avx2", md5_mb_create, md5_mb_get_avx2, NULL, md5_mb_iv, md5_mb_bits}
+,	{"sse2", md5_mb_create, md5_mb_get_sse2, NULL, md5_mb_iv, md5_mb_bits}
+,	{"portable", md5_mb_create, md5_mb_get_portable, NULL, md5_mb_iv, md5_mb_bits}
+,	{"jobs", md5_mb_create, NULL, NULL, NULL, md5_mb_bits}
+};
+
+static const struct unittest md5_mb_internal_tests[] =
+{	{"avx2", NULL, hashtest_mb_test, &md5_mbs[0], NULL}
+,	{"sse2", NULL, hashtest_mb_test, &md5_mbs[1], NULL}
+,	{"portable", NULL, hashtest_mb_test, &md5_mbs[2], NULL}
+,	{"jobs", NULL, hashtest_mb_test, &md5_mbs[3], NULL}
+};
+
+static const struct unittest *md5_mb_subtests[] =
+{	&md5_mb_internal_tests[0]
+,	&md5_mb_internal_tests[1]
+,	&md5_mb_internal_tests[2]
+,	&md5_mb_internal_tests[3]
+,	NULL
+};
+
+static const struct unittest md5_mb_tests =
+{	"mb"
+,	"MD5 multi-buffer engines against the hash object"
+,	NULL
+,	NULL
+,	md5_mb_subtests
+};
+
 static const struct unittest md5_internal_tests[] =
 {	{"test1", NULL, run_simple_md5, &simple_tests[0], NULL}
 ,	{"test2", NULL, run_simple_md5, &simple_tests[1], NULL}
@@ -98,6 +150,7 @@ static const struct unittest *md5_subtests[] =
 ,	&md5_internal_tests[4]
 ,	&md5_internal_tests[5]
 ,	&md5_internal_tests[6]
+,	&md5_mb_tests
 ,	NULL
 };
 
@@ -28,6 +28,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include "hash/sha1.h"
+#include "hash/src/sha1_internal.h"
 #include "simple_hash_test.h"
 
 struct simple_sha1_test {
@@ -83,11 +84,55 @@ void run_simple_sha1(struct unittest_manager *manager, const void *parameter)
 	sha1.destroy(&sha1);
 }
 
+/* A processor specific SHA-1 compression function. The getter returns NULL
+ * if it cannot be used on this machine. */
+struct sha1_impl_test {
+	const char     *name;
+	sha1_blocks_fn (*get)(void);
+};
+
+static const struct sha1_impl_test impl_tests[] =
+{	{"shani", sha1_get_shani}
+};
+
+/* Cross-checks an implementation against the portable one from a range of
+ * states over runs of 0 to 17 blocks of pseudo-random data. */
+static
+void run_sha1_impl(struct unittest_manager *manager, const void *parameter)
+{
+	const struct sha1_impl_test *impl = parameter;
+	sha1_blocks_fn fn = impl->get();
+	unsigned char data[64 * 17];
+	mccl_uif32 ref[5];
+	mccl_uif32 st[5];
+	unsigned nb_blocks;
+	unsigned i;
+
+	if (fn == NULL)
+		return;
+
+	hashtest_fill(data, sizeof(data), 1);
+
+	for (nb_blocks = 0; nb_blocks <= 17; nb_blocks++) {
+		for (i = 0; i < 5; i++)
+			ref[i] = st[i] = (0x9E3779B9u * (i + 5 * nb_blocks + 1)) & 0xFFFFFFFFu;
+		sha1_process_blocks(ref, data, nb_blocks);
+		fn(st, data, nb_blocks);
+		for (i = 0; i < 5; i++) {
+			if ((ref[i] ^ st[i]) & 0xFFFFFFFFu) {
+				unittest_fail(manager, "%s state differs after %u blocks\n", impl->name, nb_blocks);
+				return;
+			}
+		}
+	}
+}
+
 static const struct unittest sha1_internal_tests[] =
 {	{"test1", NULL, run_simple_sha1, &simple_tests[0], NULL}
 ,	{"test2", NULL, run_simple_sha1, &simple_tests[1], NULL}
 ,	{"test3", NULL, run_simple_sha1, &simple_tests[2], NULL}
 ,	{"test4", NULL, run_simple_sha1, &simple_tests[3], NULL}
+,	{"shani", NULL, run_sha1_impl, &impl_tests[0], NULL}
 };
 
 static const struct unittest *sha1_subtests[] =
@@ -95,6 +140,7 @@ static const struct unittest *sha1_subtests[] =
 ,	&sha1_internal_tests[1]
 ,	&sha1_internal_tests[2]
 ,	&sha1_internal_tests[3]
+,	&sha1_internal_tests[4]
 ,	NULL
 };
 
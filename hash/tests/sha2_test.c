@@ -29,6 +29,9 @@
 #include <string.h>
 #include <assert.h>
 #include "hash/sha2.h"
+#include "hash/hashtree.h"
+#include "hash/src/sha2_256.h"
+#include "hash/src/sha2_512.h"
 #include "simple_hash_test.h"
 
 struct simple_test_s {
@@ -133,6 +136,15 @@ static const struct simple_test_s sha2_test_data[] =
 	,"23FEC5BB94D60B23308192640B0C453335D664734FE40E7268674AF9"
 	,224
 	}
+/* 55 octets leaves exactly enough room in the block for the 64 bit length. */
+,	{TEST3, 55, 0
+	,"9F4390F8D30C2DD92EC9F095B65E2B9AE9B0A925A5258E241C9F1E910F734318"
+	,256
+	}
+,	{TEST3, 55, 0
+	,"FB0BD626A70C28541DFA781BB5CC4D7D7F56622A58F01A0B1DDD646F"
+	,224
+	}
 };
 
 static
@@ -157,6 +169,217 @@ void run_simple_sha2(struct unittest_manager *manager, const void *parameter)
 	sha2.destroy(&sha2);
 }
 
+/* A processor specific SHA-256 compression function. The getter returns
+ * NULL if it cannot be used on this machine. */
+struct sha2_256_impl_s {
+	const char         *name;
+	sha2_256_blocks_fn (*get)(void);
+};
+
+static const struct sha2_256_impl_s sha2_256_impls[] =
+{	{"shani", sha2_256_get_shani}
+,	{"avx2", sha2_256_get_avx2}
+,	{"avx", sha2_256_get_avx}
+,	{"ssse3", sha2_256_get_ssse3}
+};
+
+/* Cross-checks an implementation against the portable one from a range of
+ * states over runs of 0 to 17 blocks of pseudo-random data. */
+static
+void run_sha2_256_impl(struct unittest_manager *manager, const void *parameter)
+{
+	const struct sha2_256_impl_s *impl = parameter;
+	sha2_256_blocks_fn fn = impl->get();
+	unsigned char data[64 * 17];
+	mccl_uif32 ref[8];
+	mccl_uif32 st[8];
+	unsigned nb_blocks;
+	unsigned i;
+
+	if (fn == NULL)
+		return;
+
+	hashtest_fill(data, sizeof(data), 1);
+
+	for (nb_blocks = 0; nb_blocks <= 17; nb_blocks++) {
+		for (i = 0; i < 8; i++)
+			ref[i] = st[i] = (0x9E3779B9u * (i + 8 * nb_blocks + 1)) & 0xFFFFFFFFu;
+		sha2_256_process_blocks(ref, data, nb_blocks);
+		fn(st, data, nb_blocks);
+		for (i = 0; i < 8; i++) {
+			if ((ref[i] ^ st[i]) & 0xFFFFFFFFu) {
+				unittest_fail(manager, "%s state differs after %u blocks\n", impl->name, nb_blocks);
+				return;
+			}
+		}
+	}
+}
+
+/* The same for the SHA-512 compression function. */
+struct sha2_512_impl_s {
+	const char         *name;
+	sha2_512_blocks_fn (*get)(void);
+};
+
+static const struct sha2_512_impl_s sha2_512_impls[] =
+{	{"avx2", sha2_512_get_avx2}
+,	{"native", sha2_512_get_native}
+};
+
+static
+void run_sha2_512_impl(struct unittest_manager *manager, const void *parameter)
+{
+	const struct sha2_512_impl_s *impl = parameter;
+	sha2_512_blocks_fn fn = impl->get();
+	unsigned char data[128 * 9];
+	UINT64 ref[8];
+	UINT64 st[8];
+	unsigned nb_blocks;
+	unsigned i;
+
+	if (fn == NULL)
+		return;
+
+	hashtest_fill(data, sizeof(data), 1);
+
+	for (nb_blocks = 0; nb_blocks <= 9; nb_blocks++) {
+		for (i = 0; i < 8; i++)
+			ref[i] = st[i] = UINT64_MAKE(0x9E3779B9u * (i + 1), 0x7F4A7C15u * (i + 8 * nb_blocks + 1));
+		sha2_512_process_blocks(ref, data, nb_blocks);
+		fn(st, data, nb_blocks);
+		for (i = 0; i < 8; i++) {
+			if ((UINT64_HIGH(ref[i]) != UINT64_HIGH(st[i])) || (UINT64_LOW(ref[i]) != UINT64_LOW(st[i]))) {
+				unittest_fail(manager, "%s state differs after %u blocks\n", impl->name, nb_blocks);
+				return;
+			}
+		}
+	}
+}
+
+static
+int
+sha2_256_mb_create(struct hash_s *hash, unsigned digest_bits)
+{
+	return sha2_create(hash, digest_bits, 0);
+}
+
+static
+int
+sha2_512_mb_create(struct hash_s *hash, unsigned digest_bits)
+{
+	return sha2_create(hash, digest_bits, 1);
+}
+
+static
+void
+sha2_256_mb_iv(union mb_state_u *iv, unsigned digest_bits)
+{
+	static const mccl_uif32 iv256[2][8] =
+	{	{	0x6A09E667u, 0xBB67AE85u, 0x3C6EF372u, 0xA54FF53Au
+		,	0x510E527Fu, 0x9B05688Cu, 0x1F83D9ABu, 0x5BE0CD19u
+		}
+	,	{	0xC1059ED8u, 0x367CD507u, 0x3070DD17u, 0xF70E5939u
+		,	0xFFC00B31u, 0x68581511u, 0x64F98FA7u, 0xBEFA4FA4u
+		}
+	};
+	unsigned i;
+
+	for (i = 0; i < 8; i++)
+		iv->w32[i] = iv256[digest_bits == 224][i];
+}
+
+static
+void
+sha2_512_mb_iv(union mb_state_u *iv, unsigned digest_bits)
+{
+	static const UINT64 iv512[2][8] =
+	{	{	UINT64_INIT(0x6A09E667u, 0xF3BCC908u), UINT64_INIT(0xBB67AE85u, 0x84CAA73Bu)
+		,	UINT64_INIT(0x3C6EF372u, 0xFE94F82Bu), UINT64_INIT(0xA54FF53Au, 0x5F1D36F1u)
+		,	UINT64_INIT(0x510E527Fu, 0xADE682D1u), UINT64_INIT(0x9B05688Cu, 0x2B3E6C1Fu)
+		,	UINT64_INIT(0x1F83D9ABu, 0xFB41BD6Bu), UINT64_INIT(0x5BE0CD19u, 0x137E2179u)
+		}
+	,	{	UINT64_INIT(0xCBBB9D5Du, 0xC1059ED8u), UINT64_INIT(0x629A292Au, 0x367CD507u)
+		,	UINT64_INIT(0x9159015Au, 0x3070DD17u), UINT64_INIT(0x152FECD8u, 0xF70E5939u)
+		,	UINT64_INIT(0x67332667u, 0xFFC00B31u), UINT64_INIT(0x8EB44A87u, 0x68581511u)
+		,	UINT64_INIT(0xDB0C2E0Du, 0x64F98FA7u), UINT64_INIT(0x47B5481Du, 0xBEFA4FA4u)
+		}
+	};
+	unsigned i;
+
+	for (i = 0; i < 8; i++)
+		iv->w64[i] = iv512[digest_bits == 384][i];
+}
+
+static const unsigned sha2_256_mb_bits[] = {256, 224, 0};
+static const unsigned sha2_512_mb_bits[] = {512, 384, 0};
+
+/* digest_jobs() is also checked for the SHA-512 variants which have a
+ * generated initial value, including one which is not a whole number of
+ * bytes. */
+static const unsigned sha2_512_jobs_bits[] = {512, 384, 256, 224, 200, 100, 0};
+
+static const struct hashtest_mb sha2_mbs[] =
+{	{"avx2", sha2_256_mb_create, sha2_256_mb_get_avx2, NULL, sha2_256_mb_iv, sha2_256_mb_bits}
+,	{"sse41", sha2_256_mb_create, sha2_256_mb_get_sse41, NULL, sha2_256_mb_iv, sha2_256_mb_bits}
+,	{"portable", sha2_256_mb_create, sha2_256_mb_get_portable, NULL, sha2_256_mb_iv, sha2_256_mb_bits}
+,	{"avx2", sha2_512_mb_create, sha2_512_mb_get_avx2, NULL, sha2_512_mb_iv, sha2_512_mb_bits}
+,	{"portable", sha2_512_mb_create, sha2_512_mb_get_portable, NULL, sha2_512_mb_iv, sha2_512_mb_bits}
+,	{"digest_jobs", sha2_512_mb_create, NULL, NULL, NULL, sha2_512_jobs_bits}
+};
+
+/* Checks that a tree built using digest_jobs() for its leaves matches one
+ * built by hashing the leaves one at a time. */
+static
+void run_sha2_256_mb_tree(struct unittest_manager *manager, const void *parameter)
+{
+	static unsigned char data[64 * 1024 + 333];
+	unsigned char with_jobs[32];
+	unsigned char without_jobs[32];
+	struct hash_s sha;
+	struct hash_s plain;
+	struct hash_s tree;
+	unsigned i;
+
+	(void)parameter;
+
+	for (i = 0; i < sizeof(data); i++)
+		data[i] = (unsigned char)(i * 31u + (i >> 8));
+
+	if (sha2_create(&sha, 256, 0)) {
+		unittest_fail(manager, "failed to create hash object\n");
+		return;
+	}
+	plain = sha;
+	plain.digest_jobs = NULL;
+
+	if (hashtree_create(&tree, &sha, 1024, 2)) {
+		unittest_fail(manager, "failed to create tree\n");
+		sha.destroy(&sha);
+		return;
+	}
+	tree.begin(&tree);
+	tree.process(&tree, data, 100);
+	tree.process(&tree, data + 100, sizeof(data) - 100);
+	tree.end(&tree, with_jobs);
+	tree.destroy(&tree);
+
+	if (hashtree_create(&tree, &plain, 1024, 2)) {
+		unittest_fail(manager, "failed to create tree\n");
+		sha.destroy(&sha);
+		return;
+	}
+	tree.begin(&tree);
+	tree.process(&tree, data, 100);
+	tree.process(&tree, data + 100, sizeof(data) - 100);
+	tree.end(&tree, without_jobs);
+	tree.destroy(&tree);
+
+	if (memcmp(with_jobs, without_jobs, sizeof(with_jobs)))
+		unittest_fail(manager, "tree digests differ\n");
+
+	sha.destroy(&sha);
+}
+
 static const struct unittest sha2_512_internal_tests[] =
 {	{"test1", NULL, run_simple_sha2, &sha2_test_data[0], NULL}
 ,	{"test2", NULL, run_simple_sha2, &sha2_test_data[1], NULL}
@@ -176,6 +399,7 @@ static const struct unittest sha2_256_internal_tests[] =
 ,	{"test2", NULL, run_simple_sha2, &sha2_test_data[9], NULL}
 ,	{"test3", NULL, run_simple_sha2, &sha2_test_data[10], NULL}
 ,	{"test4", NULL, run_simple_sha2, &sha2_test_data[11], NULL}
+,	{"test5", NULL, run_simple_sha2, &sha2_test_data[20], NULL}
 };
 
 static const struct unittest sha2_224_internal_tests[] =
@@ -183,6 +407,7 @@ static const struct unittest sha2_224_internal_tests[] =
 ,	{"test2", NULL, run_simple_sha2, &sha2_test_data[13], NULL}
 ,	{"test3", NULL, run_simple_sha2, &sha2_test_data[14], NULL}
 ,	{"test4", NULL, run_simple_sha2, &sha2_test_data[15], NULL}
+,	{"test5", NULL, run_simple_sha2, &sha2_test_data[21], NULL}
 };
 
 static const struct unittest sha2_512_256_internal_tests[] =
@@ -195,6 +420,18 @@ static const struct unittest sha2_512_224_internal_tests[] =
 ,	{"test2", NULL, run_simple_sha2, &sha2_test_data[19], NULL}
 };
 
+static const struct unittest sha2_256_impl_internal_tests[] =
+{	{"shani", NULL, run_sha2_256_impl, &sha2_256_impls[0], NULL}
+,	{"avx2", NULL, run_sha2_256_impl, &sha2_256_impls[1], NULL}
+,	{"avx", NULL, run_sha2_256_impl, &sha2_256_impls[2], NULL}
+,	{"ssse3", NULL, run_sha2_256_impl, &sha2_256_impls[3], NULL}
+};
+
+static const struct unittest sha2_512_impl_internal_tests[] =
+{	{"avx2", NULL, run_sha2_512_impl, &sha2_512_impls[0], NULL}
+,	{"native", NULL, run_sha2_512_impl, &sha2_512_impls[1], NULL}
+};
+
 static const struct unittest *sha2_512_subtests[] =
 {	&sha2_512_internal_tests[0]
 ,	&sha2_512_internal_tests[1]
@@ -216,6 +453,7 @@ static const struct unittest *sha2_256_subtests[] =
 ,	&sha2_256_internal_tests[1]
 ,	&sha2_256_internal_tests[2]
 ,	&sha2_256_internal_tests[3]
+,	&sha2_256_internal_tests[4]
 ,	NULL
 };
 
@@ -224,6 +462,7 @@ static const struct unittest *sha2_224_subtests[] =
 ,	&sha2_224_internal_tests[1]
 ,	&sha2_224_internal_tests[2]
 ,	&sha2_224_internal_tests[3]
+,	&sha2_224_internal_tests[4]
 ,	NULL
 };
 
@@ -239,6 +478,48 @@ static const struct unittest *sha2_512_224_subtests[] =
 ,	NULL
 };
 
+static const struct unittest sha2_256_mb_internal_tests[] =
+{	{"avx2", NULL, hashtest_mb_test, &sha2_mbs[0], NULL}
+,	{"sse41", NULL, hashtest_mb_test, &sha2_mbs[1], NULL}
+,	{"portable", NULL, hashtest_mb_test, &sha2_mbs[2], NULL}
+,	{"tree", NULL, run_sha2_256_mb_tree, NULL, NULL}
+};
+
+static const struct unittest sha2_512_mb_internal_tests[] =
+{	{"avx2", NULL, hashtest_mb_test, &sha2_mbs[3], NULL}
+,	{"portable", NULL, hashtest_mb_test, &sha2_mbs[4], NULL}
+,	{"jobs", NULL, hashtest_mb_test, &sha2_mbs[5], NULL}
+};
+
+static const struct unittest *sha2_256_impl_subtests[] =
+{	&sha2_256_impl_internal_tests[0]
+,	&sha2_256_impl_internal_tests[1]
+,	&sha2_256_impl_internal_tests[2]
+,	&sha2_256_impl_internal_tests[3]
+,	NULL
+};
+
+static const struct unittest *sha2_512_impl_subtests[] =
+{	&sha2_512_impl_internal_tests[0]
+,	&sha2_512_impl_internal_tests[1]
+,	NULL
+};
+
+static const struct unittest *sha2_256_mb_subtests[] =
+{	&sha2_256_mb_internal_tests[0]
+,	&sha2_256_mb_internal_tests[1]
+,	&sha2_256_mb_internal_tests[2]
+,	&sha2_256_mb_internal_tests[3]
+,	NULL
+};
+
+static const struct unittest *sha2_512_mb_subtests[] =
+{	&sha2_512_mb_internal_tests[0]
+,	&sha2_512_mb_internal_tests[1]
+,	&sha2_512_mb_internal_tests[2]
+,	NULL
+};
+
 static const struct unittest sha2_512_tests =
 {	"512"
 ,	"SHA-2 512 bit digest tests"
@@ -287,6 +568,38 @@ static const struct unittest sha2_512_224_tests =
 ,	sha2_512_224_subtests
 };
 
+static const struct unittest sha2_256_impl_tests =
+{	"256-impl"
+,	"SHA-2 256 compression functions against the portable one"
+,	NULL
+,	NULL
+,	sha2_256_impl_subtests
+};
+
+static const struct unittest sha2_512_impl_tests =
+{	"512-impl"
+,	"SHA-2 512 compression functions against the portable one"
+,	NULL
+,	NULL
+,	sha2_512_impl_subtests
+};
+
+static const struct unittest sha2_256_mb_tests =
+{	"256-mb"
+,	"SHA-2 256 multi-buffer engines against the hash object"
+,	NULL
+,	NULL
+,	sha2_256_mb_subtests
+};
+
+static const struct unittest sha2_512_mb_tests =
+{	"512-mb"
+,	"SHA-2 512 multi-buffer engines against the hash object"
+,	NULL
+,	NULL
+,	sha2_512_mb_subtests
+};
+
 static const struct unittest *sha2_subtests[] =
 {	&sha2_512_tests
 ,	&sha2_512_224_tests
@@ -294,6 +607,10 @@ static const struct unittest *sha2_subtests[] =
 ,	&sha2_384_tests
 ,	&sha2_256_tests
 ,	&sha2_224_tests
+,	&sha2_256_impl_tests
+,	&sha2_512_impl_tests
+,	&sha2_256_mb_tests
+,	&sha2_512_mb_tests
 ,	NULL
 };
 
@@ -29,6 +29,7 @@
 #include <string.h>
 #include <assert.h>
 #include "hash/sha3.h"
+#include "hash/src/sha3_internal.h"
 #include "simple_hash_test.h"
 
 struct simple_test_s {
@@ -113,6 +114,18 @@ void run_simple_sha3(struct unittest_manager *manager, const void *parameter)
 	sha3.destroy(&sha3);
 }
 
+static const unsigned sha3_mb_bits[] = {224, 256, 384, 512, 0};
+
+static const struct hashtest_mb sha3_mbs[] =
+{	{"avx2", sha3_create, NULL, sha3_mb_get_avx2, NULL, sha3_mb_bits}
+,	{"portable", sha3_create, NULL, sha3_mb_get_portable, NULL, sha3_mb_bits}
+};
+
+static const struct unittest sha3_mb_internal_tests[] =
+{	{"avx2", NULL, hashtest_mb_test, &sha3_mbs[0], NULL}
+,	{"portable", NULL, hashtest_mb_test, &sha3_mbs[1], NULL}
+};
+
 static const struct unittest sha3_512_internal_tests[] =
 {	{"test1", NULL, run_simple_sha3, &sha3_512_test_data[0], NULL}
 ,	{"test2", NULL, run_simple_sha3, &sha3_512_test_data[1], NULL}
@@ -157,6 +170,12 @@ static const struct unittest *sha3_224_subtests[] =
 ,	NULL
 };
 
+static const struct unittest *sha3_mb_subtests[] =
+{	&sha3_mb_internal_tests[0]
+,	&sha3_mb_internal_tests[1]
+,	NULL
+};
+
 static const struct unittest sha3_512_tests =
 {	"512"
 ,	"SHA-3 512 bit digest tests"
@@ -189,11 +208,20 @@ static const struct unittest sha3_224_tests =
 ,	sha3_224_subtests
 };
 
+static const struct unittest sha3_mb_tests =
+{	"mb"
+,	"SHA-3 multi-buffer engines against the hash object"
+,	NULL
+,	NULL
+,	sha3_mb_subtests
+};
+
 static const struct unittest *sha3_subtests[] =
 {	&sha3_512_tests
 ,	&sha3_384_tests
 ,	&sha3_256_tests
 ,	&sha3_224_tests
+,	&sha3_mb_tests
 ,	NULL
 };
 
@@ -102,4 +102,80 @@ hashtest_string_test
 		);
 }
 
+void
+hashtest_fill(unsigned char *data, size_t size, unsigned long seed)
+{
+	while (size--) {
+		seed = seed * 1103515245ul + 12345ul;
+		*data++ = (unsigned char)(seed >> 16);
+	}
+}
+
+#define HASHTEST_MB_JOBS (61)
+#define HASHTEST_MB_DATA (2560 + 64)
+
+void
+hashtest_mb_test(struct unittest_manager *manager, const void *parameter)
+{
+	static const size_t sizes[] =
+	{	0, 1, 55, 56, 57, 63, 64, 65, 71, 72, 73, 103, 104, 111, 112, 119, 120
+	,	127, 128, 129, 135, 136, 137, 143, 144, 145, 239, 240, 288, 1000, 1024
+	,	2560
+	};
+	const struct hashtest_mb *test = parameter;
+	static unsigned char data[HASHTEST_MB_DATA];
+	unsigned char results[HASHTEST_MB_JOBS][64];
+	unsigned char expected[64];
+	struct hash_job_s jobs[HASHTEST_MB_JOBS];
+	unsigned v, i;
+
+	hashtest_fill(data, sizeof(data), 7);
 
+	for (i = 0; i < HASHTEST_MB_JOBS; i++) {
+		jobs[i].size   = (i < sizeof(sizes) / sizeof(sizes[0])) ? sizes[i] : (size_t)((i * 97u) % 1200u);
+		jobs[i].data   = data + (i * 13u) % 64u;
+		jobs[i].result = results[i];
+	}
+
+	for (v = 0; test->digest_bits[v]; v++) {
+		const unsigned digest_bits = test->digest_bits[v];
+		struct hash_s hash;
+
+		if (test->create(&hash, digest_bits)) {
+			unittest_fail(manager, "failed to create hash object\n");
+			return;
+		}
+
+		/* Both sides must write every byte of the digest themselves, so
+		 * start them off with different contents. */
+		memset(results, 0xA5, sizeof(results));
+
+		if ((test->get != NULL) || (test->get_bits != NULL)) {
+			const struct mb_engine_s *engine = (test->get != NULL) ? test->get() : test->get_bits(digest_bits);
+			union mb_state_u iv;
+			if (engine == NULL) {
+				hash.destroy(&hash);
+				return;
+			}
+			memset(&iv, 0, sizeof(iv));
+			if (test->iv != NULL)
+				test->iv(&iv, digest_bits);
+			mb_run(engine, &iv, digest_bits, jobs, HASHTEST_MB_JOBS);
+		} else {
+			hash.digest_jobs(&hash, jobs, HASHTEST_MB_JOBS);
+		}
+
+		for (i = 0; i < HASHTEST_MB_JOBS; i++) {
+			memset(expected, 0x5A, sizeof(expected));
+			hash.begin(&hash);
+			hash.process(&hash, jobs[i].data, jobs[i].size);
+			hash.end(&hash, expected);
+			if (memcmp(expected, results[i], (digest_bits + 7) / 8)) {
+				unittest_fail(manager, "%s digest %u of %u bytes differs for %u bits\n", test->name, i, (unsigned)jobs[i].size, digest_bits);
+				break;
+			}
+		}
+
+		hash.destroy(&hash);
+	}
+}
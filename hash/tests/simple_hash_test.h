@@ -29,6 +29,8 @@
 
 #include "unittest/unittest.h"
 #include "hash/hash.h"
+#include "hash/src/multibuf.h"
+#include <stddef.h>
 
 void
 hashtest_string_test
@@ -39,4 +41,38 @@ hashtest_string_test
 	,const char              *reference
 	);
 
+/* Fills data with bytes from a linear congruential generator started from
+ * seed. */
+void
+hashtest_fill(unsigned char *data, size_t size, unsigned long seed);
+
+/* Checks a multi-buffer engine (or digest_jobs()) against a hash object.
+ *
+ * For every size in the zero terminated digest_bits list, a batch of
+ * messages of assorted lengths is hashed. The lengths include ones either
+ * side of the padding boundaries of 64 and 128 byte blocks and of the SHA-3
+ * rates. Every digest is compared against the one computed one message at a
+ * time by the object which create() makes. Neither is given a zeroed buffer
+ * to write to, so every byte of the digest, including the partly used last
+ * byte of a digest which is not a whole number of bytes, must be written.
+ *
+ * The engine comes from get() or get_bits(), whichever is not NULL. It is
+ * run from the chaining value which iv() writes over a zeroed state, or
+ * from the zeroed state if iv is NULL. If the getter returns NULL (the engine
+ * cannot run on this machine) the test passes without doing anything. If
+ * neither getter is given, digest_jobs() of the object is checked instead.
+ *
+ * hashtest_mb_test() is a unittest_fn taking a pointer to one of these. */
+struct hashtest_mb {
+	const char                *name;
+	int                      (*create)(struct hash_s *hash, unsigned digest_bits);
+	const struct mb_engine_s *(*get)(void);
+	const struct mb_engine_s *(*get_bits)(unsigned digest_bits);
+	void                     (*iv)(union mb_state_u *iv, unsigned digest_bits);
+	const unsigned            *digest_bits;
+};
+
+void
+hashtest_mb_test(struct unittest_manager *manager, const void *parameter);
+
 #endif /* SIMPLE_HASH_TEST_H_ */
@@ -0,0 +1,187 @@
+/* Copyright (c) 2014, Nicholas Appleton (http://www.appletonaudio.com)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither Nicholas Appleton nor the names of its contributors may be
+ *       used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL NICHOLAS APPLETON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE. */
+
+#include <string.h>
+#include "hash/md5.h"
+#include "hash/sha1.h"
+#include "hash/sha2.h"
+#include "hash/stitch.h"
+#include "hash/src/md5_internal.h"
+#include "hash/src/sha1_internal.h"
+#include "hash/src/sha2_256.h"
+#include "hash/src/stitch_internal.h"
+#include "simple_hash_test.h"
+
+struct stitch_test_s {
+	const char        *name;
+	stitch_blocks_fn (*get)(unsigned roles);
+	unsigned           roles;
+	unsigned           sha2_bits;
+};
+
+static const struct stitch_test_s stitch_testcases[] =
+{	{"shani-sha1", stitch_get_shani, STITCH_SHA1, 256}
+,	{"shani-sha256", stitch_get_shani, STITCH_SHA256, 256}
+,	{"shani-both", stitch_get_shani, STITCH_SHA1 | STITCH_SHA256, 256}
+,	{"portable-sha1", stitch_get_portable, STITCH_SHA1, 256}
+,	{"portable-sha256", stitch_get_portable, STITCH_SHA256, 256}
+,	{"portable-both", stitch_get_portable, STITCH_SHA1 | STITCH_SHA256, 256}
+,	{"process-sha1", NULL, STITCH_SHA1, 256}
+,	{"process-sha224", NULL, STITCH_SHA256, 224}
+,	{"process-both", NULL, STITCH_SHA1 | STITCH_SHA256, 256}
+};
+
+#define STITCH_TEST_DATA (64 * 40 + 17)
+
+/* Hashes the same data with MD5, SHA-1 and SHA-2 objects which are fed by
+ * the kernel (or by stitch_process() in pieces of assorted sizes if there
+ * is no kernel) and by objects which are fed on their own, then compares
+ * the digests of the algorithms which were stitched. */
+static
+void run_stitch(struct unittest_manager *manager, const void *parameter)
+{
+	static const size_t pieces[] = {1, 63, 64, 65, 200, 7, 1000, 3};
+	const struct stitch_test_s *test = parameter;
+	static unsigned char data[STITCH_TEST_DATA];
+	unsigned char expected[32];
+	unsigned char result[32];
+	struct hash_s dut[3];
+	struct hash_s ref[3];
+	unsigned i;
+
+	hashtest_fill(data, sizeof(data), 11);
+
+	if (md5_create(&dut[0]) || md5_create(&ref[0]) ||
+	    sha1_create(&dut[1]) || sha1_create(&ref[1]) ||
+	    sha2_create(&dut[2], test->sha2_bits, 0) || sha2_create(&ref[2], test->sha2_bits, 0)) {
+		unittest_fail(manager, "failed to get hash context\n");
+		return;
+	}
+
+	for (i = 0; i < 3; i++) {
+		dut[i].begin(&dut[i]);
+		ref[i].begin(&ref[i]);
+		ref[i].process(&ref[i], data, STITCH_TEST_DATA);
+	}
+
+	if (test->get != NULL) {
+		stitch_blocks_fn fn = test->get(test->roles);
+		const size_t nb_blocks = STITCH_TEST_DATA / 64;
+		if (fn == NULL) {
+			for (i = 0; i < 3; i++) {
+				dut[i].destroy(&dut[i]);
+				ref[i].destroy(&ref[i]);
+			}
+			return;
+		}
+		fn(md5_stitch_state(&dut[0], NULL), sha1_stitch_state(&dut[1], NULL), sha2_stitch_state(&dut[2], NULL), data, nb_blocks);
+		md5_stitch_advance(&dut[0], nb_blocks);
+		sha1_stitch_advance(&dut[1], nb_blocks);
+		sha2_stitch_advance(&dut[2], nb_blocks);
+		for (i = 0; i < 3; i++)
+			dut[i].process(&dut[i], data + 64 * nb_blocks, STITCH_TEST_DATA - 64 * nb_blocks);
+	} else {
+		size_t offset = 0;
+		for (i = 0; offset < STITCH_TEST_DATA; i++) {
+			size_t size = pieces[i % (sizeof(pieces) / sizeof(pieces[0]))];
+			if (size > STITCH_TEST_DATA - offset)
+				size = STITCH_TEST_DATA - offset;
+			stitch_process
+				(&dut[0]
+				,(test->roles & STITCH_SHA1) ? &dut[1] : NULL
+				,(test->roles & STITCH_SHA256) ? &dut[2] : NULL
+				,data + offset
+				,size
+				);
+			offset += size;
+		}
+	}
+
+	for (i = 0; i < 3; i++) {
+		if ((i == 0) || (test->roles & (1u << i))) {
+			unsigned nb_bytes = ref[i].query_digest_size(&ref[i]) / 8;
+			ref[i].end(&ref[i], expected);
+			dut[i].end(&dut[i], result);
+			if (memcmp(expected, result, nb_bytes))
+				unittest_fail(manager, "%s digest %u differs\n", test->name, i);
+		}
+		dut[i].destroy(&dut[i]);
+		ref[i].destroy(&ref[i]);
+	}
+}
+
+static
+void run_stitch_roles(struct unittest_manager *manager, const void *parameter)
+{
+	struct hash_s md5, sha1, sha256, sha384;
+	if (md5_create(&md5) || sha1_create(&sha1) ||
+	    sha2_create(&sha256, 256, 0) || sha2_create(&sha384, 384, 0)) {
+		unittest_fail(manager, "failed to get hash context\n");
+		return;
+	}
+	if ((stitch_role(&md5) != STITCH_MD5) || (stitch_role(&sha1) != STITCH_SHA1) ||
+	    (stitch_role(&sha256) != STITCH_SHA256) || (stitch_role(&sha384) != 0))
+		unittest_fail(manager, "hash objects were given the wrong roles\n");
+	md5.destroy(&md5);
+	sha1.destroy(&sha1);
+	sha256.destroy(&sha256);
+	sha384.destroy(&sha384);
+}
+
+static const struct unittest stitch_internal_tests[] =
+{	{"roles", NULL, run_stitch_roles, NULL, NULL}
+,	{"shani-sha1", NULL, run_stitch, &stitch_testcases[0], NULL}
+,	{"shani-sha256", NULL, run_stitch, &stitch_testcases[1], NULL}
+,	{"shani-both", NULL, run_stitch, &stitch_testcases[2], NULL}
+,	{"portable-sha1", NULL, run_stitch, &stitch_testcases[3], NULL}
+,	{"portable-sha256", NULL, run_stitch, &stitch_testcases[4], NULL}
+,	{"portable-both", NULL, run_stitch, &stitch_testcases[5], NULL}
+,	{"process-sha1", NULL, run_stitch, &stitch_testcases[6], NULL}
+,	{"process-sha224", NULL, run_stitch, &stitch_testcases[7], NULL}
+,	{"process-both", NULL, run_stitch, &stitch_testcases[8], NULL}
+};
+
+static const struct unittest *stitch_subtests[] =
+{	&stitch_internal_tests[0]
+,	&stitch_internal_tests[1]
+,	&stitch_internal_tests[2]
+,	&stitch_internal_tests[3]
+,	&stitch_internal_tests[4]
+,	&stitch_internal_tests[5]
+,	&stitch_internal_tests[6]
+,	&stitch_internal_tests[7]
+,	&stitch_internal_tests[8]
+,	&stitch_internal_tests[9]
+,	NULL
+};
+
+const struct unittest stitch_tests =
+{	"stitch"
+,	"Stitched MD5, SHA-1 and SHA-256 kernels"
+,	NULL
+,	NULL
+,	stitch_subtests
+};
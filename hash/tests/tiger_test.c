@@ -28,6 +28,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include "hash/tiger.h"
+#include "hash/src/tiger_internal.h"
 #include "simple_hash_test.h"
 
 struct simple_tiger_test {
@@ -112,6 +113,60 @@ void run_simple_tiger(struct unittest_manager *manager, const void *parameter)
 	tiger.destroy(&tiger);
 }
 
+static
+int
+tiger_mb_create(struct hash_s *hash, unsigned digest_bits)
+{
+	(void)digest_bits;
+	return tiger_create(hash);
+}
+
+static
+void
+tiger_mb_iv(union mb_state_u *iv, unsigned digest_bits)
+{
+	static const UINT64 initial_hash[3] = {
+			UINT64_INIT(0x01234567u, 0x89ABCDEFu),
+			UINT64_INIT(0xFEDCBA98u, 0x76543210u),
+			UINT64_INIT(0xF096A5B4u, 0xC3B2E187u) };
+	(void)digest_bits;
+	iv->w64[0] = initial_hash[0];
+	iv->w64[1] = initial_hash[1];
+	iv->w64[2] = initial_hash[2];
+}
+
+static const unsigned tiger_mb_bits[] = {192, 0};
+
+static const struct hashtest_mb tiger_mbs[] =
+{	{"x4", tiger_mb_create, tiger_mb_get_x4, NULL, tiger_mb_iv, tiger_mb_bits}
+,	{"x2", tiger_mb_create, tiger_mb_get_x2, NULL, tiger_mb_iv, tiger_mb_bits}
+,	{"portable", tiger_mb_create, tiger_mb_get_portable, NULL, tiger_mb_iv, tiger_mb_bits}
+,	{"jobs", tiger_mb_create, NULL, NULL, NULL, tiger_mb_bits}
+};
+
+static const struct unittest tiger_mb_internal_tests[] =
+{	{"x4", NULL, hashtest_mb_test, &tiger_mbs[0], NULL}
+,	{"x2", NULL, hashtest_mb_test, &tiger_mbs[1], NULL}
+,	{"portable", NULL, hashtest_mb_test, &tiger_mbs[2], NULL}
+,	{"jobs", NULL, hashtest_mb_test, &tiger_mbs[3], NULL}
+};
+
+static const struct unittest *tiger_mb_subtests[] =
+{	&tiger_mb_internal_tests[0]
+,	&tiger_mb_internal_tests[1]
+,	&tiger_mb_internal_tests[2]
+,	&tiger_mb_internal_tests[3]
+,	NULL
+};
+
+static const struct unittest tiger_mb_tests =
+{	"mb"
+,	"tiger multi-buffer engines against the hash object"
+,	NULL
+,	NULL
+,	tiger_mb_subtests
+};
+
 static const struct unittest tiger_internal_tests[] =
 {	{"test1", NULL, run_simple_tiger, &simple_tests[0], NULL}
 ,	{"test2", NULL, run_simple_tiger, &simple_tests[1], NULL}
@@ -140,6 +195,7 @@ static const struct unittest *tiger_subtests[] =
 ,	&tiger_internal_tests[9]
 ,	&tiger_internal_tests[10]
 ,	&tiger_internal_tests[11]
+,	&tiger_mb_tests
 ,	NULL
 };
 
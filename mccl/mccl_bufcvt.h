@@ -49,10 +49,119 @@
 #include <string.h>
 #endif
 
+/* Byte reversing conversions.
+ *
+ * When the byte order of the data is the opposite of the host's, GCC's
+ * byte swap builtins load each element with a single load and a bswap (or
+ * movbe) instead of assembling it from individual characters. On x86, long
+ * runs of elements are converted in vector registers with pshufb, using
+ * AVX2 or SSSE3 depending on what the processor supports. */
+#if defined(__GNUC__) && (CHAR_BIT == 8) && !MCCL_BUFCVT_SAFE
+#define MCCL_BUFCVT_BSWAP 1
+#endif
+
+/* UINT64 is a native integer which the 64-bit builtin can be used on. */
+#if MCCL_BUFCVT_BSWAP && (UIA64_NUMBITS == 64) && UIA64_UNPADDED && !FORCE_32BIT && defined(UIF64_MAX) && !TYPE_DEBUG
+#define MCCL_BUFCVT_BSWAP64 1
+#endif
+
+#if MCCL_BUFCVT_BSWAP && (UIF32_NUMBITS == 32) && UIF32_UNPADDED
+#include "mccl_cpuid.h"
+#ifdef MCCL_CPUID_X86
+#define MCCL_BUFCVT_X86 1
+#include <immintrin.h>
+#endif
+#endif
+
+#if MCCL_BUFCVT_X86
+
+/* Each of these converts nb_vectors vectors worth of elements. The shuffle
+ * masks reverse the bytes of each 32-bit or 64-bit element. */
+
+__attribute__((target("avx2")))
+static void bufcvt_bswap32_avx2(void *ele, const unsigned char *data, unsigned nb_vectors)
+{
+	const __m256i mask = _mm256_set_epi64x
+		(0x0C0D0E0F08090A0Bll, 0x0405060700010203ll
+		,0x0C0D0E0F08090A0Bll, 0x0405060700010203ll
+		);
+	unsigned i;
+	for (i = 0; i < nb_vectors; i++)
+		_mm256_storeu_si256((__m256i *)ele + i, _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)data + i), mask));
+}
+
+__attribute__((target("ssse3")))
+static void bufcvt_bswap32_ssse3(void *ele, const unsigned char *data, unsigned nb_vectors)
+{
+	const __m128i mask = _mm_set_epi64x(0x0C0D0E0F08090A0Bll, 0x0405060700010203ll);
+	unsigned i;
+	for (i = 0; i < nb_vectors; i++)
+		_mm_storeu_si128((__m128i *)ele + i, _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)data + i), mask));
+}
+
+__attribute__((target("avx2")))
+static void bufcvt_bswap64_avx2(void *ele, const unsigned char *data, unsigned nb_vectors)
+{
+	const __m256i mask = _mm256_set_epi64x
+		(0x08090A0B0C0D0E0Fll, 0x0001020304050607ll
+		,0x08090A0B0C0D0E0Fll, 0x0001020304050607ll
+		);
+	unsigned i;
+	for (i = 0; i < nb_vectors; i++)
+		_mm256_storeu_si256((__m256i *)ele + i, _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)data + i), mask));
+}
+
+__attribute__((target("ssse3")))
+static void bufcvt_bswap64_ssse3(void *ele, const unsigned char *data, unsigned nb_vectors)
+{
+	const __m128i mask = _mm_set_epi64x(0x08090A0B0C0D0E0Fll, 0x0001020304050607ll);
+	unsigned i;
+	for (i = 0; i < nb_vectors; i++)
+		_mm_storeu_si128((__m128i *)ele + i, _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)data + i), mask));
+}
+
+/* Converts as many leading elements of size element_size as fit in whole
+ * vectors and returns how many were converted. Runs of a single hash block
+ * or less are left to the scalar code: bswap already handles those at load
+ * speed and the dispatch would cost more than it saves. */
+static INLINE unsigned bufcvt_bswap_bulk(void *ele, const unsigned char *data, unsigned nb_elements, unsigned element_size)
+{
+	const unsigned nb_bytes = nb_elements * element_size;
+	unsigned features;
+
+	if (nb_bytes < 256)
+		return 0;
+
+	features = mccl_cpu_features();
+	if (features & MCCL_CPU_AVX2) {
+		if (element_size == 4)
+			bufcvt_bswap32_avx2(ele, data, nb_bytes / 32);
+		else
+			bufcvt_bswap64_avx2(ele, data, nb_bytes / 32);
+		return (nb_bytes / 32) * 32 / element_size;
+	}
+	if (features & MCCL_CPU_SSSE3) {
+		if (element_size == 4)
+			bufcvt_bswap32_ssse3(ele, data, nb_bytes / 16);
+		else
+			bufcvt_bswap64_ssse3(ele, data, nb_bytes / 16);
+		return (nb_bytes / 16) * 16 / element_size;
+	}
+	return 0;
+}
+
+#endif /* MCCL_BUFCVT_X86 */
+
 static INLINE void bufcvt_le32_to_uif32(mccl_uif32 *ele, const unsigned char *data, unsigned nb_elements)
 {
 #if (CHAR_BIT == 8) && (UIF32_NUMBITS == 32) && UIF32_UNPADDED && MCCL_ENDIAN_LITTLE && !MCCL_BUFCVT_SAFE
 	memcpy(ele, data, 4 * nb_elements);
+#elif MCCL_BUFCVT_BSWAP && (UIF32_NUMBITS == 32) && UIF32_UNPADDED && MCCL_ENDIAN_BIG
+	unsigned i;
+	for (i = 0; i < nb_elements; i++, data += 4) {
+		memcpy(&ele[i], data, 4);
+		ele[i] = __builtin_bswap32(ele[i]);
+	}
 #else
 	unsigned i;
 	for (i = 0; i < nb_elements; i++, data += 4) {
@@ -68,6 +177,16 @@ static INLINE void bufcvt_be32_to_uif32(mccl_uif32 *ele, const unsigned char *da
 {
 #if (CHAR_BIT == 8) && (UIF32_NUMBITS == 32) && UIF32_UNPADDED && MCCL_ENDIAN_BIG && !MCCL_BUFCVT_SAFE
 	memcpy(ele, data, 4 * nb_elements);
+#elif MCCL_BUFCVT_BSWAP && (UIF32_NUMBITS == 32) && UIF32_UNPADDED && MCCL_ENDIAN_LITTLE
+	unsigned i = 0;
+#if MCCL_BUFCVT_X86
+	i = bufcvt_bswap_bulk(ele, data, nb_elements, 4);
+	data += 4 * i;
+#endif
+	for (; i < nb_elements; i++, data += 4) {
+		memcpy(&ele[i], data, 4);
+		ele[i] = __builtin_bswap32(ele[i]);
+	}
 #else
 	unsigned i;
 	for (i = 0; i < nb_elements; i++, data += 4) {
@@ -83,6 +202,12 @@ static INLINE void bufcvt_le64_to_UINT64(UINT64 *ele, const unsigned char *data,
 {
 #if (CHAR_BIT == 8) && (UIA64_NUMBITS == 64) && UIA64_UNPADDED && MCCL_ENDIAN_LITTLE && !MCCL_BUFCVT_SAFE
 	memcpy(ele, data, 8 * nb_elements);
+#elif MCCL_BUFCVT_BSWAP64 && MCCL_ENDIAN_BIG
+	unsigned i;
+	for (i = 0; i < nb_elements; i++, data += 8) {
+		memcpy(&ele[i], data, 8);
+		ele[i] = __builtin_bswap64(ele[i]);
+	}
 #else
 	unsigned i;
 	for (i = 0; i < nb_elements; i++, data += 8) {
@@ -104,6 +229,16 @@ static INLINE void bufcvt_be64_to_UINT64(UINT64 *ele, const unsigned char *data,
 {
 #if (CHAR_BIT == 8) && (UIA64_NUMBITS == 64) && UIA64_UNPADDED && MCCL_ENDIAN_BIG && !MCCL_BUFCVT_SAFE
 	memcpy(ele, data, 8 * nb_elements);
+#elif MCCL_BUFCVT_BSWAP64 && MCCL_ENDIAN_LITTLE
+	unsigned i = 0;
+#if MCCL_BUFCVT_X86
+	i = bufcvt_bswap_bulk(ele, data, nb_elements, 8);
+	data += 8 * i;
+#endif
+	for (; i < nb_elements; i++, data += 8) {
+		memcpy(&ele[i], data, 8);
+		ele[i] = __builtin_bswap64(ele[i]);
+	}
 #else
 	unsigned i;
 	for (i = 0; i < nb_elements; i++, data += 8) {
@@ -0,0 +1,160 @@
+/* Copyright (c) 2014, Nicholas Appleton (http://www.appletonaudio.com)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither Nicholas Appleton nor the names of its contributors may be
+ *       used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL NICHOLAS APPLETON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE. */
+
+#ifndef MCCL_CPUID_H_
+#define MCCL_CPUID_H_
+
+/* Runtime detection of the instruction set extensions which optimised code
+ * paths depend on.
+ *
+ * mccl_cpu_features() returns the set of MCCL_CPU_* flags which are usable on
+ * the processor the program is running on. The result is computed once. On
+ * targets where detection is not implemented, it always returns zero and
+ * only portable code will be selected.
+ *
+ * MCCL_CPUID_X86 is defined when the compiler can generate code for the x86
+ * extensions (via the GCC target attribute) and detection is available. */
+
+#include "mccl/mccl_inline.h"
+#include <stddef.h>
+
+#define MCCL_CPU_SSE2     (1u << 0)
+#define MCCL_CPU_SSSE3    (1u << 1)
+#define MCCL_CPU_SSE41    (1u << 2)
+#define MCCL_CPU_SHA      (1u << 3)
+#define MCCL_CPU_AVX      (1u << 4)
+#define MCCL_CPU_AVX2     (1u << 5)
+#define MCCL_CPU_BMI2     (1u << 6)
+#define MCCL_CPU_AVX512F  (1u << 7)
+#define MCCL_CPU_AVX512VL (1u << 8)
+#define MCCL_CPU_AVX512BW (1u << 9)
+#define MCCL_CPU_SHA512   (1u << 10)
+
+/* Returns the lower case name of a single MCCL_CPU_* flag or NULL if the
+ * flag is not known. */
+static INLINE const char *mccl_cpu_feature_name(unsigned feature)
+{
+	switch (feature) {
+	case MCCL_CPU_SSE2:     return "sse2";
+	case MCCL_CPU_SSSE3:    return "ssse3";
+	case MCCL_CPU_SSE41:    return "sse4.1";
+	case MCCL_CPU_SHA:      return "sha";
+	case MCCL_CPU_AVX:      return "avx";
+	case MCCL_CPU_AVX2:     return "avx2";
+	case MCCL_CPU_BMI2:     return "bmi2";
+	case MCCL_CPU_AVX512F:  return "avx512f";
+	case MCCL_CPU_AVX512VL: return "avx512vl";
+	case MCCL_CPU_AVX512BW: return "avx512bw";
+	case MCCL_CPU_SHA512:   return "sha512";
+	}
+	return NULL;
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+
+#define MCCL_CPUID_X86 (1)
+
+#include <cpuid.h>
+
+/* Returns the low word of the XCR0 register which says which register files
+ * the operating system saves on a context switch. Only valid when CPUID
+ * reports OSXSAVE. */
+static INLINE unsigned mccl_xgetbv0(void)
+{
+	unsigned lo, hi;
+	__asm__ __volatile__("xgetbv" : "=a" (lo), "=d" (hi) : "c" (0));
+	(void)hi;
+	return lo;
+}
+
+/* Set once the features have been probed so that zero can be cached. */
+#define MCCL_CPU_PROBED (1u << 31)
+
+static INLINE unsigned mccl_cpu_features(void)
+{
+	static unsigned cached = 0;
+	unsigned features = __atomic_load_n(&cached, __ATOMIC_RELAXED);
+
+	if (!features) {
+		unsigned max_leaf = __get_cpuid_max(0, 0);
+		unsigned a, b, c, d;
+		int ymm_saved = 0;
+		int zmm_saved = 0;
+
+		features = MCCL_CPU_PROBED;
+
+		if (max_leaf >= 1) {
+			__cpuid(1, a, b, c, d);
+			if (d & (1u << 26)) features |= MCCL_CPU_SSE2;
+			if (c & (1u << 9))  features |= MCCL_CPU_SSSE3;
+			if (c & (1u << 19)) features |= MCCL_CPU_SSE41;
+
+			/* The AVX registers are only usable if the operating system
+			 * has enabled saving of the XMM and YMM state, and the AVX-512
+			 * ones if it also saves the opmask and ZMM state. */
+			if ((c & (1u << 27)) && (c & (1u << 28))) {
+				unsigned xcr0 = mccl_xgetbv0();
+				ymm_saved = (xcr0 & 0x06u) == 0x06u;
+				zmm_saved = (xcr0 & 0xE6u) == 0xE6u;
+			}
+			if (ymm_saved)
+				features |= MCCL_CPU_AVX;
+		}
+
+		if (max_leaf >= 7) {
+			__cpuid_count(7, 0, a, b, c, d);
+			if (b & (1u << 29)) features |= MCCL_CPU_SHA;
+			if ((b & (1u << 5)) && ymm_saved) features |= MCCL_CPU_AVX2;
+			if (b & (1u << 8))  features |= MCCL_CPU_BMI2;
+			if ((b & (1u << 16)) && zmm_saved) {
+				features |= MCCL_CPU_AVX512F;
+				if (b & (1u << 31)) features |= MCCL_CPU_AVX512VL;
+				if (b & (1u << 30)) features |= MCCL_CPU_AVX512BW;
+			}
+			/* Sub-leaf 1 exists if sub-leaf 0 reports it in eax. The SHA512
+			 * instructions operate on YMM registers. */
+			if (a >= 1) {
+				__cpuid_count(7, 1, a, b, c, d);
+				if ((a & (1u << 0)) && ymm_saved) features |= MCCL_CPU_SHA512;
+			}
+		}
+
+		__atomic_store_n(&cached, features, __ATOMIC_RELAXED);
+	}
+
+	return features & ~MCCL_CPU_PROBED;
+}
+
+#else
+
+static INLINE unsigned mccl_cpu_features(void)
+{
+	return 0;
+}
+
+#endif
+
+#endif /* MCCL_CPUID_H_ */